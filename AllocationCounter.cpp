@@ -0,0 +1,98 @@
+#include "AllocationCounter.hpp"
+
+#if defined (GPS_COUNT_ALLOCATIONS)
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace gps {
+
+    namespace {
+
+        std::atomic<uint64_t> heapAllocations(0);
+        thread_local uint64_t threadHeapAllocations = 0;
+
+        void* CountedAllocate(size_t size) {
+
+            heapAllocations.fetch_add(1, std::memory_order_relaxed);
+            threadHeapAllocations++;
+            return std::malloc(size != 0 ? size : 1);
+        }
+    }
+
+    uint64_t GetHeapAllocations() {
+        return heapAllocations.load(std::memory_order_relaxed);
+    }
+
+    uint64_t GetThreadHeapAllocations() {
+        return threadHeapAllocations;
+    }
+
+    void AddThreadHeapAllocations(uint64_t count) {
+        threadHeapAllocations += count;
+    }
+}
+
+void* operator new(size_t size) {
+
+    void* pointer = gps::CountedAllocate(size);
+    if (pointer == NULL) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return gps::CountedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return gps::CountedAllocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+
+#else
+
+namespace gps {
+
+    uint64_t GetHeapAllocations() {
+        return 0;
+    }
+
+    uint64_t GetThreadHeapAllocations() {
+        return 0;
+    }
+
+    void AddThreadHeapAllocations(uint64_t) {
+    }
+}
+
+#endif
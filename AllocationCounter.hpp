@@ -0,0 +1,26 @@
+#ifndef AllocationCounter_hpp
+#define AllocationCounter_hpp
+
+#include <cstdint>
+
+namespace gps {
+
+    // Counts the calls to the global operator new. Built with GPS_COUNT_ALLOCATIONS defined,
+    // AllocationCounter.cpp replaces it with a counting version over malloc; without it the
+    // standard allocator is left alone and the counts stay 0. Differences between two
+    // readings give the number of heap allocations made by the code in between.
+#if defined (GPS_COUNT_ALLOCATIONS)
+    const bool HEAP_ALLOCATIONS_COUNTED = true;
+#else
+    const bool HEAP_ALLOCATIONS_COUNTED = false;
+#endif
+
+    // On every thread
+    uint64_t GetHeapAllocations();
+    // On the calling thread, plus what helper threads credited to it
+    uint64_t GetThreadHeapAllocations();
+    // Credits allocations made by a helper thread for the calling thread's work (after joining it)
+    void AddThreadHeapAllocations(uint64_t count);
+}
+
+#endif /* AllocationCounter_hpp */
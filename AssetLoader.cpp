@@ -0,0 +1,137 @@
+#include "AssetLoader.hpp"
+#include "AllocationCounter.hpp"
+#include "GeometryArena.hpp"
+#include "LinearArena.hpp"
+#include "TextureRegistry.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace gps {
+
+    void AssetLoader::Add(gps::Model3D& model, std::string fileName, std::string basePath) {
+
+        Job job;
+        job.model = &model;
+        job.fileName = fileName;
+        job.basePath = basePath;
+        job.prepareSeconds = 0.0;
+        job.prepared = false;
+        jobs.push_back(job);
+    }
+
+    bool AssetLoader::LoadAll(unsigned int threadCount) {
+
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+        uint64_t heapAllocations = gps::GetHeapAllocations();
+
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        threadCount = std::min(threadCount, (unsigned int)jobs.size());
+
+        // the hardware threads are shared between the workers and the parsers they start,
+        // so a cold start (no mesh caches) runs about one thread per core instead of N x N
+        unsigned int parseThreads = std::max(1u, std::thread::hardware_concurrency() / std::max(threadCount, 1u));
+
+        // models are handed out in queue order, callers should add the largest first
+        std::atomic<size_t> nextJob(0);
+        // a model failed, the remaining ones are only handed back
+        std::atomic<bool> failed(false);
+
+        std::mutex readyMutex;
+        std::condition_variable readyCondition;
+        std::deque<size_t> readyJobs;
+
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < threadCount; t++) {
+
+            workers.push_back(std::thread([&]() {
+
+                for (size_t j = nextJob++; j < jobs.size(); j = nextJob++) {
+
+                    if (!failed) {
+
+                        Clock::time_point jobStart = Clock::now();
+                        jobs[j].prepared = jobs[j].model->PrepareModel(jobs[j].fileName, jobs[j].basePath, parseThreads);
+                        jobs[j].prepareSeconds = std::chrono::duration<double>(Clock::now() - jobStart).count();
+                        if (!jobs[j].prepared) {
+                            failed = true;
+                        }
+                    }
+
+                    std::lock_guard<std::mutex> lock(readyMutex);
+                    readyJobs.push_back(j);
+                    readyCondition.notify_one();
+                }
+            }));
+        }
+
+        // upload on this thread in completion order
+        double uploadSeconds = 0.0;
+        for (size_t uploaded = 0; uploaded < jobs.size(); uploaded++) {
+
+            size_t j;
+            {
+                std::unique_lock<std::mutex> lock(readyMutex);
+                readyCondition.wait(lock, [&]() { return !readyJobs.empty(); });
+                j = readyJobs.front();
+                readyJobs.pop_front();
+            }
+
+            if (!jobs[j].prepared) {
+
+                // why it failed, the skipped ones have nothing to say
+                jobs[j].model->PrintLoadLog(std::cerr);
+                continue;
+            }
+            if (failed) {
+                continue;
+            }
+
+            Clock::time_point uploadStart = Clock::now();
+            jobs[j].model->UploadModel();
+            uploadSeconds += std::chrono::duration<double>(Clock::now() - uploadStart).count();
+        }
+
+        // the workers' loader arenas are freed as their threads end, this one's after the uploads
+        for (size_t t = 0; t < workers.size(); t++) {
+            workers[t].join();
+        }
+        gps::LinearArena::ForThread().Release();
+
+        if (failed) {
+
+            std::cerr << "ERROR: loading stopped, a model could not be loaded" << std::endl;
+            jobs.clear();
+            return false;
+        }
+
+        double prepareSeconds = 0.0;
+        double slowestSeconds = 0.0;
+        for (size_t j = 0; j < jobs.size(); j++) {
+
+            prepareSeconds += jobs[j].prepareSeconds;
+            slowestSeconds = std::max(slowestSeconds, jobs[j].prepareSeconds);
+        }
+
+        double totalSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+        std::cout << "Loaded " << jobs.size() << " models on " << threadCount << " threads (" << parseThreads << " per .obj parse) in " << totalSeconds << " s"
+            << " (prepare sum " << prepareSeconds << " s, slowest " << slowestSeconds << " s, upload " << uploadSeconds << " s)";
+        if (gps::HEAP_ALLOCATIONS_COUNTED) {
+            std::cout << ", " << gps::GetHeapAllocations() - heapAllocations << " heap allocations";
+        }
+        std::cout << std::endl;
+        gps::TextureRegistry::Get().PrintStats();
+        gps::GeometryArena::Get().PrintStats();
+
+        jobs.clear();
+        return true;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef AssetLoader_hpp
+#define AssetLoader_hpp
+
+#include "Model3D.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Loads a batch of models in parallel: parsing and texture decoding run on
+    // worker threads, the OpenGL uploads run on the thread calling LoadAll
+    // (which must own the context) as soon as each model is ready
+    class AssetLoader {
+
+    public:
+        // Queues a model, nothing is loaded until LoadAll
+        void Add(gps::Model3D& model, std::string fileName, std::string basePath);
+
+        // Loads every queued model and returns once all of them are uploaded.
+        // threadCount = 0 uses one worker per hardware thread. Returns false, after
+        // printing why, as soon as a model fails to load: the models not started
+        // yet are skipped and the ones prepared meanwhile are not uploaded.
+        bool LoadAll(unsigned int threadCount = 0);
+
+    private:
+        struct Job {
+            gps::Model3D* model;
+            std::string fileName;
+            std::string basePath;
+            double prepareSeconds;
+            // set by the worker, false for skipped jobs too
+            bool prepared;
+        };
+
+        std::vector<Job> jobs;
+    };
+}
+
+#endif /* AssetLoader_hpp */
@@ -0,0 +1,641 @@
+#include "Benchmark.hpp"
+#include "AllocationCounter.hpp"
+#include "FrameUniforms.hpp"
+#include "GLState.hpp"
+#include "LinearArena.hpp"
+#include "Model3D.hpp"
+#include "ObjParser.hpp"
+#include "RenderQueue.hpp"
+#include "SceneBVH.hpp"
+#include "TextureProcessing.hpp"
+#include "Window.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+namespace gps {
+
+    namespace {
+
+        typedef std::chrono::steady_clock Clock;
+
+        double SecondsSince(Clock::time_point start) {
+
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        // .obj files of the scene and their texture folders, as loaded by initModels
+        const char* SCENE_MODELS[][2] = {
+            { "objects/castle.obj", "textures/castle/" },
+            { "objects/church.obj", "textures/church/" },
+            { "objects/pisaTower.obj", "textures/tower/" },
+            { "objects/Grillparzer_C.obj", "textures/statuet/" },
+            { "objects/ground.obj", "textures/ground/" },
+            { "objects/skydome.obj", "textures/sky/" },
+            { "objects/tree.obj", "textures/tree/" },
+            { "objects/3DModel.obj", "textures/building/" },
+            { "objects/house1.obj", "textures/house1/" },
+            { "objects/tavern2.obj", "textures/house2/" },
+            { "objects/medievalHouse3.obj", "textures/house3/" },
+            { "objects/Tavern.obj", "textures/tavern/" }
+        };
+
+        bool SameIndex(const tinyobj::index_t& a, const tinyobj::index_t& b) {
+
+            return a.vertex_index == b.vertex_index && a.normal_index == b.normal_index && a.texcoord_index == b.texcoord_index;
+        }
+
+        bool SameShapes(const std::vector<tinyobj::shape_t>& a, const std::vector<tinyobj::shape_t>& b) {
+
+            if (a.size() != b.size()) {
+                return false;
+            }
+
+            for (size_t s = 0; s < a.size(); s++) {
+
+                const tinyobj::mesh_t& meshA = a[s].mesh;
+                const tinyobj::mesh_t& meshB = b[s].mesh;
+                if (a[s].name != b[s].name || meshA.indices.size() != meshB.indices.size()
+                    || meshA.num_face_vertices != meshB.num_face_vertices || meshA.material_ids != meshB.material_ids) {
+
+                    return false;
+                }
+
+                for (size_t i = 0; i < meshA.indices.size(); i++) {
+                    if (!SameIndex(meshA.indices[i], meshB.indices[i])) {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        int RunObjBenchmark(const std::vector<std::string>& args) {
+
+            std::vector<std::pair<std::string, std::string> > files;
+            for (size_t i = 0; i + 1 < args.size(); i += 2) {
+                files.push_back(std::make_pair(args[i], args[i + 1]));
+            }
+            if (files.empty()) {
+                for (size_t i = 0; i < sizeof(SCENE_MODELS) / sizeof(SCENE_MODELS[0]); i++) {
+                    files.push_back(std::make_pair(SCENE_MODELS[i][0], SCENE_MODELS[i][1]));
+                }
+            }
+
+            const int runs = 3;
+            bool allIdentical = true;
+            double tinyobjTotal = 0.0;
+            double parallelTotal = 0.0;
+
+            std::cout << std::left << std::setw(32) << "file" << std::setw(14) << "tinyobj (s)"
+                << std::setw(14) << "parallel (s)" << std::setw(10) << "speedup" << "output" << std::endl;
+
+            for (size_t f = 0; f < files.size(); f++) {
+
+                const std::string& fileName = files[f].first;
+                const std::string& basePath = files[f].second;
+
+                tinyobj::attrib_t attribA, attribB;
+                std::vector<tinyobj::shape_t> shapesA, shapesB;
+                std::vector<tinyobj::material_t> materialsA, materialsB;
+                std::string errA, errB;
+                bool retA = false, retB = false;
+
+                // best of a few runs, the first one also warms up the page cache
+                double tinyobjSeconds = 1e30;
+                double parallelSeconds = 1e30;
+                for (int r = 0; r < runs; r++) {
+
+                    materialsA.clear();
+                    errA.clear();
+                    Clock::time_point start = Clock::now();
+                    retA = tinyobj::LoadObj(&attribA, &shapesA, &materialsA, &errA, fileName.c_str(), basePath.c_str(), true);
+                    tinyobjSeconds = std::min(tinyobjSeconds, SecondsSince(start));
+
+                    materialsB.clear();
+                    errB.clear();
+                    tinyobj::MaterialFileReader readMatFn(basePath);
+                    start = Clock::now();
+                    retB = gps::LoadObjParallel(&attribB, &shapesB, &materialsB, &errB, fileName, &readMatFn);
+                    parallelSeconds = std::min(parallelSeconds, SecondsSince(start));
+                }
+
+                if (!retA || !retB) {
+                    std::cout << std::setw(32) << fileName << "could not be loaded" << std::endl;
+                    allIdentical = allIdentical && retA == retB;
+                    continue;
+                }
+
+                bool identical = attribA.vertices == attribB.vertices && attribA.normals == attribB.normals
+                    && attribA.texcoords == attribB.texcoords && materialsA.size() == materialsB.size()
+                    && SameShapes(shapesA, shapesB);
+                allIdentical = allIdentical && identical;
+
+                tinyobjTotal += tinyobjSeconds;
+                parallelTotal += parallelSeconds;
+
+                std::cout << std::setw(32) << fileName << std::setw(14) << tinyobjSeconds << std::setw(14) << parallelSeconds
+                    << std::setw(10) << tinyobjSeconds / parallelSeconds << (identical ? "identical" : "DIFFERENT") << std::endl;
+            }
+
+            std::cout << std::setw(32) << "total" << std::setw(14) << tinyobjTotal << std::setw(14) << parallelTotal
+                << std::setw(10) << (parallelTotal > 0.0 ? tinyobjTotal / parallelTotal : 0.0) << std::endl;
+
+            return allIdentical ? 0 : 1;
+        }
+
+        // Model3D::PrepareModel parsing every file (mesh cache off) with the loader arenas off and on.
+        // The counts cover all threads, the parser's included, and need GPS_COUNT_ALLOCATIONS.
+        int RunLoaderBenchmark(const std::vector<std::string>& args) {
+
+            if (!gps::HEAP_ALLOCATIONS_COUNTED) {
+                std::cout << "Heap allocations are not counted, build with GPS_COUNT_ALLOCATIONS defined" << std::endl;
+            }
+
+            std::vector<std::pair<std::string, std::string> > files;
+            for (size_t i = 0; i + 1 < args.size(); i += 2) {
+                files.push_back(std::make_pair(args[i], args[i + 1]));
+            }
+            if (files.empty()) {
+                for (size_t i = 0; i < sizeof(SCENE_MODELS) / sizeof(SCENE_MODELS[0]); i++) {
+                    files.push_back(std::make_pair(SCENE_MODELS[i][0], SCENE_MODELS[i][1]));
+                }
+            }
+
+            uint64_t allocationTotals[2] = { 0, 0 };
+            double secondTotals[2] = { 0.0, 0.0 };
+
+            std::cout << std::left << std::setw(32) << "file" << std::setw(16) << "heap allocs"
+                << std::setw(16) << "with arena" << std::setw(12) << "time (s)" << "with arena (s)" << std::endl;
+
+            for (size_t f = 0; f < files.size(); f++) {
+
+                uint64_t allocations[2];
+                double seconds[2];
+
+                for (int arena = 0; arena < 2; arena++) {
+
+                    gps::LinearArena::SetEnabled(arena == 1);
+                    // no blocks left over from the previous file
+                    gps::LinearArena::ForThread().Release();
+
+                    uint64_t before = gps::GetHeapAllocations();
+                    Clock::time_point start = Clock::now();
+                    {
+                        gps::Model3D model;
+                        model.SetUseMeshCache(false);
+                        model.PrepareModel(files[f].first, files[f].second);
+                    }
+                    seconds[arena] = SecondsSince(start);
+                    allocations[arena] = gps::GetHeapAllocations() - before;
+
+                    allocationTotals[arena] += allocations[arena];
+                    secondTotals[arena] += seconds[arena];
+                }
+
+                std::cout << std::setw(32) << files[f].first << std::setw(16) << allocations[0] << std::setw(16) << allocations[1]
+                    << std::setw(12) << seconds[0] << seconds[1] << std::endl;
+            }
+
+            gps::LinearArena::SetEnabled(true);
+            gps::LinearArena::ForThread().Release();
+
+            std::cout << std::setw(32) << "total" << std::setw(16) << allocationTotals[0] << std::setw(16) << allocationTotals[1]
+                << std::setw(12) << secondTotals[0] << secondTotals[1] << std::endl;
+            return 0;
+        }
+
+        // The flip loop ReadTextureFromFile used before the texture kernels
+        void FlipRowsByteLoop(unsigned char* image_data, int width_in_bytes, int y) {
+
+            unsigned char *top = NULL;
+            unsigned char *bottom = NULL;
+            unsigned char temp = 0;
+            int half_height = y / 2;
+
+            for (int row = 0; row < half_height; row++) {
+
+                top = image_data + row * width_in_bytes;
+                bottom = image_data + (y - row - 1) * width_in_bytes;
+
+                for (int col = 0; col < width_in_bytes; col++) {
+
+                    temp = *top;
+                    *top = *bottom;
+                    *bottom = temp;
+                    top++;
+                    bottom++;
+                }
+            }
+        }
+
+        const char* SIMD_LEVEL_NAMES[] = { "scalar", "sse2", "avx2" };
+
+        // Times one kernel (best of a few runs) and prints it against the first row of its table
+        template <typename Kernel>
+        double TimeKernel(const std::string& name, size_t bytes, double baseline, Kernel kernel) {
+
+            double best = 1e30;
+            for (int r = 0; r < 5; r++) {
+
+                Clock::time_point start = Clock::now();
+                kernel();
+                best = std::min(best, SecondsSince(start));
+            }
+
+            std::cout << "  " << std::setw(24) << name << std::setw(12) << best * 1000.0
+                << std::setw(12) << bytes / best / 1e9 << std::setw(10) << (baseline > 0.0 ? baseline / best : 1.0) << std::endl;
+            return best;
+        }
+
+        int RunTextureBenchmark(const std::vector<std::string>& args) {
+
+            std::vector<int> sizes;
+            for (size_t i = 0; i < args.size(); i++) {
+                sizes.push_back(atoi(args[i].c_str()));
+            }
+            if (sizes.empty()) {
+                // 4K and 8K square textures
+                sizes.push_back(4096);
+                sizes.push_back(8192);
+            }
+
+            TextureSimdLevel best = GetTextureSimdLevel();
+            std::cout << "Best SIMD level : " << SIMD_LEVEL_NAMES[best] << std::endl;
+
+            std::mt19937 random(1234);
+            bool allIdentical = true;
+
+            for (size_t s = 0; s < sizes.size(); s++) {
+
+                int size = sizes[s];
+                size_t pixelCount = (size_t)size * size;
+                size_t rowBytes = (size_t)size * 4;
+
+                std::vector<unsigned char> rgb(pixelCount * 3);
+                for (size_t i = 0; i < rgb.size(); i++) {
+                    rgb[i] = (unsigned char)random();
+                }
+
+                std::vector<unsigned char> rgba(pixelCount * 4);
+                std::vector<unsigned char> reference(pixelCount * 4);
+
+                std::cout << size << "x" << size << std::endl;
+                std::cout << "  " << std::setw(24) << "kernel" << std::setw(12) << "ms" << std::setw(12) << "GB/s" << std::setw(10) << "speedup" << std::endl;
+
+                // RGB -> RGBA, writing the rows bottom up like the texture cooker
+                double baseline = 0.0;
+                for (int level = TEXTURE_SIMD_SCALAR; level <= best; level++) {
+
+                    std::vector<unsigned char>& out = level == TEXTURE_SIMD_SCALAR ? reference : rgba;
+                    double seconds = TimeKernel(std::string("rgb->rgba ") + SIMD_LEVEL_NAMES[level], pixelCount * 7, baseline, [&]() {
+                        for (int row = 0; row < size; row++) {
+                            ConvertRowToRGBA(&rgb[(size_t)(size - row - 1) * size * 3], 3, &out[row * rowBytes], size, (TextureSimdLevel)level);
+                        }
+                    });
+                    if (level == TEXTURE_SIMD_SCALAR) {
+                        baseline = seconds;
+                    }
+                    else {
+                        allIdentical = allIdentical && rgba == reference;
+                    }
+                }
+
+                // vertical flip, each kernel result is flipped back with the scalar kernel and compared
+                baseline = TimeKernel("flip byte loop", pixelCount * 8, 0.0, [&]() {
+                    FlipRowsByteLoop(reference.data(), (int)rowBytes, size);
+                });
+                for (int level = TEXTURE_SIMD_SCALAR; level <= best; level++) {
+
+                    // the byte loop ran an odd number of times, so reference is flipped, same for rgba below
+                    rgba = reference;
+                    TimeKernel(std::string("flip ") + SIMD_LEVEL_NAMES[level], pixelCount * 8, baseline, [&]() {
+                        FlipRows(rgba.data(), rowBytes, size, (TextureSimdLevel)level);
+                    });
+                    FlipRows(rgba.data(), rowBytes, size, TEXTURE_SIMD_SCALAR);
+                    allIdentical = allIdentical && rgba == reference;
+                }
+
+                // premultiply, checked once from the source, then timed in place
+                std::vector<unsigned char> source(reference);
+                for (size_t i = 3; i < source.size(); i += 4) {
+                    source[i] = (unsigned char)random();
+                }
+                baseline = 0.0;
+                for (int level = TEXTURE_SIMD_SCALAR; level <= best; level++) {
+
+                    std::vector<unsigned char>& out = level == TEXTURE_SIMD_SCALAR ? reference : rgba;
+                    out = source;
+                    PremultiplyAlpha(out.data(), pixelCount, (TextureSimdLevel)level);
+                    if (level != TEXTURE_SIMD_SCALAR) {
+                        allIdentical = allIdentical && rgba == reference;
+                    }
+
+                    std::vector<unsigned char> scratch(source);
+                    double seconds = TimeKernel(std::string("premultiply ") + SIMD_LEVEL_NAMES[level], pixelCount * 8, baseline, [&]() {
+                        PremultiplyAlpha(scratch.data(), pixelCount, (TextureSimdLevel)level);
+                    });
+                    if (level == TEXTURE_SIMD_SCALAR) {
+                        baseline = seconds;
+                    }
+                }
+            }
+
+            std::cout << (allIdentical ? "SIMD output identical to scalar" : "SIMD output DIFFERENT from scalar") << std::endl;
+            return allIdentical ? 0 : 1;
+        }
+
+        // Draws count trees on a grid, one Model3D::Submit per tree (the per-object loop
+        // of renderScene, direct or through the indirect path) against one
+        // Model3D::SubmitInstances, in a hidden window
+        int RunInstancingBenchmark(const std::vector<std::string>& args) {
+
+            int count = args.empty() ? 10000 : atoi(args[0].c_str());
+            int result = 0;
+            const int FRAMES = 50;
+            const int SIZE = 256;
+
+            gps::Window window;
+            try {
+                window.Create(SIZE, SIZE, "Instancing benchmark", false);
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+
+            {
+                GLState::Get().SetEnabled(GL_DEPTH_TEST, true);
+                GLState::Get().SetEnabled(GL_CULL_FACE, true);
+                glViewport(0, 0, SIZE, SIZE);
+
+                gps::Model3D tree;
+                tree.LoadModel("objects/tree.obj", "textures/tree/");
+
+                gps::Shader basicShader;
+                basicShader.loadShader("shaders/basic.vert", "shaders/basic.frag");
+                gps::Shader indirectShader;
+                indirectShader.loadShader("shaders/basic_indirect.vert", "shaders/basic.frag");
+
+                // trees on a square grid, 4 units apart, seen from above one corner
+                int side = (int)std::ceil(std::sqrt((double)count));
+                std::vector<glm::mat4> models;
+                for (int i = 0; i < count; i++) {
+                    glm::vec3 position((i % side) * 4.0f, 0.0f, -(i / side) * 4.0f);
+                    models.push_back(glm::translate(glm::mat4(1.0f), position));
+                }
+
+                gps::FrameUniforms frameUniforms;
+                frameUniforms.Create();
+                frameUniforms.Attach(basicShader);
+                frameUniforms.Attach(indirectShader);
+
+                gps::FrameData frameData = gps::FrameData();
+                frameData.view = glm::lookAt(glm::vec3(-20.0f, 60.0f, 20.0f), glm::vec3(side * 2.0f, 0.0f, -side * 2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+                frameData.projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 2000.0f);
+                frameData.lightDir = glm::vec3(0.0f, 1.0f, 1.0f);
+                frameData.lightColor = glm::vec3(1.0f);
+                frameUniforms.Update(frameData);
+
+                struct Case {
+                    const char* name;
+                    gps::SubmitMode mode;
+                    const gps::Shader* shader;
+                    bool instanced;
+                };
+                const Case cases[] = {
+                    { "per-object loop", SUBMIT_DIRECT, &basicShader, false },
+                    { "per-object indirect", SUBMIT_INDIRECT, &indirectShader, false },
+                    { "instanced", SUBMIT_DIRECT, &indirectShader, true }
+                };
+
+                // the default count is past what one upload of the draw data holds, the queue
+                // splits it into windows and the uploads column shows how many
+                size_t maxInstances = RenderQueue::GetMaxDrawDataInstances();
+                std::cout << count << " trees of " << tree.GetMeshCount() << " meshes, multi-draw indirect "
+                    << (RenderQueue::IsMultiDrawIndirectSupported() ? "available" : "not available")
+                    << ", " << maxInstances << " instances per draw data upload" << std::endl;
+                std::cout << std::setw(24) << "path" << std::setw(12) << "draw calls" << std::setw(10) << "uploads" << std::setw(14) << "CPU ms" << std::setw(14) << "frame ms" << std::endl;
+
+                gps::RenderQueue queue;
+                for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+
+                    queue.SetSubmitMode(cases[c].mode);
+                    double cpuSeconds = 0.0;
+                    double frameSeconds = 0.0;
+
+                    // the first frames create buffers and warm the driver up
+                    for (int frame = -5; frame < FRAMES; frame++) {
+
+                        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                        glFinish();
+
+                        Clock::time_point start = Clock::now();
+                        queue.Begin(frameData.view, frameData.projection, 2000.0f);
+                        if (cases[c].instanced) {
+                            tree.SubmitInstances(queue, RENDER_LAYER_OPAQUE, *cases[c].shader, models);
+                        }
+                        else {
+                            for (size_t i = 0; i < models.size(); i++) {
+                                tree.Submit(queue, RENDER_LAYER_OPAQUE, *cases[c].shader, models[i]);
+                            }
+                        }
+                        queue.Execute();
+                        double cpu = SecondsSince(start);
+                        glFinish();
+                        double total = SecondsSince(start);
+
+                        if (frame >= 0) {
+                            cpuSeconds += cpu;
+                            frameSeconds += total;
+                        }
+                    }
+
+                    const RenderQueueStats& stats = queue.GetStats();
+                    if (stats.largestDrawDataUpload > maxInstances) {
+                        std::cerr << "ERROR: " << cases[c].name << " uploaded " << stats.largestDrawDataUpload << " instances of draw data at once" << std::endl;
+                        result = 1;
+                    }
+
+                    std::cout << std::setw(24) << cases[c].name << std::setw(12) << stats.drawCalls << std::setw(10) << stats.drawDataUploads
+                        << std::setw(14) << std::fixed << std::setprecision(3) << cpuSeconds * 1000.0 / FRAMES
+                        << std::setw(14) << frameSeconds * 1000.0 / FRAMES << std::endl;
+                }
+
+                queue.Delete();
+                frameUniforms.Delete();
+                // the tree and shaders go away here, while the context still exists
+            }
+
+            window.Delete();
+            return result;
+        }
+
+        // Builds a SceneBVH over count random boxes spread over a village sized square and
+        // times it against the linear loops it replaces: frustum culling from a few
+        // cameras, and rays (checked against a brute force search over every box)
+        int RunBvhBenchmark(const std::vector<std::string>& args) {
+
+            int count = args.empty() ? 100000 : atoi(args[0].c_str());
+            const int BUILDS = 3;
+            const int VIEWS = 16;
+            const int RAYS = 1000;
+
+            // about one object every 8 x 8 units, 1 to 6 units wide, up to 20 high
+            std::mt19937 random(1234);
+            float side = std::sqrt((float)count) * 8.0f;
+            std::uniform_real_distribution<float> position(0.0f, side);
+            std::uniform_real_distribution<float> size(0.5f, 3.0f);
+            std::uniform_real_distribution<float> height(0.5f, 10.0f);
+
+            std::vector<gps::BoundingBox> boxes(count);
+            for (int i = 0; i < count; i++) {
+                boxes[i].extent = glm::vec3(size(random), height(random), size(random));
+                boxes[i].center = glm::vec3(position(random), boxes[i].extent.y, -position(random));
+            }
+
+            gps::SceneBVH bvh;
+            double buildSeconds = 1e30;
+            for (int b = 0; b < BUILDS; b++) {
+
+                Clock::time_point start = Clock::now();
+                bvh.Build(boxes);
+                buildSeconds = std::min(buildSeconds, SecondsSince(start));
+            }
+
+            std::cout << count << " objects, " << bvh.GetNodeCount() << " nodes" << std::endl;
+            std::cout << std::fixed << std::setprecision(3);
+            std::cout << "  build           " << buildSeconds * 1000.0 << " ms" << std::endl;
+            std::cout << "  memory          " << bvh.GetMemoryUsage() / (1024.0 * 1024.0) << " MB ("
+                << (double)bvh.GetMemoryUsage() / count << " bytes per object)" << std::endl;
+
+            // 1% of the objects move, then everything is refitted once
+            Clock::time_point start = Clock::now();
+            for (int i = 0; i < count; i += 100) {
+                boxes[i].center += glm::vec3(2.0f, 0.0f, -1.0f);
+                bvh.Update((uint32_t)i, boxes[i]);
+            }
+            double updateSeconds = SecondsSince(start);
+            start = Clock::now();
+            bvh.Refit();
+            double refitSeconds = SecondsSince(start);
+            std::cout << "  update 1%       " << updateSeconds * 1000.0 << " ms" << std::endl;
+            std::cout << "  refit           " << refitSeconds * 1000.0 << " ms" << std::endl;
+
+            // cameras looking over the square from its border
+            bool identical = true;
+            double bvhCullSeconds = 0.0;
+            double linearCullSeconds = 0.0;
+            size_t nodesTested = 0;
+            size_t visibleCount = 0;
+            glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+            glm::vec3 center(side * 0.5f, 0.0f, -side * 0.5f);
+            std::vector<uint32_t> visible;
+            std::vector<uint32_t> reference;
+            for (int v = 0; v < VIEWS; v++) {
+
+                float angle = v * 6.2831853f / VIEWS;
+                glm::vec3 eye = center + glm::vec3(std::cos(angle), 0.0f, std::sin(angle)) * (side * 0.5f) + glm::vec3(0.0f, 20.0f, 0.0f);
+                gps::Frustum frustum;
+                frustum.Extract(projection * glm::lookAt(eye, center, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+                visible.clear();
+                start = Clock::now();
+                nodesTested += bvh.Cull(frustum, visible);
+                bvhCullSeconds += SecondsSince(start);
+
+                reference.clear();
+                start = Clock::now();
+                for (int i = 0; i < count; i++) {
+                    if (frustum.TestBox(boxes[i]) != FRUSTUM_OUTSIDE) {
+                        reference.push_back((uint32_t)i);
+                    }
+                }
+                linearCullSeconds += SecondsSince(start);
+
+                std::sort(visible.begin(), visible.end());
+                identical = identical && visible == reference;
+                visibleCount += visible.size();
+            }
+            std::cout << "  frustum cull    " << bvhCullSeconds * 1000.0 / VIEWS << " ms, " << nodesTested / VIEWS << " nodes tested, "
+                << visibleCount / VIEWS << " visible (linear " << linearCullSeconds * 1000.0 / VIEWS << " ms)" << std::endl;
+
+            // rays from above the square, pointing down and across
+            std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+            double bvhRaySeconds = 0.0;
+            double linearRaySeconds = 0.0;
+            size_t nodesVisited = 0;
+            int hits = 0;
+            for (int r = 0; r < RAYS; r++) {
+
+                glm::vec3 origin(position(random), 30.0f, -position(random));
+                glm::vec3 direction = glm::normalize(glm::vec3(unit(random), -1.0f, unit(random)));
+
+                uint32_t object = 0;
+                float distance = 0.0f;
+                size_t visited = 0;
+                start = Clock::now();
+                bool hit = bvh.Raycast(origin, direction, 1000.0f, object, distance, &visited);
+                bvhRaySeconds += SecondsSince(start);
+                nodesVisited += visited;
+
+                // every box, same slab test
+                start = Clock::now();
+                float nearest = 1000.0f;
+                bool referenceHit = false;
+                glm::vec3 inverseDirection = glm::vec3(1.0f) / direction;
+                for (int i = 0; i < count; i++) {
+
+                    glm::vec3 t1 = (boxes[i].center - boxes[i].extent - origin) * inverseDirection;
+                    glm::vec3 t2 = (boxes[i].center + boxes[i].extent - origin) * inverseDirection;
+                    glm::vec3 nearT = glm::min(t1, t2);
+                    glm::vec3 farT = glm::max(t1, t2);
+                    float enter = std::max(std::max(nearT.x, nearT.y), std::max(nearT.z, 0.0f));
+                    float exit = std::min(std::min(farT.x, farT.y), std::min(farT.z, nearest));
+                    if (enter <= exit) {
+                        nearest = enter;
+                        referenceHit = true;
+                    }
+                }
+                linearRaySeconds += SecondsSince(start);
+
+                identical = identical && hit == referenceHit && (!hit || distance == nearest);
+                hits += hit ? 1 : 0;
+            }
+            std::cout << "  raycast         " << bvhRaySeconds * 1e6 / RAYS << " us, " << (double)nodesVisited / RAYS << " nodes visited, "
+                << hits << " / " << RAYS << " hits (linear " << linearRaySeconds * 1e6 / RAYS << " us)" << std::endl;
+
+            std::cout << (identical ? "BVH results identical to the linear search" : "BVH results DIFFERENT from the linear search") << std::endl;
+            return identical ? 0 : 1;
+        }
+    }
+
+    int RunBenchmark(const std::string& name, const std::vector<std::string>& args) {
+
+        if (name == "obj") {
+            return RunObjBenchmark(args);
+        }
+        if (name == "loader") {
+            return RunLoaderBenchmark(args);
+        }
+        if (name == "texture") {
+            return RunTextureBenchmark(args);
+        }
+        if (name == "instancing") {
+            return RunInstancingBenchmark(args);
+        }
+        if (name == "bvh") {
+            return RunBvhBenchmark(args);
+        }
+
+        std::cerr << "Unknown benchmark " << name << std::endl;
+        return 1;
+    }
+}
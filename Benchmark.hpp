@@ -0,0 +1,19 @@
+#ifndef Benchmark_hpp
+#define Benchmark_hpp
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Runs an offline benchmark selected from the command line (--benchmark <name> [args]),
+    // without showing a window. Returns the process exit code.
+    //   obj [file.obj basePath]...  tinyobj::LoadObj against gps::LoadObjParallel
+    //   loader [file.obj basePath]... heap allocations (GPS_COUNT_ALLOCATIONS builds) and time of Model3D::PrepareModel without / with the loader arenas
+    //   texture [size]...            flip / RGB->RGBA / premultiply kernels on 4K and 8K images
+    //   instancing [count]           10k trees drawn one by one against one instanced draw (hidden window)
+    //   bvh [count]                  SceneBVH build / refit / culling / raycasts over 100k random boxes
+    int RunBenchmark(const std::string& name, const std::vector<std::string>& args);
+}
+
+#endif /* Benchmark_hpp */
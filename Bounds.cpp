@@ -0,0 +1,70 @@
+#include "Bounds.hpp"
+
+#include "Mesh.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    Bounds ComputeBounds(const std::vector<gps::Vertex>& vertices) {
+
+        Bounds bounds;
+        if (vertices.empty()) {
+            bounds.box.center = bounds.box.extent = bounds.sphere.center = glm::vec3(0.0f);
+            bounds.sphere.radius = 0.0f;
+            return bounds;
+        }
+
+        glm::vec3 minimum = vertices[0].Position;
+        glm::vec3 maximum = vertices[0].Position;
+        for (size_t i = 1; i < vertices.size(); i++) {
+            minimum = glm::min(minimum, vertices[i].Position);
+            maximum = glm::max(maximum, vertices[i].Position);
+        }
+        bounds.box.center = (minimum + maximum) * 0.5f;
+        bounds.box.extent = (maximum - minimum) * 0.5f;
+
+        // usually much tighter than the sphere around the box corners
+        float radiusSquared = 0.0f;
+        for (size_t i = 0; i < vertices.size(); i++) {
+            glm::vec3 offset = vertices[i].Position - bounds.box.center;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+        bounds.sphere.center = bounds.box.center;
+        bounds.sphere.radius = std::sqrt(radiusSquared);
+        return bounds;
+    }
+
+    Bounds MergeBounds(const Bounds& a, const Bounds& b) {
+
+        Bounds merged;
+        glm::vec3 minimum = glm::min(a.box.center - a.box.extent, b.box.center - b.box.extent);
+        glm::vec3 maximum = glm::max(a.box.center + a.box.extent, b.box.center + b.box.extent);
+        merged.box.center = (minimum + maximum) * 0.5f;
+        merged.box.extent = (maximum - minimum) * 0.5f;
+
+        // the sphere around the box center that holds both spheres
+        merged.sphere.center = merged.box.center;
+        merged.sphere.radius = std::max(glm::length(a.sphere.center - merged.box.center) + a.sphere.radius,
+                                        glm::length(b.sphere.center - merged.box.center) + b.sphere.radius);
+        // never looser than the sphere around the box corners
+        merged.sphere.radius = std::min(merged.sphere.radius, glm::length(merged.box.extent));
+        return merged;
+    }
+
+    Bounds TransformBounds(const Bounds& bounds, const glm::mat4& model) {
+
+        Bounds transformed;
+        glm::mat3 linear(model);
+        glm::mat3 absolute(glm::abs(linear[0]), glm::abs(linear[1]), glm::abs(linear[2]));
+
+        transformed.box.center = glm::vec3(model * glm::vec4(bounds.box.center, 1.0f));
+        transformed.box.extent = absolute * bounds.box.extent;
+
+        float scaleSquared = std::max(glm::dot(linear[0], linear[0]), std::max(glm::dot(linear[1], linear[1]), glm::dot(linear[2], linear[2])));
+        transformed.sphere.center = glm::vec3(model * glm::vec4(bounds.sphere.center, 1.0f));
+        transformed.sphere.radius = bounds.sphere.radius * std::sqrt(scaleSquared);
+        return transformed;
+    }
+}
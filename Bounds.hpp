@@ -0,0 +1,42 @@
+#ifndef Bounds_hpp
+#define Bounds_hpp
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gps {
+
+    struct Vertex;
+
+    // Axis aligned box, stored as center and half size so transforms and plane tests
+    // need no corners
+    struct BoundingBox {
+        glm::vec3 center;
+        glm::vec3 extent;
+    };
+
+    struct BoundingSphere {
+        glm::vec3 center;
+        float radius;
+    };
+
+    // Both volumes of a mesh or model: the sphere is the cheap early test, the box the tight one
+    struct Bounds {
+        BoundingBox box;
+        BoundingSphere sphere;
+    };
+
+    // Box of the positions, and the sphere around the box center reaching the farthest position.
+    // Empty meshes get a zero sized volume at the origin.
+    Bounds ComputeBounds(const std::vector<gps::Vertex>& vertices);
+
+    // Smallest volumes holding both
+    Bounds MergeBounds(const Bounds& a, const Bounds& b);
+
+    // Volumes holding the transformed volumes: the box is refitted from the matrix
+    // (Arvo's method), the sphere radius grows by the largest axis scale
+    Bounds TransformBounds(const Bounds& bounds, const glm::mat4& model);
+}
+
+#endif /* Bounds_hpp */
@@ -0,0 +1,53 @@
+#include "FrameUniforms.hpp"
+
+#include <cstddef>
+
+namespace gps {
+
+    // std140 offsets of the FrameData block
+    static_assert(sizeof(SpotLightData) == 48, "SpotLightData does not match std140");
+    static_assert(sizeof(PointLightData) == 48, "PointLightData does not match std140");
+    static_assert(offsetof(FrameData, lightDir) == 128, "FrameData does not match std140");
+    static_assert(offsetof(FrameData, lightColor) == 144, "FrameData does not match std140");
+    static_assert(offsetof(FrameData, spotLight) == 160, "FrameData does not match std140");
+    static_assert(offsetof(FrameData, pointLight) == 208, "FrameData does not match std140");
+    static_assert(offsetof(FrameData, fogColor) == 256, "FrameData does not match std140");
+    static_assert(sizeof(FrameData) == 272, "FrameData does not match std140");
+
+    FrameUniforms::FrameUniforms()
+        : buffer(0) {}
+
+    void FrameUniforms::Create() {
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        // stays bound for the lifetime of the context, programs only select the binding point
+        glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, buffer);
+    }
+
+    void FrameUniforms::Delete() {
+
+        if (buffer != 0) {
+            glDeleteBuffers(1, &buffer);
+            buffer = 0;
+        }
+    }
+
+    void FrameUniforms::Attach(const gps::Shader& shader) const {
+
+        GLuint blockIndex = glGetUniformBlockIndex(shader.shaderProgram, "FrameData");
+        if (blockIndex != GL_INVALID_INDEX) {
+            glUniformBlockBinding(shader.shaderProgram, blockIndex, BINDING);
+        }
+    }
+
+    void FrameUniforms::Update(const FrameData& data) {
+
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef FrameUniforms_hpp
+#define FrameUniforms_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Shader.hpp"
+
+namespace gps {
+
+    // Per-frame state shared by every program through the std140 "FrameData" uniform
+    // block (see shaders/basic.vert). The C++ structs mirror the GLSL layout exactly:
+    // a vec3 followed by a float shares one 16 byte slot, structs round up to 16 bytes.
+
+    struct SpotLightData {
+        glm::vec3 position;
+        float cutOff;
+        glm::vec3 direction;
+        float outerCutOff;
+        glm::vec3 color;
+        float padding;
+    };
+
+    struct PointLightData {
+        glm::vec3 position;
+        float constant;
+        glm::vec3 color;
+        float linear;
+        float quadratic;
+        float padding[3];
+    };
+
+    struct FrameData {
+        glm::mat4 view;
+        glm::mat4 projection;
+        // directional light
+        glm::vec3 lightDir;
+        float fogDensity;
+        glm::vec3 lightColor;
+        float padding;
+        // lights in eye space
+        SpotLightData spotLight;
+        PointLightData pointLight;
+        glm::vec4 fogColor;
+    };
+
+    // Owns the uniform buffer behind the FrameData block
+    class FrameUniforms {
+
+    public:
+        // the block has no binding qualifier in GLSL 4.10, Attach assigns this one
+        static const GLuint BINDING = 0;
+
+        FrameUniforms();
+
+        // Creates the buffer and binds it to BINDING, needs a current context
+        void Create();
+        void Delete();
+
+        // Points the program's FrameData block (if it has one) at the shared buffer
+        void Attach(const gps::Shader& shader) const;
+
+        // Uploads the whole block with one glBufferSubData
+        void Update(const FrameData& data);
+
+    private:
+        GLuint buffer;
+    };
+}
+
+#endif /* FrameUniforms_hpp */
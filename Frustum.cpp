@@ -0,0 +1,154 @@
+#include "Frustum.hpp"
+
+#include <cfloat>
+#include <cmath>
+
+#if defined (_M_X64) || defined (__x86_64__) || defined (__SSE__) || (defined (_M_IX86_FP) && _M_IX86_FP >= 1)
+    #define GPS_FRUSTUM_SSE
+    #include <xmmintrin.h>
+#endif
+
+namespace gps {
+
+    namespace {
+
+#if defined (GPS_FRUSTUM_SSE)
+        // Outside if any plane has the volume fully behind it, inside if every plane has it fully in front
+        inline FrustumTest Classify(__m128 distance, __m128 radius) {
+
+            const __m128 zero = _mm_setzero_ps();
+            if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), zero)) != 0) {
+                return FRUSTUM_OUTSIDE;
+            }
+            if (_mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), zero)) != 0) {
+                return FRUSTUM_INTERSECTS;
+            }
+            return FRUSTUM_INSIDE;
+        }
+
+        // Signed distances of a point to the 4 planes of a group
+        inline __m128 PlaneDistance(const float (&group)[4][4], const glm::vec3& point) {
+
+            __m128 distance = _mm_load_ps(group[3]);
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_load_ps(group[0]), _mm_set1_ps(point.x)));
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_load_ps(group[1]), _mm_set1_ps(point.y)));
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_load_ps(group[2]), _mm_set1_ps(point.z)));
+            return distance;
+        }
+
+        inline FrustumTest Combine(FrustumTest a, FrustumTest b) {
+            return a < b ? a : b;
+        }
+#endif
+    }
+
+    Frustum::Frustum() {
+
+        // until Extract, every plane keeps everything inside; the padding lanes stay that way,
+        // so no radius ever reaches them and the SSE tests agree with the scalar ones
+        for (int group = 0; group < 2; group++) {
+            for (int lane = 0; lane < 4; lane++) {
+                planes[group][0][lane] = planes[group][1][lane] = planes[group][2][lane] = 0.0f;
+                planes[group][3][lane] = FLT_MAX;
+            }
+        }
+    }
+
+    void Frustum::Extract(const glm::mat4& viewProjection) {
+
+        // rows of the matrix (glm is column major)
+        glm::vec4 rows[4];
+        for (int r = 0; r < 4; r++) {
+            rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+        }
+
+        // left, right, bottom, top, near, far
+        glm::vec4 extracted[PLANE_COUNT] = {
+            rows[3] + rows[0], rows[3] - rows[0],
+            rows[3] + rows[1], rows[3] - rows[1],
+            rows[3] + rows[2], rows[3] - rows[2]
+        };
+
+        *this = Frustum();
+        for (int p = 0; p < PLANE_COUNT; p++) {
+
+            glm::vec4 plane = extracted[p] / glm::length(glm::vec3(extracted[p]));
+            for (int component = 0; component < 4; component++) {
+                planes[p / 4][component][p % 4] = plane[component];
+            }
+        }
+    }
+
+    FrustumTest Frustum::TestSphere(const BoundingSphere& sphere) const {
+
+#if defined (GPS_FRUSTUM_SSE)
+        __m128 radius = _mm_set1_ps(sphere.radius);
+        return Combine(Classify(PlaneDistance(planes[0], sphere.center), radius),
+                       Classify(PlaneDistance(planes[1], sphere.center), radius));
+#else
+        FrustumTest result = FRUSTUM_INSIDE;
+        for (int p = 0; p < PLANE_COUNT; p++) {
+
+            const float (&group)[4][4] = planes[p / 4];
+            int lane = p % 4;
+            float distance = group[0][lane] * sphere.center.x + group[1][lane] * sphere.center.y
+                + group[2][lane] * sphere.center.z + group[3][lane];
+            if (distance < -sphere.radius) {
+                return FRUSTUM_OUTSIDE;
+            }
+            if (distance < sphere.radius) {
+                result = FRUSTUM_INTERSECTS;
+            }
+        }
+        return result;
+#endif
+    }
+
+    FrustumTest Frustum::TestBox(const BoundingBox& box) const {
+
+#if defined (GPS_FRUSTUM_SSE)
+        // projected radius: |n| . extent
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        FrustumTest result = FRUSTUM_INSIDE;
+        for (int group = 0; group < 2; group++) {
+
+            __m128 radius = _mm_mul_ps(_mm_andnot_ps(signMask, _mm_load_ps(planes[group][0])), _mm_set1_ps(box.extent.x));
+            radius = _mm_add_ps(radius, _mm_mul_ps(_mm_andnot_ps(signMask, _mm_load_ps(planes[group][1])), _mm_set1_ps(box.extent.y)));
+            radius = _mm_add_ps(radius, _mm_mul_ps(_mm_andnot_ps(signMask, _mm_load_ps(planes[group][2])), _mm_set1_ps(box.extent.z)));
+
+            result = Combine(result, Classify(PlaneDistance(planes[group], box.center), radius));
+            if (result == FRUSTUM_OUTSIDE) {
+                break;
+            }
+        }
+        return result;
+#else
+        FrustumTest result = FRUSTUM_INSIDE;
+        for (int p = 0; p < PLANE_COUNT; p++) {
+
+            const float (&group)[4][4] = planes[p / 4];
+            int lane = p % 4;
+            float distance = group[0][lane] * box.center.x + group[1][lane] * box.center.y
+                + group[2][lane] * box.center.z + group[3][lane];
+            float radius = std::fabs(group[0][lane]) * box.extent.x + std::fabs(group[1][lane]) * box.extent.y
+                + std::fabs(group[2][lane]) * box.extent.z;
+            if (distance < -radius) {
+                return FRUSTUM_OUTSIDE;
+            }
+            if (distance < radius) {
+                result = FRUSTUM_INTERSECTS;
+            }
+        }
+        return result;
+#endif
+    }
+
+    FrustumTest Frustum::Test(const Bounds& bounds) const {
+
+        FrustumTest sphere = TestSphere(bounds.sphere);
+        if (sphere != FRUSTUM_INTERSECTS) {
+            return sphere;
+        }
+        return TestBox(bounds.box);
+    }
+}
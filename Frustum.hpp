@@ -0,0 +1,45 @@
+#ifndef Frustum_hpp
+#define Frustum_hpp
+
+#include "Bounds.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+namespace gps {
+
+    // Culling result of one volume
+    enum FrustumTest {
+        FRUSTUM_OUTSIDE = 0,
+        FRUSTUM_INTERSECTS = 1,
+        // completely inside, nothing it contains needs testing
+        FRUSTUM_INSIDE = 2
+    };
+
+    // The 6 planes of projection * view, normals pointing inside. The planes are kept
+    // as 4 wide rows (x of 4 planes, y of 4 planes, ...), so the SSE tests check 4
+    // planes per instruction; the 2 unused lanes hold a plane everything is in front of.
+    class Frustum {
+
+    public:
+        Frustum();
+
+        // Gribb / Hartmann extraction from an OpenGL clip matrix
+        void Extract(const glm::mat4& viewProjection);
+
+        FrustumTest TestSphere(const BoundingSphere& sphere) const;
+        FrustumTest TestBox(const BoundingBox& box) const;
+
+        // Sphere test first, box test only when the sphere is not decided
+        FrustumTest Test(const Bounds& bounds) const;
+
+    private:
+        static const int PLANE_COUNT = 6;
+
+        // [group][component][lane]: group 0 is planes 0-3, group 1 planes 4-5 and padding
+        alignas(16) float planes[2][4][4];
+    };
+}
+
+#endif /* Frustum_hpp */
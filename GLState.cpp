@@ -0,0 +1,177 @@
+#include "GLState.hpp"
+
+#include <cstring>
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+
+        // a name no object has, forces the next call through
+        const GLuint UNKNOWN_NAME = ~0u;
+    }
+
+    GLState::GLState() {
+
+        memset(&current, 0, sizeof(current));
+        memset(&lastFrame, 0, sizeof(lastFrame));
+        Invalidate();
+    }
+
+    GLState& GLState::Get() {
+
+        // never destroyed, the global models forget their VAOs during static destruction
+        static GLState* state = new GLState();
+        return *state;
+    }
+
+    bool GLState::UseProgram(GLuint program) {
+
+        if (this->program == program) {
+            current.programCallsFiltered++;
+            return false;
+        }
+
+        glUseProgram(program);
+        this->program = program;
+        current.programCalls++;
+        return true;
+    }
+
+    bool GLState::BindVertexArray(GLuint vao) {
+
+        if (this->vao == vao) {
+            current.vaoCallsFiltered++;
+            return false;
+        }
+
+        glBindVertexArray(vao);
+        this->vao = vao;
+        current.vaoCalls++;
+        return true;
+    }
+
+    bool GLState::BindTexture(GLuint unit, GLuint texture, GLenum target) {
+
+        std::vector<GLuint>& bound = target == GL_TEXTURE_BUFFER ? unitBufferTextures : unitTextures;
+        if (unit < bound.size() && bound[unit] == texture) {
+            current.textureCallsFiltered++;
+            return false;
+        }
+
+        SelectTextureUnit(unit);
+        glBindTexture(target, texture);
+        if (unit >= bound.size()) {
+            bound.resize(unit + 1, UNKNOWN_NAME);
+        }
+        bound[unit] = texture;
+        current.textureCalls++;
+        return true;
+    }
+
+    bool GLState::SelectTextureUnit(GLuint unit) {
+
+        if (activeUnit == unit) {
+            current.activeTextureCallsFiltered++;
+            return false;
+        }
+
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+        current.activeTextureCalls++;
+        return true;
+    }
+
+    bool GLState::SetEnabled(GLenum capability, bool enabled) {
+
+        size_t i = 0;
+        while (i < capabilities.size() && capabilities[i].name != capability) {
+            i++;
+        }
+
+        if (i < capabilities.size() && capabilities[i].enabled == enabled) {
+            current.capabilityCallsFiltered++;
+            return false;
+        }
+
+        if (enabled) {
+            glEnable(capability);
+        }
+        else {
+            glDisable(capability);
+        }
+
+        if (i == capabilities.size()) {
+            Capability added = { capability, enabled };
+            capabilities.push_back(added);
+        }
+        capabilities[i].enabled = enabled;
+        current.capabilityCalls++;
+        return true;
+    }
+
+    void GLState::ForgetProgram(GLuint program) {
+
+        // a program in use stays in use until another replaces it, only the name can be reused
+        if (this->program == program) {
+            this->program = UNKNOWN_NAME;
+        }
+    }
+
+    void GLState::ForgetVertexArray(GLuint vao) {
+
+        if (this->vao == vao) {
+            this->vao = 0;
+        }
+    }
+
+    void GLState::ForgetTexture(GLuint texture) {
+
+        for (size_t unit = 0; unit < unitTextures.size(); unit++) {
+            if (unitTextures[unit] == texture) {
+                unitTextures[unit] = 0;
+            }
+        }
+        for (size_t unit = 0; unit < unitBufferTextures.size(); unit++) {
+            if (unitBufferTextures[unit] == texture) {
+                unitBufferTextures[unit] = 0;
+            }
+        }
+    }
+
+    void GLState::Invalidate() {
+
+        program = UNKNOWN_NAME;
+        vao = UNKNOWN_NAME;
+        activeUnit = UNKNOWN_NAME;
+        unitTextures.clear();
+        unitBufferTextures.clear();
+        capabilities.clear();
+    }
+
+    void GLState::EndFrame() {
+
+        lastFrame = current;
+        memset(&current, 0, sizeof(current));
+    }
+
+    const GLStateStats& GLState::GetFrameStats() const {
+
+        return lastFrame;
+    }
+
+    void GLState::PrintFrameStats() const {
+
+        size_t issued = lastFrame.programCalls + lastFrame.vaoCalls + lastFrame.activeTextureCalls
+            + lastFrame.textureCalls + lastFrame.capabilityCalls;
+        size_t filtered = lastFrame.programCallsFiltered + lastFrame.vaoCallsFiltered + lastFrame.activeTextureCallsFiltered
+            + lastFrame.textureCallsFiltered + lastFrame.capabilityCallsFiltered;
+
+        std::cout << "GL state : " << issued << " calls issued, " << filtered << " filtered (program "
+            << lastFrame.programCalls << "/" << lastFrame.programCallsFiltered << ", VAO "
+            << lastFrame.vaoCalls << "/" << lastFrame.vaoCallsFiltered << ", active texture "
+            << lastFrame.activeTextureCalls << "/" << lastFrame.activeTextureCallsFiltered << ", texture "
+            << lastFrame.textureCalls << "/" << lastFrame.textureCallsFiltered << ", enable "
+            << lastFrame.capabilityCalls << "/" << lastFrame.capabilityCallsFiltered << ")" << std::endl;
+    }
+}
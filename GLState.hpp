@@ -0,0 +1,86 @@
+#ifndef GLState_hpp
+#define GLState_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // Calls that reached the driver and calls dropped because the state was already set
+    struct GLStateStats {
+        size_t programCalls;
+        size_t programCallsFiltered;
+        size_t vaoCalls;
+        size_t vaoCallsFiltered;
+        size_t activeTextureCalls;
+        size_t activeTextureCallsFiltered;
+        size_t textureCalls;
+        size_t textureCallsFiltered;
+        size_t capabilityCalls;
+        size_t capabilityCallsFiltered;
+    };
+
+    // Shadow copy of the binding state of the OpenGL context: current program, VAO,
+    // active texture unit, the 2D and buffer texture of each unit and the depth test / cull face
+    // switches. All engine binds go through it so calls that would not change
+    // anything are never made. Objects deleted while bound must be reported with the
+    // Forget functions, the context unbinds them. Single context, GL thread only.
+    class GLState {
+
+    public:
+        static GLState& Get();
+
+        // Each returns true if the GL call was made
+        bool UseProgram(GLuint program);
+        bool BindVertexArray(GLuint vao);
+        // Binds a GL_TEXTURE_2D or GL_TEXTURE_BUFFER texture to a unit, selecting the unit first if needed
+        bool BindTexture(GLuint unit, GLuint texture, GLenum target = GL_TEXTURE_2D);
+        // Makes a unit active, for glTexParameter calls on the texture bound to it
+        bool SelectTextureUnit(GLuint unit);
+        // GL_DEPTH_TEST, GL_CULL_FACE, ...
+        bool SetEnabled(GLenum capability, bool enabled);
+
+        void ForgetProgram(GLuint program);
+        void ForgetVertexArray(GLuint vao);
+        void ForgetTexture(GLuint texture);
+
+        // Forgets everything, for code that changed the state without the tracker
+        void Invalidate();
+
+        // Closes the counts of the current frame
+        void EndFrame();
+
+        // Counts of the last finished frame
+        const GLStateStats& GetFrameStats() const;
+        void PrintFrameStats() const;
+
+    private:
+        GLState();
+
+        struct Capability {
+            GLenum name;
+            bool enabled;
+        };
+
+        GLuint program;
+        GLuint vao;
+        GLuint activeUnit;
+        // per unit, the texture of each tracked target
+        std::vector<GLuint> unitTextures;
+        std::vector<GLuint> unitBufferTextures;
+        std::vector<Capability> capabilities;
+
+        GLStateStats current;
+        GLStateStats lastFrame;
+    };
+}
+
+#endif /* GLState_hpp */
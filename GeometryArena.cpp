@@ -0,0 +1,348 @@
+#include "GeometryArena.hpp"
+
+#include "GLState.hpp"
+#include "Mesh.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+
+        // 8 MB of full vertices (4 MB packed) and 2 MB of 16 bit indices (4 MB of 32 bit) before the first growth
+        const size_t INITIAL_VERTEX_CAPACITY = 1 << 18;
+        const size_t INITIAL_INDEX_CAPACITY = 1 << 20;
+
+        // type of each index slot of the arena
+        const GLenum INDEX_TYPES[] = { GL_UNSIGNED_SHORT, GL_UNSIGNED_INT };
+
+        size_t GrownCapacity(size_t capacity, size_t needed) {
+            return std::max(capacity * 2, capacity + needed);
+        }
+
+        // New buffer of the given size with the first copySize bytes of the old one
+        GLuint ReallocateBuffer(GLuint oldBuffer, size_t copySize, size_t newSize) {
+
+            GLuint buffer;
+            glGenBuffers(1, &buffer);
+            // the copy targets are not part of the VAO state, binding them here cannot change a VAO
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, newSize, NULL, GL_STATIC_DRAW);
+
+            if (oldBuffer != 0) {
+                if (copySize > 0) {
+                    glBindBuffer(GL_COPY_READ_BUFFER, oldBuffer);
+                    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, copySize);
+                    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+                }
+                glDeleteBuffers(1, &oldBuffer);
+            }
+
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            return buffer;
+        }
+
+        void UploadRange(GLuint buffer, size_t offset, size_t size, const void* data) {
+
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+    }
+
+    GeometryArena::RangeAllocator::RangeAllocator()
+        : capacity(0), used(0) {}
+
+    bool GeometryArena::RangeAllocator::Allocate(size_t count, size_t& offset) {
+
+        if (count == 0) {
+            offset = 0;
+            return true;
+        }
+
+        for (size_t i = 0; i < freeBlocks.size(); i++) {
+
+            Block& block = freeBlocks[i];
+            if (block.count >= count) {
+
+                offset = block.offset;
+                block.offset += count;
+                block.count -= count;
+                if (block.count == 0) {
+                    freeBlocks.erase(freeBlocks.begin() + i);
+                }
+                used += count;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void GeometryArena::RangeAllocator::Free(size_t offset, size_t count) {
+
+        if (count == 0) {
+            return;
+        }
+        used -= count;
+        AddFreeBlock(offset, count);
+    }
+
+    void GeometryArena::RangeAllocator::Grow(size_t newCapacity) {
+
+        if (newCapacity > capacity) {
+            AddFreeBlock(capacity, newCapacity - capacity);
+            capacity = newCapacity;
+        }
+    }
+
+    void GeometryArena::RangeAllocator::AddFreeBlock(size_t offset, size_t count) {
+
+        size_t i = 0;
+        while (i < freeBlocks.size() && freeBlocks[i].offset < offset) {
+            i++;
+        }
+
+        Block block = { offset, count };
+        freeBlocks.insert(freeBlocks.begin() + i, block);
+
+        // merge with the next block, then with the previous one
+        if (i + 1 < freeBlocks.size() && freeBlocks[i].offset + freeBlocks[i].count == freeBlocks[i + 1].offset) {
+            freeBlocks[i].count += freeBlocks[i + 1].count;
+            freeBlocks.erase(freeBlocks.begin() + i + 1);
+        }
+        if (i > 0 && freeBlocks[i - 1].offset + freeBlocks[i - 1].count == freeBlocks[i].offset) {
+            freeBlocks[i - 1].count += freeBlocks[i].count;
+            freeBlocks.erase(freeBlocks.begin() + i);
+        }
+    }
+
+    GeometryArena::GeometryArena()
+        : drawIndexBuffer(0), drawIndexCapacity(0) {
+
+        for (int format = 0; format < VERTEX_FORMAT_COUNT; format++) {
+            for (int slot = 0; slot < INDEX_TYPE_COUNT; slot++) {
+                stores[format].vaos[slot] = 0;
+            }
+            stores[format].vertexBuffer = 0;
+        }
+        for (int slot = 0; slot < INDEX_TYPE_COUNT; slot++) {
+            indexStores[slot].indexBuffer = 0;
+        }
+    }
+
+    GeometryArena& GeometryArena::Get() {
+
+        // never destroyed, the global models free their ranges during static destruction
+        static GeometryArena* arena = new GeometryArena();
+        return *arena;
+    }
+
+    GeometryRange GeometryArena::Allocate(const std::vector<gps::Vertex>& vertices, const std::vector<GLuint>& indices) {
+
+        return Allocate(VERTEX_FORMAT_FULL, vertices.data(), vertices.size(), indices);
+    }
+
+    GeometryRange GeometryArena::Allocate(const std::vector<gps::PackedVertex>& vertices, const std::vector<GLuint>& indices) {
+
+        return Allocate(VERTEX_FORMAT_PACKED, vertices.data(), vertices.size(), indices);
+    }
+
+    GeometryRange GeometryArena::Allocate(VertexFormat format, const void* vertices, size_t vertexCount,
+                                          const std::vector<GLuint>& indices) {
+
+        // the indices are relative to the range, so its size alone decides the type
+        GLenum indexType = vertexCount <= SHORT_INDEX_VERTICES ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        int slot = IndexSlot(indexType);
+        VertexStore& store = stores[format];
+        IndexStore& indexStore = indexStores[slot];
+
+        if (store.vertexBuffer == 0) {
+            ResizeVertices(format, std::max(INITIAL_VERTEX_CAPACITY, vertexCount));
+        }
+        if (indexStore.indexBuffer == 0) {
+            ResizeIndices(slot, std::max(INITIAL_INDEX_CAPACITY, indices.size()));
+        }
+        if (store.vaos[slot] == 0) {
+            glGenVertexArrays(1, &store.vaos[slot]);
+            SetupVertexArray(format, slot);
+        }
+
+        size_t vertexOffset;
+        while (!store.space.Allocate(vertexCount, vertexOffset)) {
+            ResizeVertices(format, GrownCapacity(store.space.capacity, vertexCount));
+        }
+        size_t indexOffset;
+        while (!indexStore.space.Allocate(indices.size(), indexOffset)) {
+            ResizeIndices(slot, GrownCapacity(indexStore.space.capacity, indices.size()));
+        }
+
+        size_t vertexSize = GetVertexSize(format);
+        if (vertexCount > 0) {
+            UploadRange(store.vertexBuffer, vertexOffset * vertexSize, vertexCount * vertexSize, vertices);
+        }
+        if (!indices.empty() && indexType == GL_UNSIGNED_SHORT) {
+            std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+            UploadRange(indexStore.indexBuffer, indexOffset * sizeof(uint16_t), shortIndices.size() * sizeof(uint16_t), shortIndices.data());
+        }
+        else if (!indices.empty()) {
+            UploadRange(indexStore.indexBuffer, indexOffset * sizeof(GLuint), indices.size() * sizeof(GLuint), indices.data());
+        }
+
+        GeometryRange range;
+        range.baseVertex = (GLint)vertexOffset;
+        range.vertexCount = (GLsizei)vertexCount;
+        range.firstIndex = (GLuint)indexOffset;
+        range.indexCount = (GLsizei)indices.size();
+        range.format = format;
+        range.indexType = indexType;
+        return range;
+    }
+
+    void GeometryArena::Free(const GeometryRange& range) {
+
+        stores[range.format].space.Free((size_t)range.baseVertex, (size_t)range.vertexCount);
+        indexStores[IndexSlot(range.indexType)].space.Free((size_t)range.firstIndex, (size_t)range.indexCount);
+    }
+
+    GLuint GeometryArena::GetVertexArray(const GeometryRange& range) const {
+
+        return stores[range.format].vaos[IndexSlot(range.indexType)];
+    }
+
+    void GeometryArena::ReserveDrawIndices(size_t count) {
+
+        if (count <= drawIndexCapacity) {
+            return;
+        }
+
+        drawIndexCapacity = std::max(count, std::max(drawIndexCapacity * 2, (size_t)1024));
+        std::vector<GLuint> drawIndices(drawIndexCapacity);
+        for (size_t i = 0; i < drawIndices.size(); i++) {
+            drawIndices[i] = (GLuint)i;
+        }
+
+        if (drawIndexBuffer == 0) {
+            glGenBuffers(1, &drawIndexBuffer);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, drawIndexBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, drawIndices.size() * sizeof(GLuint), drawIndices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        // VAOs created later pick the buffer up when they are set up
+        for (int format = 0; format < VERTEX_FORMAT_COUNT; format++) {
+            for (int slot = 0; slot < INDEX_TYPE_COUNT; slot++) {
+                if (stores[format].vaos[slot] != 0) {
+                    SetupVertexArray((VertexFormat)format, slot);
+                }
+            }
+        }
+    }
+
+    size_t GeometryArena::GetIndexSize(GLenum indexType) {
+
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(GLuint);
+    }
+
+    const void* GeometryArena::IndexOffset(const GeometryRange& range) {
+
+        return (const void*)((uintptr_t)range.firstIndex * GetIndexSize(range.indexType));
+    }
+
+    void GeometryArena::PrintStats() const {
+
+        static const char* FORMAT_NAMES[VERTEX_FORMAT_COUNT] = { "full", "packed" };
+        static const char* INDEX_NAMES[INDEX_TYPE_COUNT] = { "16 bit", "32 bit" };
+
+        size_t bytes = 0;
+        std::cout << "Geometry arena : ";
+        for (int format = 0; format < VERTEX_FORMAT_COUNT; format++) {
+
+            const RangeAllocator& space = stores[format].space;
+            std::cout << space.used << " / " << space.capacity << " " << FORMAT_NAMES[format] << " vertices, ";
+            bytes += space.capacity * GetVertexSize((VertexFormat)format);
+        }
+        for (int slot = 0; slot < INDEX_TYPE_COUNT; slot++) {
+
+            const RangeAllocator& space = indexStores[slot].space;
+            std::cout << space.used << " / " << space.capacity << " " << INDEX_NAMES[slot] << " indices"
+                << (slot + 1 < INDEX_TYPE_COUNT ? ", " : "");
+            bytes += space.capacity * GetIndexSize(INDEX_TYPES[slot]);
+        }
+        std::cout << " (" << bytes / (1024.0 * 1024.0) << " MB)" << std::endl;
+    }
+
+    int GeometryArena::IndexSlot(GLenum indexType) {
+
+        return indexType == GL_UNSIGNED_SHORT ? 0 : 1;
+    }
+
+    void GeometryArena::ResizeVertices(VertexFormat format, size_t vertexCapacity) {
+
+        VertexStore& store = stores[format];
+        size_t vertexSize = GetVertexSize(format);
+        store.vertexBuffer = ReallocateBuffer(store.vertexBuffer, store.space.capacity * vertexSize, vertexCapacity * vertexSize);
+        store.space.Grow(vertexCapacity);
+
+        for (int slot = 0; slot < INDEX_TYPE_COUNT; slot++) {
+            if (store.vaos[slot] != 0) {
+                SetupVertexArray(format, slot);
+            }
+        }
+    }
+
+    void GeometryArena::ResizeIndices(int indexSlot, size_t indexCapacity) {
+
+        IndexStore& indexStore = indexStores[indexSlot];
+        size_t indexSize = GetIndexSize(INDEX_TYPES[indexSlot]);
+        indexStore.indexBuffer = ReallocateBuffer(indexStore.indexBuffer, indexStore.space.capacity * indexSize, indexCapacity * indexSize);
+        indexStore.space.Grow(indexCapacity);
+
+        // the VAOs of every format hold the index buffer
+        for (int format = 0; format < VERTEX_FORMAT_COUNT; format++) {
+            if (stores[format].vaos[indexSlot] != 0) {
+                SetupVertexArray((VertexFormat)format, indexSlot);
+            }
+        }
+    }
+
+    void GeometryArena::SetupVertexArray(VertexFormat format, int indexSlot) {
+
+        GLState& state = GLState::Get();
+        state.BindVertexArray(stores[format].vaos[indexSlot]);
+
+        glBindBuffer(GL_ARRAY_BUFFER, stores[format].vertexBuffer);
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        if (format == VERTEX_FORMAT_PACKED) {
+            // the fetch normalizes all three, positions come out in [0, 1] (see PackedVertex)
+            glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, position));
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, normal));
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, texCoords));
+        }
+        else {
+            // Vertex Positions
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+            // Vertex Normals
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+            // Vertex Texture Coords
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+        }
+
+        // Draw index, one value per instance
+        if (drawIndexBuffer != 0) {
+            glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+            glEnableVertexAttribArray(DRAW_INDEX_ATTRIBUTE);
+            glVertexAttribIPointer(DRAW_INDEX_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid*)0);
+            glVertexAttribDivisor(DRAW_INDEX_ATTRIBUTE, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexStores[indexSlot].indexBuffer);
+
+        // nothing else may record buffer bindings into the arena VAOs
+        state.BindVertexArray(0);
+    }
+}
@@ -0,0 +1,130 @@
+#ifndef GeometryArena_hpp
+#define GeometryArena_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "VertexFormat.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    struct Vertex;
+
+    // Place of one mesh inside the arena buffers. Indices are relative to the
+    // mesh's own vertices, the draw adds baseVertex to them.
+    struct GeometryRange {
+        GLint baseVertex;
+        GLsizei vertexCount;
+        // in indices of indexType
+        GLuint firstIndex;
+        GLsizei indexCount;
+        // buffer the vertices are in
+        VertexFormat format;
+        // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, the type argument of the draw
+        GLenum indexType;
+    };
+
+    // One VBO per vertex format and one EBO per index type holding the geometry of all
+    // static meshes, with one VAO per pair, so meshes are drawn with glDrawElementsBaseVertex
+    // switching VAOs only between formats and index types. The buffers grow (copied on the
+    // GPU) when a mesh does not fit, freed ranges are reused. GL thread only.
+    class GeometryArena {
+
+    public:
+        // Instanced attribute holding the instance index, offset by the draw's base
+        // instance, so indirect draws can find their per-draw data
+        static const GLuint DRAW_INDEX_ATTRIBUTE = 3;
+
+        // Ranges of at most this many vertices get 16 bit indices
+        static const size_t SHORT_INDEX_VERTICES = 65536;
+
+        static GeometryArena& Get();
+
+        // Copies the mesh into the arena
+        GeometryRange Allocate(const std::vector<gps::Vertex>& vertices, const std::vector<GLuint>& indices);
+        GeometryRange Allocate(const std::vector<gps::PackedVertex>& vertices, const std::vector<GLuint>& indices);
+        void Free(const GeometryRange& range);
+
+        // The VAO a range is drawn with
+        GLuint GetVertexArray(const GeometryRange& range) const;
+
+        // Makes the draw index attribute cover at least count instances
+        void ReserveDrawIndices(size_t count);
+
+        static size_t GetIndexSize(GLenum indexType);
+        // Byte offset of the first index of a range, the "indices" argument of the draw
+        static const void* IndexOffset(const GeometryRange& range);
+
+        // Used and allocated sizes of the buffers
+        void PrintStats() const;
+
+    private:
+        GeometryArena();
+
+        // First-fit allocator over [0, capacity) in elements, free blocks sorted and merged
+        class RangeAllocator {
+
+        public:
+            RangeAllocator();
+
+            // Returns false if no free block is large enough
+            bool Allocate(size_t count, size_t& offset);
+            void Free(size_t offset, size_t count);
+            // Adds [capacity, newCapacity) to the free space
+            void Grow(size_t newCapacity);
+
+            size_t capacity;
+            size_t used;
+
+        private:
+            struct Block {
+                size_t offset;
+                size_t count;
+            };
+
+            std::vector<Block> freeBlocks;
+
+            void AddFreeBlock(size_t offset, size_t count);
+        };
+
+        // 16 and 32 bit
+        static const int INDEX_TYPE_COUNT = 2;
+
+        // Vertices of one format, with a VAO per index type (0 until the first allocation using it)
+        struct VertexStore {
+            GLuint vaos[INDEX_TYPE_COUNT];
+            GLuint vertexBuffer;
+            RangeAllocator space;
+        };
+
+        struct IndexStore {
+            GLuint indexBuffer;
+            RangeAllocator space;
+        };
+
+        VertexStore stores[VERTEX_FORMAT_COUNT];
+        IndexStore indexStores[INDEX_TYPE_COUNT];
+        // 0, 1, 2, ... read with divisor 1
+        GLuint drawIndexBuffer;
+        size_t drawIndexCapacity;
+
+        static int IndexSlot(GLenum indexType);
+
+        GeometryRange Allocate(VertexFormat format, const void* vertices, size_t vertexCount, const std::vector<GLuint>& indices);
+
+        // Move the contents to larger buffers and point the VAOs at them
+        void ResizeVertices(VertexFormat format, size_t vertexCapacity);
+        void ResizeIndices(int indexSlot, size_t indexCapacity);
+        void SetupVertexArray(VertexFormat format, int indexSlot);
+    };
+}
+
+#endif /* GeometryArena_hpp */
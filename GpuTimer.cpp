@@ -0,0 +1,86 @@
+#include "GpuTimer.hpp"
+
+namespace gps {
+
+    GpuTimer::GpuTimer(GLenum target)
+        : target(target), next(0), running(false), total(0.0), samples(0) {
+
+        for (int i = 0; i < QUERY_COUNT; i++) {
+            queries[i] = 0;
+            pending[i] = false;
+        }
+    }
+
+    GpuTimer::~GpuTimer() {
+
+        if (queries[0] != 0) {
+            glDeleteQueries(QUERY_COUNT, queries);
+        }
+    }
+
+    void GpuTimer::Begin() {
+
+        // created on first use, when the context exists
+        if (queries[0] == 0) {
+            glGenQueries(QUERY_COUNT, queries);
+        }
+
+        Collect();
+
+        // all queries still in flight, skip this sample rather than stall
+        if (pending[next]) {
+            return;
+        }
+        glBeginQuery(target, queries[next]);
+        pending[next] = true;
+        running = true;
+    }
+
+    void GpuTimer::End() {
+
+        if (!running) {
+            return;
+        }
+        glEndQuery(target);
+        running = false;
+        next = (next + 1) % QUERY_COUNT;
+    }
+
+    bool GpuTimer::ReadAverage(int sampleCount, double& average) {
+
+        Collect();
+        if (samples < sampleCount || samples == 0) {
+            return false;
+        }
+
+        average = total / samples;
+        total = 0.0;
+        samples = 0;
+        return true;
+    }
+
+    void GpuTimer::Collect() {
+
+        // results come back in issue order, starting with the oldest query
+        for (int i = 0; i < QUERY_COUNT; i++) {
+
+            int query = (next + i) % QUERY_COUNT;
+            if (!pending[query]) {
+                continue;
+            }
+
+            GLint available = 0;
+            glGetQueryObjectiv(queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                break;
+            }
+
+            GLuint64 result = 0;
+            glGetQueryObjectui64v(queries[query], GL_QUERY_RESULT, &result);
+            // time queries count nanoseconds
+            total += target == GL_TIME_ELAPSED ? result / 1e6 : (double)result;
+            samples++;
+            pending[query] = false;
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef GpuTimer_hpp
+#define GpuTimer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+namespace gps {
+
+    // Measures the GPU time of the commands between Begin and End with GL_TIME_ELAPSED
+    // queries, or counts what they produced with another query target (GL_SAMPLES_PASSED
+    // gives the fragments that passed the depth test). Results are read a few frames later
+    // so the CPU never waits on the GPU. Only one GpuTimer per target can be running at a
+    // time (queries of the same target do not nest).
+    class GpuTimer {
+
+    public:
+        explicit GpuTimer(GLenum target = GL_TIME_ELAPSED);
+        ~GpuTimer();
+
+        GpuTimer(const GpuTimer&) = delete;
+        GpuTimer& operator=(const GpuTimer&) = delete;
+
+        void Begin();
+        void End();
+
+        // Returns true once sampleCount results have been collected since the last call,
+        // with their average: milliseconds for GL_TIME_ELAPSED, the raw count otherwise
+        bool ReadAverage(int sampleCount, double& average);
+
+    private:
+        static const int QUERY_COUNT = 4;
+
+        GLenum target;
+        GLuint queries[QUERY_COUNT];
+        bool pending[QUERY_COUNT];
+        int next;
+        bool running;
+
+        double total;
+        int samples;
+
+        void Collect();
+    };
+}
+
+#endif /* GpuTimer_hpp */
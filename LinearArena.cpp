@@ -0,0 +1,137 @@
+#include "LinearArena.hpp"
+
+#include <algorithm>
+#include <new>
+
+namespace gps {
+
+    namespace {
+
+        bool arenasEnabled = true;
+    }
+
+    LinearArena::LinearArena(size_t blockSize)
+        : blockSize(blockSize), current(0), offset(0), usedBefore(0), peakBytes(0) {
+    }
+
+    LinearArena::~LinearArena() {
+        Release();
+    }
+
+    void* LinearArena::Allocate(size_t size, size_t alignment) {
+
+        if (!blocks.empty()) {
+
+            Block& block = blocks[current];
+            size_t start = (offset + alignment - 1) & ~(alignment - 1);
+            if (start + size <= block.size) {
+
+                offset = start + size;
+                peakBytes = std::max(peakBytes, usedBefore + offset);
+                return block.data + start;
+            }
+            usedBefore += block.size;
+        }
+
+        // a new block, at least twice the last one; operator new aligns for any fundamental type
+        size_t newSize = blocks.empty() ? blockSize : blocks.back().size * 2;
+        newSize = std::max(newSize, size + alignment);
+
+        Block block;
+        block.data = static_cast<char*>(::operator new(newSize));
+        block.size = newSize;
+        blocks.push_back(block);
+
+        current = blocks.size() - 1;
+        offset = size;
+        peakBytes = std::max(peakBytes, usedBefore + offset);
+        return block.data;
+    }
+
+    LinearArena::Marker LinearArena::GetMarker() const {
+
+        Marker marker;
+        marker.block = current;
+        marker.offset = offset;
+        return marker;
+    }
+
+    void LinearArena::Rewind(const Marker& marker) {
+
+        if (blocks.empty()) {
+            return;
+        }
+        FreeBlocks(marker.block + 1);
+        current = marker.block;
+        offset = marker.offset;
+
+        usedBefore = 0;
+        for (size_t i = 0; i < current; i++) {
+            usedBefore += blocks[i].size;
+        }
+    }
+
+    void LinearArena::Reset() {
+
+        // one block as large as all of them, so the same work fits without growing next time
+        if (blocks.size() > 1) {
+
+            size_t total = GetCapacity();
+            Release();
+
+            Block block;
+            block.data = static_cast<char*>(::operator new(total));
+            block.size = total;
+            blocks.push_back(block);
+        }
+        current = 0;
+        offset = 0;
+        usedBefore = 0;
+        peakBytes = 0;
+    }
+
+    void LinearArena::Release() {
+
+        FreeBlocks(0);
+        current = 0;
+        offset = 0;
+        usedBefore = 0;
+    }
+
+    size_t LinearArena::GetPeakBytes() const {
+        return peakBytes;
+    }
+
+    size_t LinearArena::GetCapacity() const {
+
+        size_t capacity = 0;
+        for (size_t i = 0; i < blocks.size(); i++) {
+            capacity += blocks[i].size;
+        }
+        return capacity;
+    }
+
+    LinearArena& LinearArena::ForThread() {
+
+        static thread_local LinearArena arena;
+        return arena;
+    }
+
+    void LinearArena::SetEnabled(bool enabled) {
+        arenasEnabled = enabled;
+    }
+
+    bool LinearArena::IsEnabled() {
+        return arenasEnabled;
+    }
+
+    void LinearArena::FreeBlocks(size_t first) {
+
+        for (size_t i = first; i < blocks.size(); i++) {
+            ::operator delete(blocks[i].data);
+        }
+        if (first < blocks.size()) {
+            blocks.resize(first);
+        }
+    }
+}
@@ -0,0 +1,134 @@
+#ifndef LinearArena_hpp
+#define LinearArena_hpp
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // Bump allocator for short-lived loader data. Allocations are never freed one by one:
+    // Rewind drops everything allocated after a marker, Reset everything. The memory comes
+    // in blocks that double in size; Reset merges them into one block, so the next model
+    // loaded on the same thread is usually served without touching the heap. Not thread
+    // safe, each loading thread uses its own (ForThread).
+    class LinearArena {
+
+    public:
+        // First block size, later blocks double
+        static const size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+
+        struct Marker {
+            size_t block;
+            size_t offset;
+        };
+
+        explicit LinearArena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+        ~LinearArena();
+
+        LinearArena(const LinearArena&) = delete;
+        LinearArena& operator=(const LinearArena&) = delete;
+
+        // alignment must be a power of two
+        void* Allocate(size_t size, size_t alignment);
+
+        Marker GetMarker() const;
+        // Frees the blocks started after the marker and goes back to it in its block
+        void Rewind(const Marker& marker);
+        // Frees everything allocated, keeps (merged) blocks for the next use
+        void Reset();
+        // Frees everything, blocks included
+        void Release();
+
+        // Bytes handed out since the last Reset, most at any time
+        size_t GetPeakBytes() const;
+        size_t GetCapacity() const;
+
+        // Arena of the calling thread, released when the thread ends
+        static LinearArena& ForThread();
+
+        // Off makes the ArenaAllocators created from then on use the heap, to measure the difference
+        static void SetEnabled(bool enabled);
+        static bool IsEnabled();
+
+    private:
+        struct Block {
+            char* data;
+            size_t size;
+        };
+
+        std::vector<Block> blocks;
+        size_t blockSize;
+        // last block in use, position inside it
+        size_t current;
+        size_t offset;
+        // bytes of the blocks before current, handed out or skipped
+        size_t usedBefore;
+        size_t peakBytes;
+
+        void FreeBlocks(size_t first);
+    };
+
+    // Standard allocator over a LinearArena, deallocate does nothing. The arena must outlive
+    // the containers using it and must not be rewound past their allocations while they live.
+    template <typename T>
+    class ArenaAllocator {
+
+    public:
+        typedef T value_type;
+
+        ArenaAllocator(LinearArena& arena)
+            : arena(LinearArena::IsEnabled() ? &arena : NULL) {}
+
+        template <typename U>
+        ArenaAllocator(const ArenaAllocator<U>& other)
+            : arena(other.arena) {}
+
+        T* allocate(size_t count) {
+
+            if (arena == NULL) {
+                return static_cast<T*>(::operator new(count * sizeof(T)));
+            }
+            return static_cast<T*>(arena->Allocate(count * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T* pointer, size_t) {
+
+            if (arena == NULL) {
+                ::operator delete(pointer);
+            }
+        }
+
+        template <typename U>
+        bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+        template <typename U>
+        bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+    private:
+        template <typename U>
+        friend class ArenaAllocator;
+
+        // NULL: the arenas were disabled when the allocator was made
+        LinearArena* arena;
+    };
+
+    template <typename T>
+    using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+    // Rewinds an arena to where it was when the scope started
+    class ArenaScope {
+
+    public:
+        explicit ArenaScope(LinearArena& arena)
+            : arena(arena), marker(arena.GetMarker()) {}
+        ~ArenaScope() { arena.Rewind(marker); }
+
+        ArenaScope(const ArenaScope&) = delete;
+        ArenaScope& operator=(const ArenaScope&) = delete;
+
+    private:
+        LinearArena& arena;
+        LinearArena::Marker marker;
+    };
+}
+
+#endif /* LinearArena_hpp */
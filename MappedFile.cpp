@@ -0,0 +1,204 @@
+#include "MappedFile.hpp"
+
+#if defined (_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #include <sys/stat.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include <atomic>
+
+namespace gps {
+
+    MappedFile::MappedFile()
+        : data(nullptr), size(0), opened(false) {
+#if defined (_WIN32)
+        fileHandle = INVALID_HANDLE_VALUE;
+        mappingHandle = NULL;
+#endif
+    }
+
+    MappedFile::~MappedFile() {
+
+        Close();
+    }
+
+#if defined (_WIN32)
+    bool MappedFile::Open(const std::string& fileName) {
+
+        Close();
+
+        HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                                  OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize)) {
+            CloseHandle(file);
+            return false;
+        }
+
+        fileHandle = file;
+        size = (size_t)fileSize.QuadPart;
+        opened = true;
+
+        // empty files cannot be mapped, but are still valid
+        if (size == 0) {
+            return true;
+        }
+
+        mappingHandle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mappingHandle == NULL) {
+            Close();
+            return false;
+        }
+
+        data = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+        if (data == nullptr) {
+            Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void MappedFile::Close() {
+
+        if (data != nullptr) {
+            UnmapViewOfFile(data);
+        }
+        if (mappingHandle != NULL) {
+            CloseHandle((HANDLE)mappingHandle);
+        }
+        if (fileHandle != INVALID_HANDLE_VALUE) {
+            CloseHandle((HANDLE)fileHandle);
+        }
+
+        fileHandle = INVALID_HANDLE_VALUE;
+        mappingHandle = NULL;
+        data = nullptr;
+        size = 0;
+        opened = false;
+    }
+
+    bool GetFileStamp(const std::string& fileName, FileStamp& stamp) {
+
+        struct _stat64 fileInfo;
+        if (_stat64(fileName.c_str(), &fileInfo) != 0) {
+            return false;
+        }
+
+        stamp.size = (uint64_t)fileInfo.st_size;
+        stamp.modifiedTime = (int64_t)fileInfo.st_mtime;
+        return true;
+    }
+#else
+    bool MappedFile::Open(const std::string& fileName) {
+
+        Close();
+
+        int fd = open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat fileInfo;
+        if (fstat(fd, &fileInfo) != 0) {
+            close(fd);
+            return false;
+        }
+
+        size = (size_t)fileInfo.st_size;
+        opened = true;
+
+        // empty files cannot be mapped, but are still valid
+        if (size == 0) {
+            close(fd);
+            return true;
+        }
+
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping keeps its own reference to the file
+        close(fd);
+
+        if (mapping == MAP_FAILED) {
+            size = 0;
+            opened = false;
+            return false;
+        }
+
+        madvise(mapping, size, MADV_SEQUENTIAL);
+        data = (const char*)mapping;
+        return true;
+    }
+
+    void MappedFile::Close() {
+
+        if (data != nullptr) {
+            munmap((void*)data, size);
+        }
+
+        data = nullptr;
+        size = 0;
+        opened = false;
+    }
+
+    bool GetFileStamp(const std::string& fileName, FileStamp& stamp) {
+
+        struct stat fileInfo;
+        if (stat(fileName.c_str(), &fileInfo) != 0) {
+            return false;
+        }
+
+        stamp.size = (uint64_t)fileInfo.st_size;
+        stamp.modifiedTime = (int64_t)fileInfo.st_mtime;
+        return true;
+    }
+#endif
+
+    uint64_t HashBytes(const void* bytes, size_t count, uint64_t hash) {
+
+        const unsigned char* p = (const unsigned char*)bytes;
+        for (size_t i = 0; i < count; i++) {
+            hash ^= p[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    uint64_t HashFileStamps(const std::vector<std::string>& fileNames) {
+
+        uint64_t hash = HASH_SEED;
+        for (size_t i = 0; i < fileNames.size(); i++) {
+
+            // a missing file hashes as an empty stamp, so creating it later changes the hash
+            FileStamp stamp = { 0, -1 };
+            GetFileStamp(fileNames[i], stamp);
+
+            hash = HashBytes(fileNames[i].data(), fileNames[i].size(), hash);
+            hash = HashBytes(&stamp.size, sizeof(stamp.size), hash);
+            hash = HashBytes(&stamp.modifiedTime, sizeof(stamp.modifiedTime), hash);
+        }
+        return hash;
+    }
+
+    std::string MakeTempFileName(const std::string& fileName) {
+
+        static std::atomic<unsigned int> nextTempFile(0);
+
+#if defined (_WIN32)
+        unsigned long processId = GetCurrentProcessId();
+#else
+        unsigned long processId = (unsigned long)getpid();
+#endif
+        return fileName + "." + std::to_string(processId) + "." + std::to_string(nextTempFile++) + ".tmp";
+    }
+}
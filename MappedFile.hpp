@@ -0,0 +1,74 @@
+#ifndef MappedFile_hpp
+#define MappedFile_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Read-only view of a whole file mapped into the address space
+    class MappedFile {
+
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Maps the file, returns false if it does not exist or cannot be mapped
+        bool Open(const std::string& fileName);
+        void Close();
+
+        bool IsOpen() const { return opened; }
+        const char* Data() const { return data; }
+        size_t Size() const { return size; }
+
+    private:
+        const char* data;
+        size_t size;
+        bool opened;
+
+#if defined (_WIN32)
+        void* fileHandle;
+        void* mappingHandle;
+#endif
+    };
+
+    // std::streambuf reading straight from memory, lets std::istream based parsers
+    // (tinyobj::LoadMtl) run on a MappedFile without copying it to the heap first
+    class MemoryStreamBuf : public std::streambuf {
+
+    public:
+        MemoryStreamBuf(const char* data, size_t size) {
+            char* begin = const_cast<char*>(data);
+            setg(begin, begin, begin + size);
+        }
+    };
+
+    // Size and modification time of a file on disk, used to detect source changes
+    struct FileStamp {
+        uint64_t size;
+        int64_t modifiedTime;
+    };
+
+    // Returns false if the file does not exist
+    bool GetFileStamp(const std::string& fileName, FileStamp& stamp);
+
+    // FNV-1a (64 bit) of a block of memory, chain blocks by passing the previous hash
+    const uint64_t HASH_SEED = 14695981039346656037ull;
+    uint64_t HashBytes(const void* bytes, size_t count, uint64_t hash = HASH_SEED);
+
+    // Hash of the names, sizes and modification times of the files, used by the
+    // load caches to detect that any of their sources changed
+    uint64_t HashFileStamps(const std::vector<std::string>& fileNames);
+
+    // Name of a temporary file next to fileName, different on every call (and in every
+    // process), so concurrent writers of the same cache never share one
+    std::string MakeTempFileName(const std::string& fileName);
+}
+
+#endif /* MappedFile_hpp */
@@ -1,72 +1,150 @@
 #include "Mesh.hpp"
+#include "GLState.hpp"
+
+#include <utility>
+
 namespace gps {
 
 	/* Mesh Constructor */
-	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures) {
+	Mesh::Mesh(gps::MeshData&& data, std::vector<Texture> textures, VertexFormat format, bool retainCpuData) {
+
+		this->textures = std::move(textures);
+		this->bounds = data.bounds;
+
+		for (size_t i = 0; i < this->textures.size(); i++) {
+			this->textureUniforms.push_back(gps::HashUniformName(this->textures[i].type.c_str()));
+		}
+
+		this->setupMesh(data, format);
+
+		if (retainCpuData) {
+			this->vertices = std::move(data.vertices);
+			this->indices = std::move(data.indices);
+		}
+		else {
+			// swapped out, clear() would keep the capacity
+			std::vector<Vertex>().swap(data.vertices);
+			std::vector<GLuint>().swap(data.indices);
+		}
+		std::vector<MeshLod>().swap(data.lods);
+	}
+
+	GeometryRange Mesh::getGeometry() const {
+	    return this->geometry;
+	}
+
+	size_t Mesh::getLodCount() const {
+	    return this->lodGeometry.size();
+	}
+
+	const GeometryRange& Mesh::getLodGeometry(size_t level) const {
+	    return this->lodGeometry[level];
+	}
+
+	float Mesh::getLodError(size_t level) const {
+	    return this->lodErrors[level];
+	}
+
+	const Bounds& Mesh::getBounds() const {
+	    return this->bounds;
+	}
+
+	VertexFormat Mesh::getVertexFormat() const {
+	    return this->vertexFormat;
+	}
 
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+	const glm::mat4& Mesh::getPositionDecode() const {
+	    return this->positionDecode;
+	}
 
-		this->setupMesh();
+	const PackingError& Mesh::getPackingError() const {
+	    return this->packingError;
 	}
 
-	Buffers Mesh::getBuffers() {
-	    return this->buffers;
+	GLenum Mesh::getIndexType() const {
+	    return this->geometry.indexType;
 	}
 
 	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)	{
+	void Mesh::Draw(const gps::Shader& shader)	{
 
+		gps::GLState& state = gps::GLState::Get();
 		shader.useShaderProgram();
 
-		//set textures
+		//set textures, they stay bound for the next draw (GLState skips them if it uses the same ones)
 		for (GLuint i = 0; i < textures.size(); i++) {
 
-			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
-			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
+			glUniform1i(shader.getUniformLocation(this->textureUniforms[i]), i);
+			state.BindTexture(i, this->textures[i].id);
 		}
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, (GLsizei)this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		// all meshes of a format and index type share the arena VAO
+		const GeometryRange& full = this->lodGeometry[0];
+		state.BindVertexArray(gps::GeometryArena::Get().GetVertexArray(full));
+		glDrawElementsBaseVertex(GL_TRIANGLES, full.indexCount, full.indexType,
+			gps::GeometryArena::IndexOffset(full), full.baseVertex);
+	}
 
-        for(GLuint i = 0; i < this->textures.size(); i++) {
+	void Mesh::Submit(gps::RenderQueue& queue, gps::RenderLayer layer, const gps::Shader& shader, uint32_t transform,
+	                  const gps::BoundingBox& bounds, uint32_t instanceCount, size_t lod) {
+
+		gps::DrawItem item;
+		item.shader = &shader;
+		item.vao = gps::GeometryArena::Get().GetVertexArray(this->geometry);
+		item.geometry = this->lodGeometry[lod];
+		item.textureSet = queue.GetTextureSet(this->textures, this->textureUniforms);
+		item.transform = transform;
+		item.instanceCount = instanceCount;
+		item.bounds = bounds;
+		queue.Submit(layer, item);
+		queue.RecordTriangles((size_t)item.geometry.indexCount / 3 * instanceCount,
+			(size_t)this->lodGeometry[0].indexCount / 3 * instanceCount);
+	}
 
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, 0);
-        }
+	// Copies the geometry into the shared arena buffers, the coarser index buffers after the full one
+	void Mesh::setupMesh(const gps::MeshData& data, VertexFormat format) {
 
-    }
+		const std::vector<MeshLod>& lods = data.lods;
+		std::vector<GLuint> allIndices;
+		if (!lods.empty()) {
+			allIndices = data.indices;
+			for (size_t i = 0; i < lods.size(); i++) {
+				allIndices.insert(allIndices.end(), lods[i].indices.begin(), lods[i].indices.end());
+			}
+		}
+		const std::vector<GLuint>& uploadIndices = lods.empty() ? data.indices : allIndices;
 
-	// Initializes all the buffer objects/arrays
-	void Mesh::setupMesh() {
+		this->vertexFormat = format;
+		this->positionDecode = glm::mat4(1.0f);
+		this->packingError.position = 0.0f;
+		this->packingError.normal = 0.0f;
+		this->packingError.texCoords = 0.0f;
 
-		// Create buffers/arrays
-		glGenVertexArrays(1, &this->buffers.VAO);
-		glGenBuffers(1, &this->buffers.VBO);
-		glGenBuffers(1, &this->buffers.EBO);
+		if (format == VERTEX_FORMAT_PACKED) {
 
-		glBindVertexArray(this->buffers.VAO);
-		// Load data into vertex buffers
-		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+			VertexQuantization quantization = gps::ComputeQuantization(data.vertices);
+			std::vector<PackedVertex> packed;
+			gps::PackVertices(data.vertices, quantization, packed);
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+			this->positionDecode = gps::GetPositionDecode(quantization);
+			this->packingError = gps::MeasurePackingError(data.vertices, packed, quantization);
+			this->geometry = gps::GeometryArena::Get().Allocate(packed, uploadIndices);
+		}
+		else {
+			this->geometry = gps::GeometryArena::Get().Allocate(data.vertices, uploadIndices);
+		}
+
+		GeometryRange level = this->geometry;
+		level.indexCount = (GLsizei)data.indices.size();
+		this->lodGeometry.push_back(level);
+		this->lodErrors.push_back(0.0f);
 
-		// Set the vertex attribute pointers
-		// Vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-		// Vertex Normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-		// Vertex Texture Coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+		for (size_t i = 0; i < lods.size(); i++) {
 
-		glBindVertexArray(0);
+			level.firstIndex += (GLuint)level.indexCount;
+			level.indexCount = (GLsizei)lods[i].indices.size();
+			this->lodGeometry.push_back(level);
+			this->lodErrors.push_back(lods[i].error);
+		}
 	}
 }
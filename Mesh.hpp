@@ -11,7 +11,10 @@
 
 #include <glm/glm.hpp>
 
+#include "Bounds.hpp"
+#include "GeometryArena.hpp"
 #include "Shader.hpp"
+#include "RenderQueue.hpp"
 
 #include <string>
 #include <vector>
@@ -41,31 +44,94 @@ namespace gps {
         glm::vec3 specular;
     };
 
-    struct Buffers {
-        GLuint VAO;
-        GLuint VBO;
-        GLuint EBO;
+    // Simplified index buffer over the vertices of its mesh (see MeshSimplifier)
+    struct MeshLod {
+        std::vector<GLuint> indices;
+        // largest distance from the full detail surface, model space
+        float error;
+    };
+
+    // CPU-side geometry of one mesh, before it is uploaded to the GPU
+    // (texture ids are not resolved yet, only type and path are set)
+    struct MeshData {
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+        std::vector<Texture> textures;
+        // coarser levels of indices, finest first
+        std::vector<MeshLod> lods;
+        // set for the vertices a split shares with the other chunks of its shape (see SplitMesh),
+        // empty for whole shapes; not stored in the mesh cache
+        std::vector<unsigned char> splitBorder;
+        // model space volumes of the vertices
+        Bounds bounds;
     };
 
     class Mesh {
 
     public:
+        // CPU copies of the full detail geometry, only kept with retainCpuData (collision or
+        // picking against triangles), empty otherwise since the arena has the drawn copy
         std::vector<Vertex> vertices;
         std::vector<GLuint> indices;
         std::vector<Texture> textures;
 
-	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
-
-	    Buffers getBuffers();
-
-	    void Draw(gps::Shader shader);
+	    // Copies the geometry and levels of detail of data into the arena, with VERTEX_FORMAT_PACKED
+	    // as PackedVertex copies. The vertices and indices of data move into the mesh with
+	    // retainCpuData, otherwise they are released as soon as they are uploaded.
+	    Mesh(gps::MeshData&& data, std::vector<Texture> textures, VertexFormat format = VERTEX_FORMAT_FULL,
+	         bool retainCpuData = false);
+
+	    // one mesh per arena range (its Model3D frees it), so meshes move but never copy
+	    Mesh(const Mesh&) = delete;
+	    Mesh& operator=(const Mesh&) = delete;
+	    Mesh(Mesh&&) = default;
+	    Mesh& operator=(Mesh&&) = default;
+
+	    // Where the mesh lives in the GeometryArena, indices of all levels of detail
+	    GeometryRange getGeometry() const;
+
+	    // Levels of detail, level 0 is the full mesh
+	    size_t getLodCount() const;
+	    const GeometryRange& getLodGeometry(size_t level) const;
+	    // Largest model space distance of the level from the full mesh
+	    float getLodError(size_t level) const;
+
+	    // Model space bounding volumes
+	    const Bounds& getBounds() const;
+
+	    VertexFormat getVertexFormat() const;
+	    // Applied before the model matrix to the positions of packed meshes, identity otherwise
+	    const glm::mat4& getPositionDecode() const;
+	    // What packing cost, 0 for full vertices
+	    const PackingError& getPackingError() const;
+	    // GL_UNSIGNED_SHORT below GeometryArena::SHORT_INDEX_VERTICES vertices, GL_UNSIGNED_INT above
+	    GLenum getIndexType() const;
+
+	    // The model uniform must include the position decode
+	    void Draw(const gps::Shader& shader);
+
+	    // Adds the draw of this mesh to the queue, with transforms added to the same queue
+	    // (including the position decode for packed meshes, see RenderQueue::AddTransform):
+	    // instanceCount copies placed by the consecutive transforms starting at transform,
+	    // all of them inside the world space box bounds, drawn with the given level of detail
+	    void Submit(gps::RenderQueue& queue, gps::RenderLayer layer, const gps::Shader& shader, uint32_t transform,
+	                const gps::BoundingBox& bounds, uint32_t instanceCount = 1, size_t lod = 0);
 
     private:
         /*  Render data  */
-        Buffers buffers;
-
-	    // Initializes all the buffer objects/arrays
-	    void setupMesh();
+        GeometryRange geometry;
+        // inside geometry, one per level of detail
+        std::vector<GeometryRange> lodGeometry;
+        std::vector<float> lodErrors;
+        Bounds bounds;
+        VertexFormat vertexFormat;
+        glm::mat4 positionDecode;
+        PackingError packingError;
+        // hashed sampler name (texture type) of every texture
+        std::vector<gps::UniformName> textureUniforms;
+
+	    // Copies the geometry and the level of detail indices into the shared arena buffers
+	    void setupMesh(const gps::MeshData& data, VertexFormat format);
 
     };
 
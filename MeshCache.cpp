@@ -0,0 +1,303 @@
+#include "MeshCache.hpp"
+#include "MappedFile.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+
+        const char MESH_CACHE_MAGIC[4] = { 'G', 'P', 'S', 'M' };
+        // bump whenever the layout of the file or of gps::Vertex changes
+        const uint32_t MESH_CACHE_VERSION = 3;
+
+        struct MeshCacheHeader {
+            char magic[4];
+            uint32_t version;
+            uint32_t vertexSize;
+            uint32_t sourceFileCount;
+            uint64_t sourceHash;
+            uint32_t meshCount;
+            uint32_t optimizeFlags;
+            // the levels of detail depend on it
+            float lodMaxError;
+            // 0 when the shapes were not split
+            uint32_t maxMeshVertices;
+        };
+
+        struct MeshCacheEntry {
+            uint32_t vertexCount;
+            uint32_t indexCount;
+            uint32_t textureCount;
+            uint32_t lodCount;
+        };
+
+        struct MeshCacheLod {
+            uint32_t indexCount;
+            float error;
+        };
+
+        // Bounds-checked reader over the mapped cache file
+        class CacheReader {
+
+        public:
+            CacheReader(const char* data, size_t size) : data(data), size(size), offset(0) {}
+
+            bool Read(void* destination, size_t count) {
+
+                if (count > Remaining()) {
+                    return false;
+                }
+                if (count > 0) {
+                    memcpy(destination, data + offset, count);
+                }
+                offset += Align(count);
+                return true;
+            }
+
+            // Whether count elements of elementSize bytes fit in the rest of the file, checked before
+            // sizing a vector from a count read from it
+            bool Fits(size_t count, size_t elementSize) const {
+
+                return elementSize == 0 || count <= Remaining() / elementSize;
+            }
+
+            size_t Remaining() const {
+                return size - offset;
+            }
+
+            bool ReadString(std::string& value) {
+
+                uint32_t length;
+                if (!Read(&length, sizeof(length)) || length > Remaining()) {
+                    return false;
+                }
+                value.assign(data + offset, length);
+                offset += Align(length);
+                return true;
+            }
+
+        private:
+            const char* data;
+            size_t size;
+            size_t offset;
+
+            // every block starts 4-byte aligned
+            size_t Align(size_t count) const {
+
+                size_t aligned = (count + 3) & ~(size_t)3;
+                return aligned < size - offset ? aligned : size - offset;
+            }
+        };
+
+        // A stale or corrupt cache must not hand out-of-range indices to the GPU or the mesh passes
+        bool IndicesInRange(const std::vector<GLuint>& indices, size_t vertexCount) {
+
+            for (size_t i = 0; i < indices.size(); i++) {
+                if (indices[i] >= vertexCount) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void WriteBlock(std::ofstream& out, const void* data, size_t count) {
+
+            static const char padding[4] = { 0, 0, 0, 0 };
+            out.write((const char*)data, count);
+            out.write(padding, ((count + 3) & ~(size_t)3) - count);
+        }
+
+        void WriteString(std::ofstream& out, const std::string& value) {
+
+            uint32_t length = (uint32_t)value.size();
+            WriteBlock(out, &length, sizeof(length));
+            WriteBlock(out, value.data(), value.size());
+        }
+    }
+
+    std::string GetMeshCacheFileName(const std::string& objFileName) {
+
+        return objFileName + ".meshcache";
+    }
+
+    bool ReadMeshCache(const std::string& cacheFileName, unsigned int optimizeFlags, float lodMaxError, uint32_t maxMeshVertices,
+                       std::vector<gps::MeshData>& meshes) {
+
+        MappedFile file;
+        if (!file.Open(cacheFileName)) {
+            return false;
+        }
+
+        CacheReader reader(file.Data(), file.Size());
+
+        MeshCacheHeader header;
+        if (!reader.Read(&header, sizeof(header))
+            || memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0
+            || header.version != MESH_CACHE_VERSION
+            || header.vertexSize != sizeof(gps::Vertex)
+            || header.optimizeFlags != optimizeFlags
+            || header.lodMaxError != lodMaxError
+            || header.maxMeshVertices != maxMeshVertices) {
+
+            return false;
+        }
+
+        // a corrupt count must not size a vector larger than the file, every string has its length
+        if (!reader.Fits(header.sourceFileCount, sizeof(uint32_t))) {
+            return false;
+        }
+        std::vector<std::string> sourceFiles(header.sourceFileCount);
+        for (size_t i = 0; i < sourceFiles.size(); i++) {
+
+            if (!reader.ReadString(sourceFiles[i])) {
+                return false;
+            }
+        }
+
+        if (HashFileStamps(sourceFiles) != header.sourceHash) {
+
+            std::cout << "Mesh cache out of date : " << cacheFileName << std::endl;
+            return false;
+        }
+
+        if (!reader.Fits(header.meshCount, sizeof(MeshCacheEntry))) {
+            return false;
+        }
+        std::vector<gps::MeshData> cachedMeshes(header.meshCount);
+        for (size_t m = 0; m < cachedMeshes.size(); m++) {
+
+            MeshCacheEntry entry;
+            if (!reader.Read(&entry, sizeof(entry))) {
+                return false;
+            }
+
+            gps::MeshData& mesh = cachedMeshes[m];
+            // type and path lengths
+            if (!reader.Fits(entry.textureCount, 2 * sizeof(uint32_t))) {
+                return false;
+            }
+            mesh.textures.resize(entry.textureCount);
+            for (size_t t = 0; t < mesh.textures.size(); t++) {
+
+                mesh.textures[t].id = 0;
+                if (!reader.ReadString(mesh.textures[t].type) || !reader.ReadString(mesh.textures[t].path)) {
+                    return false;
+                }
+            }
+
+            if (!reader.Fits(entry.vertexCount, sizeof(gps::Vertex))) {
+                return false;
+            }
+            mesh.vertices.resize(entry.vertexCount);
+            if (!reader.Fits(entry.indexCount, sizeof(GLuint))) {
+                return false;
+            }
+            mesh.indices.resize(entry.indexCount);
+            if (!reader.Read(mesh.vertices.data(), mesh.vertices.size() * sizeof(gps::Vertex))
+                || !reader.Read(mesh.indices.data(), mesh.indices.size() * sizeof(GLuint))
+                || !IndicesInRange(mesh.indices, mesh.vertices.size())) {
+
+                return false;
+            }
+
+            if (!reader.Fits(entry.lodCount, sizeof(MeshCacheLod))) {
+                return false;
+            }
+            mesh.lods.resize(entry.lodCount);
+            for (size_t l = 0; l < mesh.lods.size(); l++) {
+
+                MeshCacheLod lod;
+                if (!reader.Read(&lod, sizeof(lod))) {
+                    return false;
+                }
+                mesh.lods[l].error = lod.error;
+                if (!reader.Fits(lod.indexCount, sizeof(GLuint))) {
+                    return false;
+                }
+                mesh.lods[l].indices.resize(lod.indexCount);
+                if (!reader.Read(mesh.lods[l].indices.data(), mesh.lods[l].indices.size() * sizeof(GLuint))
+                    || !IndicesInRange(mesh.lods[l].indices, mesh.vertices.size())) {
+                    return false;
+                }
+            }
+        }
+
+        meshes.swap(cachedMeshes);
+        return true;
+    }
+
+    bool WriteMeshCache(const std::string& cacheFileName, const std::vector<std::string>& sourceFiles,
+                        unsigned int optimizeFlags, float lodMaxError, uint32_t maxMeshVertices, const std::vector<gps::MeshData>& meshes) {
+
+        // write to a temporary file first, so a crash never leaves a truncated cache behind
+        std::string tempFileName = MakeTempFileName(cacheFileName);
+        std::ofstream out(tempFileName.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+
+        MeshCacheHeader header;
+        memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+        header.version = MESH_CACHE_VERSION;
+        header.vertexSize = sizeof(gps::Vertex);
+        header.sourceFileCount = (uint32_t)sourceFiles.size();
+        header.sourceHash = HashFileStamps(sourceFiles);
+        header.meshCount = (uint32_t)meshes.size();
+        header.optimizeFlags = optimizeFlags;
+        header.lodMaxError = lodMaxError;
+        header.maxMeshVertices = maxMeshVertices;
+        WriteBlock(out, &header, sizeof(header));
+
+        for (size_t i = 0; i < sourceFiles.size(); i++) {
+            WriteString(out, sourceFiles[i]);
+        }
+
+        for (size_t m = 0; m < meshes.size(); m++) {
+
+            const gps::MeshData& mesh = meshes[m];
+
+            MeshCacheEntry entry;
+            entry.vertexCount = (uint32_t)mesh.vertices.size();
+            entry.indexCount = (uint32_t)mesh.indices.size();
+            entry.textureCount = (uint32_t)mesh.textures.size();
+            entry.lodCount = (uint32_t)mesh.lods.size();
+            WriteBlock(out, &entry, sizeof(entry));
+
+            for (size_t t = 0; t < mesh.textures.size(); t++) {
+
+                WriteString(out, mesh.textures[t].type);
+                WriteString(out, mesh.textures[t].path);
+            }
+
+            WriteBlock(out, mesh.vertices.data(), mesh.vertices.size() * sizeof(gps::Vertex));
+            WriteBlock(out, mesh.indices.data(), mesh.indices.size() * sizeof(GLuint));
+
+            for (size_t l = 0; l < mesh.lods.size(); l++) {
+
+                MeshCacheLod lod;
+                lod.indexCount = (uint32_t)mesh.lods[l].indices.size();
+                lod.error = mesh.lods[l].error;
+                WriteBlock(out, &lod, sizeof(lod));
+                WriteBlock(out, mesh.lods[l].indices.data(), mesh.lods[l].indices.size() * sizeof(GLuint));
+            }
+        }
+
+        out.close();
+        if (!out) {
+            remove(tempFileName.c_str());
+            return false;
+        }
+
+        remove(cacheFileName.c_str());
+        if (rename(tempFileName.c_str(), cacheFileName.c_str()) != 0) {
+            remove(tempFileName.c_str());
+            return false;
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef MeshCache_hpp
+#define MeshCache_hpp
+
+#include "Mesh.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Binary cache of the parsed geometry of a model, stored next to its .obj file.
+    // The header keeps a hash of the size and modification time of every source
+    // file (.obj and .mtl), so editing any of them invalidates the cache.
+
+    // Returns the cache file name used for a given .obj file
+    std::string GetMeshCacheFileName(const std::string& objFileName);
+
+    // Fills in the meshes from the cache file, returns false if the cache is
+    // missing, written by another version, older than its source files or
+    // built with other optimization flags (see MeshOptimizer.hpp), LOD error limit or split
+    // size (0 for shapes that were not split)
+    bool ReadMeshCache(const std::string& cacheFileName, unsigned int optimizeFlags, float lodMaxError, uint32_t maxMeshVertices,
+                       std::vector<gps::MeshData>& meshes);
+
+    // Writes the meshes, their levels of detail and the stamps of the source files they were built from
+    bool WriteMeshCache(const std::string& cacheFileName, const std::vector<std::string>& sourceFiles,
+                        unsigned int optimizeFlags, float lodMaxError, uint32_t maxMeshVertices, const std::vector<gps::MeshData>& meshes);
+}
+
+#endif /* MeshCache_hpp */
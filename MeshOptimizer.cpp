@@ -0,0 +1,519 @@
+#include "MeshOptimizer.hpp"
+#include "LinearArena.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace gps {
+
+    namespace {
+
+        // Vertices are compared bit for bit, only exact duplicates are welded
+        struct VertexHash {
+
+            size_t operator()(const gps::Vertex& vertex) const {
+
+                uint32_t words[sizeof(gps::Vertex) / sizeof(uint32_t)];
+                memcpy(words, &vertex, sizeof(words));
+
+                // FNV-1a over the attribute words
+                uint64_t hash = 14695981039346656037ull;
+                for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+                    hash ^= words[i];
+                    hash *= 1099511628211ull;
+                }
+                return (size_t)(hash ^ (hash >> 32));
+            }
+        };
+
+        struct VertexEqual {
+
+            bool operator()(const gps::Vertex& a, const gps::Vertex& b) const {
+
+                return memcmp(&a, &b, sizeof(gps::Vertex)) == 0;
+            }
+        };
+
+        // size of the simulated FIFO cache used for statistics and cluster splitting
+        const size_t FIFO_CACHE_SIZE = 16;
+
+        // size of the LRU cache modelled by the Forsyth scoring function
+        const int FORSYTH_CACHE_SIZE = 32;
+
+        float ForsythVertexScore(int cachePosition, unsigned int remainingTriangles) {
+
+            if (remainingTriangles == 0) {
+                return -1.0f;
+            }
+
+            float score = 0.0f;
+            if (cachePosition >= 0) {
+
+                // the vertices of the last triangle get a fixed score, so the next triangle
+                // does not simply reuse them in the same order
+                if (cachePosition < 3) {
+                    score = 0.75f;
+                }
+                else {
+                    float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+                    score = powf(1.0f - (cachePosition - 3) * scale, 1.5f);
+                }
+            }
+
+            // favour vertices with few triangles left, so they leave the working set
+            score += 2.0f / sqrtf((float)remainingTriangles);
+            return score;
+        }
+
+        // Forsyth, "Linear-Speed Vertex Cache Optimisation"
+        void OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount) {
+
+            size_t triangleCount = indices.size() / 3;
+            if (triangleCount == 0) {
+                return;
+            }
+
+            // triangle adjacency per vertex
+            std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+            for (size_t i = 0; i < triangleCount * 3; i++) {
+                adjacencyOffset[indices[i] + 1]++;
+            }
+            for (size_t v = 0; v < vertexCount; v++) {
+                adjacencyOffset[v + 1] += adjacencyOffset[v];
+            }
+
+            std::vector<unsigned int> adjacency(triangleCount * 3);
+            std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+            for (size_t t = 0; t < triangleCount; t++) {
+                for (int k = 0; k < 3; k++) {
+                    adjacency[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+                }
+            }
+
+            std::vector<unsigned int> remaining(vertexCount);
+            std::vector<int> cachePosition(vertexCount, -1);
+            std::vector<float> vertexScore(vertexCount);
+            for (size_t v = 0; v < vertexCount; v++) {
+
+                remaining[v] = adjacencyOffset[v + 1] - adjacencyOffset[v];
+                vertexScore[v] = ForsythVertexScore(-1, remaining[v]);
+            }
+
+            std::vector<char> emitted(triangleCount, 0);
+
+            std::vector<GLuint> output;
+            output.reserve(triangleCount * 3);
+
+            // cache holds one more entry than modelled, so evicted vertices can be rescored
+            std::vector<GLuint> cache;
+            std::vector<GLuint> newCache;
+            cache.reserve(FORSYTH_CACHE_SIZE + 3);
+            newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+            size_t scanCursor = 0;
+            long bestTriangle = -1;
+
+            for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+
+                if (bestTriangle < 0) {
+
+                    // nothing in the cache is connected to a remaining triangle, restart from
+                    // the next one in input order (keeps the scan amortized linear)
+                    while (emitted[scanCursor]) {
+                        scanCursor++;
+                    }
+                    bestTriangle = (long)scanCursor;
+                }
+
+                size_t t = (size_t)bestTriangle;
+                emitted[t] = 1;
+
+                // emit the triangle and move its vertices to the front of the cache
+                newCache.clear();
+                for (int k = 0; k < 3; k++) {
+
+                    GLuint v = indices[t * 3 + k];
+                    output.push_back(v);
+                    newCache.push_back(v);
+
+                    // remove the triangle from the adjacency of its vertices
+                    unsigned int* begin = &adjacency[adjacencyOffset[v]];
+                    unsigned int* end = begin + remaining[v];
+                    unsigned int* found = std::find(begin, end, (unsigned int)t);
+                    std::swap(*found, *(end - 1));
+                    remaining[v]--;
+                }
+
+                for (size_t c = 0; c < cache.size(); c++) {
+
+                    GLuint v = cache[c];
+                    if (v != newCache[0] && v != newCache[1] && v != newCache[2]) {
+                        newCache.push_back(v);
+                    }
+                }
+                cache.swap(newCache);
+
+                // evicted vertices lose their cache score
+                for (size_t c = FORSYTH_CACHE_SIZE; c < cache.size(); c++) {
+
+                    cachePosition[cache[c]] = -1;
+                    vertexScore[cache[c]] = ForsythVertexScore(-1, remaining[cache[c]]);
+                }
+                if (cache.size() > (size_t)FORSYTH_CACHE_SIZE) {
+                    cache.resize(FORSYTH_CACHE_SIZE);
+                }
+
+                for (size_t c = 0; c < cache.size(); c++) {
+
+                    cachePosition[cache[c]] = (int)c;
+                    vertexScore[cache[c]] = ForsythVertexScore((int)c, remaining[cache[c]]);
+                }
+
+                // rescore the triangles touching the cache and pick the best one as the next
+                bestTriangle = -1;
+                float bestScore = -1.0f;
+                for (size_t c = 0; c < cache.size(); c++) {
+
+                    GLuint v = cache[c];
+                    for (unsigned int a = 0; a < remaining[v]; a++) {
+
+                        unsigned int neighbour = adjacency[adjacencyOffset[v] + a];
+                        float score = vertexScore[indices[neighbour * 3 + 0]]
+                            + vertexScore[indices[neighbour * 3 + 1]]
+                            + vertexScore[indices[neighbour * 3 + 2]];
+
+                        if (score > bestScore) {
+                            bestScore = score;
+                            bestTriangle = (long)neighbour;
+                        }
+                    }
+                }
+            }
+
+            indices.swap(output);
+        }
+
+        // Splits the (cache optimized) triangle list into clusters wherever the FIFO cache
+        // restarts, then draws the clusters facing away from the mesh centre first, in the
+        // spirit of Sander et al. "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+        void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<gps::Vertex>& vertices) {
+
+            size_t triangleCount = indices.size() / 3;
+            if (triangleCount == 0) {
+                return;
+            }
+
+            std::vector<size_t> clusterStart;
+            std::vector<unsigned int> cacheTime(vertices.size(), 0);
+            unsigned int time = FIFO_CACHE_SIZE + 1;
+
+            for (size_t t = 0; t < triangleCount; t++) {
+
+                int misses = 0;
+                for (int k = 0; k < 3; k++) {
+
+                    GLuint v = indices[t * 3 + k];
+                    if (time - cacheTime[v] > FIFO_CACHE_SIZE) {
+                        cacheTime[v] = time++;
+                        misses++;
+                    }
+                }
+
+                if (t == 0 || misses == 3) {
+                    clusterStart.push_back(t);
+                }
+            }
+            clusterStart.push_back(triangleCount);
+
+            // area weighted centroid of the whole mesh
+            glm::vec3 meshCentroid(0.0f);
+            float meshArea = 0.0f;
+            for (size_t t = 0; t < triangleCount; t++) {
+
+                const glm::vec3& p0 = vertices[indices[t * 3 + 0]].Position;
+                const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+                const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+                float area = glm::length(glm::cross(p1 - p0, p2 - p0));
+
+                meshCentroid += (p0 + p1 + p2) * (area / 3.0f);
+                meshArea += area;
+            }
+            if (meshArea > 0.0f) {
+                meshCentroid /= meshArea;
+            }
+
+            size_t clusterCount = clusterStart.size() - 1;
+            std::vector<float> sortKey(clusterCount);
+            for (size_t c = 0; c < clusterCount; c++) {
+
+                glm::vec3 centroid(0.0f);
+                glm::vec3 normal(0.0f);
+                float area = 0.0f;
+
+                for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++) {
+
+                    const glm::vec3& p0 = vertices[indices[t * 3 + 0]].Position;
+                    const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+                    const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+                    glm::vec3 areaNormal = glm::cross(p1 - p0, p2 - p0);
+                    float triangleArea = glm::length(areaNormal);
+
+                    centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+                    normal += areaNormal;
+                    area += triangleArea;
+                }
+
+                if (area > 0.0f) {
+                    centroid /= area;
+                }
+                float normalLength = glm::length(normal);
+                if (normalLength > 0.0f) {
+                    normal /= normalLength;
+                }
+
+                sortKey[c] = glm::dot(centroid - meshCentroid, normal);
+            }
+
+            std::vector<size_t> order(clusterCount);
+            for (size_t c = 0; c < clusterCount; c++) {
+                order[c] = c;
+            }
+            std::stable_sort(order.begin(), order.end(), [&sortKey](size_t a, size_t b) {
+                return sortKey[a] > sortKey[b];
+            });
+
+            std::vector<GLuint> output;
+            output.reserve(indices.size());
+            for (size_t i = 0; i < clusterCount; i++) {
+
+                size_t c = order[i];
+                output.insert(output.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+            }
+
+            indices.swap(output);
+        }
+
+        // Spreads the low 10 bits of value two bits apart, for 30 bit Morton codes
+        uint32_t SpreadBits(uint32_t value) {
+
+            value &= 0x3ff;
+            value = (value | (value << 16)) & 0x030000ff;
+            value = (value | (value << 8)) & 0x0300f00f;
+            value = (value | (value << 4)) & 0x030c30c3;
+            value = (value | (value << 2)) & 0x09249249;
+            return value;
+        }
+
+        // Reorders the vertex buffer in the order of first use by the index buffer
+        void OptimizeVertexFetch(gps::MeshData& mesh) {
+
+            const GLuint unused = ~0u;
+            std::vector<GLuint> remap(mesh.vertices.size(), unused);
+            std::vector<gps::Vertex> vertices;
+            vertices.reserve(mesh.vertices.size());
+
+            for (size_t i = 0; i < mesh.indices.size(); i++) {
+
+                GLuint& index = mesh.indices[i];
+                if (remap[index] == unused) {
+                    remap[index] = (GLuint)vertices.size();
+                    vertices.push_back(mesh.vertices[index]);
+                }
+                index = remap[index];
+            }
+
+            // the levels of detail only use vertices of the full mesh
+            for (size_t l = 0; l < mesh.lods.size(); l++) {
+                for (size_t i = 0; i < mesh.lods[l].indices.size(); i++) {
+                    mesh.lods[l].indices[i] = remap[mesh.lods[l].indices[i]];
+                }
+            }
+
+            if (!mesh.splitBorder.empty()) {
+                std::vector<unsigned char> splitBorder(vertices.size());
+                for (size_t i = 0; i < remap.size(); i++) {
+                    if (remap[i] != unused) {
+                        splitBorder[remap[i]] = mesh.splitBorder[i];
+                    }
+                }
+                mesh.splitBorder.swap(splitBorder);
+            }
+
+            // vertices not referenced by any triangle are dropped
+            mesh.vertices.swap(vertices);
+        }
+    }
+
+    WeldStats WeldVertices(gps::MeshData& mesh) {
+
+        WeldStats stats;
+        stats.inputVertices = mesh.vertices.size();
+
+        // the map and the remap table are freed when the scope ends, the welded vertices stay on the heap
+        gps::LinearArena& arena = gps::LinearArena::ForThread();
+        gps::ArenaScope scope(arena);
+
+        typedef std::unordered_map<gps::Vertex, GLuint, VertexHash, VertexEqual,
+                                   gps::ArenaAllocator<std::pair<const gps::Vertex, GLuint> > > VertexMap;
+        VertexMap uniqueVertices(mesh.vertices.size(), VertexHash(), VertexEqual(), arena);
+
+        std::vector<gps::Vertex> weldedVertices;
+        weldedVertices.reserve(mesh.vertices.size());
+
+        // remap[old index] = new index
+        gps::ArenaVector<GLuint> remap(mesh.vertices.size(), 0, arena);
+
+        for (size_t i = 0; i < mesh.vertices.size(); i++) {
+
+            GLuint next = (GLuint)weldedVertices.size();
+            std::pair<VertexMap::iterator, bool> inserted =
+                uniqueVertices.insert(std::make_pair(mesh.vertices[i], next));
+
+            if (inserted.second) {
+                weldedVertices.push_back(mesh.vertices[i]);
+            }
+            remap[i] = inserted.first->second;
+        }
+
+        for (size_t i = 0; i < mesh.indices.size(); i++) {
+            mesh.indices[i] = remap[mesh.indices[i]];
+        }
+
+        weldedVertices.shrink_to_fit();
+        mesh.vertices.swap(weldedVertices);
+
+        stats.outputVertices = mesh.vertices.size();
+        return stats;
+    }
+
+    void SplitMesh(const gps::MeshData& mesh, size_t maxVertices, std::vector<gps::MeshData>& chunks) {
+
+        chunks.clear();
+        size_t triangleCount = mesh.indices.size() / 3;
+        if (mesh.vertices.size() <= maxVertices || triangleCount == 0) {
+            chunks.push_back(mesh);
+            return;
+        }
+
+        glm::vec3 minimum = mesh.vertices[0].Position;
+        glm::vec3 maximum = mesh.vertices[0].Position;
+        for (size_t i = 1; i < mesh.vertices.size(); i++) {
+            minimum = glm::min(minimum, mesh.vertices[i].Position);
+            maximum = glm::max(maximum, mesh.vertices[i].Position);
+        }
+        glm::vec3 size = glm::max(maximum - minimum, glm::vec3(1e-20f));
+
+        // Morton code of the center in the high bits, triangle in the low ones
+        std::vector<uint64_t> order(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++) {
+
+            glm::vec3 center = (mesh.vertices[mesh.indices[t * 3]].Position + mesh.vertices[mesh.indices[t * 3 + 1]].Position
+                + mesh.vertices[mesh.indices[t * 3 + 2]].Position) / 3.0f;
+            glm::vec3 cell = (center - minimum) / size * 1023.0f;
+
+            uint32_t code = SpreadBits((uint32_t)cell.x) | (SpreadBits((uint32_t)cell.y) << 1) | (SpreadBits((uint32_t)cell.z) << 2);
+            order[t] = ((uint64_t)code << 32) | (uint64_t)t;
+        }
+        std::sort(order.begin(), order.end());
+
+        const GLuint none = ~0u;
+        // index in the last chunk that used each vertex, and how many chunks use it
+        std::vector<GLuint> chunkIndex(mesh.vertices.size(), none);
+        std::vector<GLuint> lastChunk(mesh.vertices.size(), none);
+        std::vector<unsigned int> chunkUses(mesh.vertices.size(), 0);
+        // source vertex of every chunk vertex
+        std::vector<std::vector<GLuint> > sources;
+
+        for (size_t o = 0; o < order.size(); o++) {
+
+            const GLuint* triangle = &mesh.indices[(size_t)(order[o] & 0xffffffffu) * 3];
+
+            GLuint chunk = (GLuint)chunks.size() - 1;
+            size_t added = 0;
+            for (int k = 0; k < 3; k++) {
+                bool repeated = (k > 0 && triangle[k] == triangle[0]) || (k > 1 && triangle[k] == triangle[1]);
+                if (!repeated && (chunks.empty() || lastChunk[triangle[k]] != chunk)) {
+                    added++;
+                }
+            }
+
+            if (chunks.empty() || chunks.back().vertices.size() + added > maxVertices) {
+                chunks.push_back(gps::MeshData());
+                chunks.back().textures = mesh.textures;
+                sources.push_back(std::vector<GLuint>());
+                chunk = (GLuint)chunks.size() - 1;
+            }
+
+            gps::MeshData& current = chunks.back();
+            for (int k = 0; k < 3; k++) {
+
+                GLuint v = triangle[k];
+                if (lastChunk[v] != chunk) {
+                    lastChunk[v] = chunk;
+                    chunkIndex[v] = (GLuint)current.vertices.size();
+                    chunkUses[v]++;
+                    current.vertices.push_back(mesh.vertices[v]);
+                    sources.back().push_back(v);
+                }
+                current.indices.push_back(chunkIndex[v]);
+            }
+        }
+
+        for (size_t c = 0; c < chunks.size(); c++) {
+
+            chunks[c].splitBorder.resize(sources[c].size());
+            for (size_t i = 0; i < sources[c].size(); i++) {
+                chunks[c].splitBorder[i] = chunkUses[sources[c][i]] > 1 ? 1 : 0;
+            }
+        }
+    }
+
+    VertexCacheStats AnalyzeVertexCache(const gps::MeshData& mesh) {
+
+        VertexCacheStats stats;
+        stats.acmr = 0.0f;
+        stats.atvr = 0.0f;
+
+        size_t triangleCount = mesh.indices.size() / 3;
+        if (triangleCount == 0 || mesh.vertices.empty()) {
+            return stats;
+        }
+
+        std::vector<unsigned int> cacheTime(mesh.vertices.size(), 0);
+        unsigned int time = FIFO_CACHE_SIZE + 1;
+        size_t misses = 0;
+
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+
+            GLuint v = mesh.indices[i];
+            if (time - cacheTime[v] > FIFO_CACHE_SIZE) {
+                cacheTime[v] = time++;
+                misses++;
+            }
+        }
+
+        stats.acmr = (float)misses / (float)triangleCount;
+        stats.atvr = (float)misses / (float)mesh.vertices.size();
+        return stats;
+    }
+
+    void OptimizeMesh(gps::MeshData& mesh, unsigned int flags) {
+
+        if (flags & MESH_OPTIMIZE_VERTEX_CACHE) {
+            OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+            for (size_t l = 0; l < mesh.lods.size(); l++) {
+                OptimizeVertexCache(mesh.lods[l].indices, mesh.vertices.size());
+            }
+        }
+
+        if (flags & MESH_OPTIMIZE_OVERDRAW) {
+            OptimizeOverdraw(mesh.indices, mesh.vertices);
+        }
+
+        if (flags & MESH_OPTIMIZE_VERTEX_FETCH) {
+            OptimizeVertexFetch(mesh);
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef MeshOptimizer_hpp
+#define MeshOptimizer_hpp
+
+#include "Mesh.hpp"
+
+namespace gps {
+
+    struct WeldStats {
+        size_t inputVertices;
+        size_t outputVertices;
+    };
+
+    // Merges vertices with identical position, normal and texture coordinates,
+    // keeping the first occurrence of each, and rewrites the index buffer to match
+    WeldStats WeldVertices(gps::MeshData& mesh);
+
+    // Splits a mesh with more than maxVertices vertices into chunks of at most maxVertices,
+    // each with a copy of the textures. Triangles are taken in Morton order of their centers,
+    // so every chunk is a compact piece of the surface. Vertices used by several chunks are
+    // copied into each of them and flagged in splitBorder. Runs before the levels of detail
+    // (mesh.lods must be empty); a mesh that fits is copied as a single chunk.
+    void SplitMesh(const gps::MeshData& mesh, size_t maxVertices, std::vector<gps::MeshData>& chunks);
+
+    // Optional reordering passes, run once at load time (the result is stored in the mesh cache)
+    enum MeshOptimizeFlags {
+        MESH_OPTIMIZE_NONE = 0,
+        // Forsyth triangle ordering for the post-transform vertex cache
+        MESH_OPTIMIZE_VERTEX_CACHE = 1 << 0,
+        // sorts triangle clusters so outward facing ones are drawn first
+        MESH_OPTIMIZE_OVERDRAW = 1 << 1,
+        // renumbers vertices in the order the index buffer first uses them
+        MESH_OPTIMIZE_VERTEX_FETCH = 1 << 2,
+        MESH_OPTIMIZE_ALL = MESH_OPTIMIZE_VERTEX_CACHE | MESH_OPTIMIZE_OVERDRAW | MESH_OPTIMIZE_VERTEX_FETCH
+    };
+
+    // Post-transform cache efficiency, simulated with a FIFO cache
+    struct VertexCacheStats {
+        // average cache miss ratio - transformed vertices per triangle (0.5 is ideal, 3 is worst)
+        float acmr;
+        // average transform to vertex ratio - transformed vertices per unique vertex (1 is ideal)
+        float atvr;
+    };
+
+    VertexCacheStats AnalyzeVertexCache(const gps::MeshData& mesh);
+
+    // Runs the passes selected in flags, in cache, overdraw, fetch order. The levels of
+    // detail get the cache pass and follow the vertex renumbering.
+    void OptimizeMesh(gps::MeshData& mesh, unsigned int flags);
+}
+
+#endif /* MeshOptimizer_hpp */
@@ -0,0 +1,634 @@
+#include "MeshSimplifier.hpp"
+#include "LinearArena.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace gps {
+
+    namespace {
+
+        const GLuint NO_VERTEX = ~0u;
+
+        // open edges hold their vertices this much harder than the faces, so borders and seams keep their shape
+        const float EDGE_WEIGHT = 10.0f;
+
+        // a collapse may not turn a remaining triangle by more than ~75 degrees
+        const float FLIP_THRESHOLD = 0.25f;
+
+        // a LOD level has to drop at least this fraction of the triangles of the level before
+        const float MIN_LOD_REDUCTION = 0.2f;
+
+        enum VertexKind {
+            // inside the surface, collapses along any edge
+            VERTEX_MANIFOLD,
+            // on an open border, collapses along the border
+            VERTEX_BORDER,
+            // one of the two attribute sets of a position, collapses along the seam together with its twin
+            VERTEX_SEAM,
+            // corners, seams meeting, non manifold fans: never moves
+            VERTEX_LOCKED
+        };
+
+        // Weighted sum of squared distances to planes, the symmetric 4x4 matrix [A b; b c]
+        struct Quadric {
+            float a00, a11, a22, a10, a20, a21;
+            float b0, b1, b2;
+            float c;
+            float weight;
+        };
+
+        void AddPlane(Quadric& q, const glm::vec3& normal, float distance, float weight) {
+
+            q.a00 += weight * normal.x * normal.x;
+            q.a11 += weight * normal.y * normal.y;
+            q.a22 += weight * normal.z * normal.z;
+            q.a10 += weight * normal.y * normal.x;
+            q.a20 += weight * normal.z * normal.x;
+            q.a21 += weight * normal.z * normal.y;
+            q.b0 += weight * normal.x * distance;
+            q.b1 += weight * normal.y * distance;
+            q.b2 += weight * normal.z * distance;
+            q.c += weight * distance * distance;
+            q.weight += weight;
+        }
+
+        void AddQuadric(Quadric& q, const Quadric& other) {
+
+            q.a00 += other.a00;
+            q.a11 += other.a11;
+            q.a22 += other.a22;
+            q.a10 += other.a10;
+            q.a20 += other.a20;
+            q.a21 += other.a21;
+            q.b0 += other.b0;
+            q.b1 += other.b1;
+            q.b2 += other.b2;
+            q.c += other.c;
+            q.weight += other.weight;
+        }
+
+        // Squared distance of p to the planes, averaged by their weights
+        float Evaluate(const Quadric& q, const glm::vec3& p) {
+
+            float rx = q.a00 * p.x + q.a10 * p.y + q.a20 * p.z;
+            float ry = q.a10 * p.x + q.a11 * p.y + q.a21 * p.z;
+            float rz = q.a20 * p.x + q.a21 * p.y + q.a22 * p.z;
+            float r = rx * p.x + ry * p.y + rz * p.z + 2.0f * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+            return q.weight > 0.0f ? std::fabs(r) / q.weight : 0.0f;
+        }
+
+        // Positions are compared bit for bit, like the welding
+        struct PositionHash {
+
+            size_t operator()(const glm::vec3& position) const {
+
+                uint32_t words[3];
+                memcpy(words, &position, sizeof(words));
+                uint64_t hash = 14695981039346656037ull;
+                for (int i = 0; i < 3; i++) {
+                    hash ^= words[i];
+                    hash *= 1099511628211ull;
+                }
+                return (size_t)(hash ^ (hash >> 32));
+            }
+        };
+
+        struct PositionEqual {
+
+            bool operator()(const glm::vec3& a, const glm::vec3& b) const {
+
+                return memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+            }
+        };
+
+        struct Collapse {
+            GLuint vertex;
+            GLuint target;
+            // squared, normalized units
+            float error;
+        };
+
+        // State of one mesh being simplified, successive Simplify calls continue from the last one
+        class Simplifier {
+
+        public:
+            Simplifier(const gps::MeshData& mesh, const std::vector<GLuint>& indices);
+
+            // Collapses edges until targetIndexCount or maxError (model units) is reached,
+            // returns the largest error made since the start
+            float Simplify(size_t targetIndexCount, float maxError);
+
+            const std::vector<GLuint>& GetIndices() const { return indices; }
+
+        private:
+            const std::vector<gps::Vertex>& vertices;
+            const std::vector<unsigned char>& splitBorder;
+            std::vector<GLuint> indices;
+            size_t vertexCount;
+
+            // positions scaled into the unit cube, so the quadrics keep their precision in floats
+            std::vector<glm::vec3> positions;
+            float scale;
+
+            // first vertex with the same position, and the next one of them (circular list)
+            std::vector<GLuint> remap;
+            std::vector<GLuint> wedge;
+            std::vector<unsigned char> kinds;
+            // the other end of the single open edge leaving / reaching a border or seam vertex
+            std::vector<GLuint> openNext;
+            std::vector<GLuint> openPrevious;
+            // per position (by its first vertex)
+            std::vector<Quadric> quadrics;
+
+            // triangles using each position, rebuilt by every pass
+            std::vector<GLuint> triangleOffsets;
+            std::vector<GLuint> triangles;
+
+            float error;
+
+            // Directed edges a -> b of the source triangles, grouped by a
+            std::vector<GLuint> edgeOffsets;
+            std::vector<GLuint> edgeTargets;
+
+            void BuildEdges();
+            bool HasEdge(GLuint a, GLuint b) const;
+            bool HasPositionEdge(GLuint a, GLuint b) const;
+            void ClassifyVertices();
+            void ComputeQuadrics();
+
+            GLuint SeamTwin(GLuint vertex, GLuint target) const;
+            bool CanCollapse(GLuint vertex, GLuint target) const;
+            float NormalError(GLuint vertex, GLuint target) const;
+            float CollapseError(GLuint vertex, GLuint target) const;
+            bool Flips(GLuint vertex, GLuint target) const;
+
+            void BuildTriangleAdjacency();
+            void RemapOpenEdges(std::vector<GLuint>& open, const std::vector<GLuint>& collapseRemap) const;
+        };
+
+        Simplifier::Simplifier(const gps::MeshData& mesh, const std::vector<GLuint>& indices)
+            : vertices(mesh.vertices), splitBorder(mesh.splitBorder), indices(indices), vertexCount(mesh.vertices.size()), scale(1.0f), error(0.0f) {
+
+            glm::vec3 minimum(FLT_MAX);
+            glm::vec3 maximum(-FLT_MAX);
+            for (size_t i = 0; i < vertexCount; i++) {
+                minimum = glm::min(minimum, vertices[i].Position);
+                maximum = glm::max(maximum, vertices[i].Position);
+            }
+            glm::vec3 size = maximum - minimum;
+            float extent = std::max(size.x, std::max(size.y, size.z));
+            scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+
+            positions.resize(vertexCount);
+            for (size_t i = 0; i < vertexCount; i++) {
+                positions[i] = (vertices[i].Position - minimum) * scale;
+            }
+
+            // wedges: vertices that differ only by their attributes
+            remap.resize(vertexCount);
+            wedge.resize(vertexCount);
+            // one node per position, on the thread arena until the constructor returns
+            gps::LinearArena& arena = gps::LinearArena::ForThread();
+            gps::ArenaScope scope(arena);
+            std::unordered_map<glm::vec3, GLuint, PositionHash, PositionEqual,
+                               gps::ArenaAllocator<std::pair<const glm::vec3, GLuint> > >
+                firstVertex(vertexCount, PositionHash(), PositionEqual(), arena);
+            for (size_t i = 0; i < vertexCount; i++) {
+
+                GLuint first = firstVertex.insert(std::make_pair(vertices[i].Position, (GLuint)i)).first->second;
+                remap[i] = first;
+                wedge[i] = (GLuint)i;
+                if (first != i) {
+                    wedge[i] = wedge[first];
+                    wedge[first] = (GLuint)i;
+                }
+            }
+
+            BuildEdges();
+            ClassifyVertices();
+            ComputeQuadrics();
+        }
+
+        void Simplifier::BuildEdges() {
+
+            edgeOffsets.assign(vertexCount + 1, 0);
+            for (size_t i = 0; i < indices.size(); i++) {
+                edgeOffsets[indices[i] + 1]++;
+            }
+            for (size_t v = 0; v < vertexCount; v++) {
+                edgeOffsets[v + 1] += edgeOffsets[v];
+            }
+
+            edgeTargets.resize(indices.size());
+            std::vector<GLuint> fill(edgeOffsets.begin(), edgeOffsets.end() - 1);
+            for (size_t t = 0; t < indices.size() / 3; t++) {
+                for (int k = 0; k < 3; k++) {
+
+                    GLuint a = indices[t * 3 + k];
+                    GLuint b = indices[t * 3 + (k + 1) % 3];
+                    edgeTargets[fill[a]++] = b;
+                }
+            }
+        }
+
+        bool Simplifier::HasEdge(GLuint a, GLuint b) const {
+
+            for (GLuint e = edgeOffsets[a]; e < edgeOffsets[a + 1]; e++) {
+                if (edgeTargets[e] == b) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Edge a -> b between any wedges of the two positions
+        bool Simplifier::HasPositionEdge(GLuint a, GLuint b) const {
+
+            GLuint w = a;
+            do {
+                for (GLuint e = edgeOffsets[w]; e < edgeOffsets[w + 1]; e++) {
+                    if (remap[edgeTargets[e]] == remap[b]) {
+                        return true;
+                    }
+                }
+                w = wedge[w];
+            } while (w != a);
+            return false;
+        }
+
+        void Simplifier::ClassifyVertices() {
+
+            // open edges have no twin going the other way, a vertex on more than one in either
+            // direction points to itself
+            openNext.assign(vertexCount, NO_VERTEX);
+            openPrevious.assign(vertexCount, NO_VERTEX);
+            std::vector<unsigned char> border(vertexCount, 0);
+
+            for (GLuint a = 0; a < vertexCount; a++) {
+                for (GLuint e = edgeOffsets[a]; e < edgeOffsets[a + 1]; e++) {
+
+                    GLuint b = edgeTargets[e];
+                    if (remap[a] == remap[b] || HasEdge(b, a)) {
+                        continue;
+                    }
+
+                    openNext[a] = openNext[a] == NO_VERTEX ? b : a;
+                    openPrevious[b] = openPrevious[b] == NO_VERTEX ? a : b;
+                    // open between the positions too, not a seam
+                    if (!HasPositionEdge(b, a)) {
+                        border[a] = border[b] = 1;
+                    }
+                }
+            }
+
+            kinds.assign(vertexCount, VERTEX_LOCKED);
+            for (GLuint v = 0; v < vertexCount; v++) {
+
+                if (remap[v] != v) {
+                    continue;
+                }
+
+                GLuint twin = wedge[v];
+                bool single = openNext[v] != NO_VERTEX && openNext[v] != v && openPrevious[v] != NO_VERTEX && openPrevious[v] != v;
+                unsigned char kind = VERTEX_LOCKED;
+
+                if (twin == v) {
+                    if (openNext[v] == NO_VERTEX && openPrevious[v] == NO_VERTEX) {
+                        kind = VERTEX_MANIFOLD;
+                    }
+                    else if (single) {
+                        kind = VERTEX_BORDER;
+                    }
+                }
+                else if (wedge[twin] == v) {
+
+                    bool twinSingle = openNext[twin] != NO_VERTEX && openNext[twin] != twin
+                        && openPrevious[twin] != NO_VERTEX && openPrevious[twin] != twin;
+                    // the twin runs along the same seam the other way
+                    if (single && twinSingle && !border[v] && !border[twin]
+                        && remap[openNext[v]] == remap[openPrevious[twin]] && remap[openPrevious[v]] == remap[openNext[twin]]) {
+                        kind = VERTEX_SEAM;
+                    }
+                }
+
+                // the other chunks of a split shape draw the same position, it cannot move
+                GLuint w = v;
+                do {
+                    if (!splitBorder.empty() && splitBorder[w]) {
+                        kind = VERTEX_LOCKED;
+                    }
+                    w = wedge[w];
+                } while (w != v);
+
+                do {
+                    kinds[w] = kind;
+                    w = wedge[w];
+                } while (w != v);
+            }
+        }
+
+        void Simplifier::ComputeQuadrics() {
+
+            Quadric zero;
+            memset(&zero, 0, sizeof(zero));
+            quadrics.assign(vertexCount, zero);
+
+            for (size_t t = 0; t < indices.size() / 3; t++) {
+
+                const GLuint* corners = &indices[t * 3];
+                const glm::vec3& p0 = positions[corners[0]];
+                glm::vec3 normal = glm::cross(positions[corners[1]] - p0, positions[corners[2]] - p0);
+                float length = glm::length(normal);
+                if (length == 0.0f) {
+                    continue;
+                }
+                normal /= length;
+
+                // the face plane, weighted by the area
+                for (int k = 0; k < 3; k++) {
+                    AddPlane(quadrics[remap[corners[k]]], normal, -glm::dot(normal, p0), length * 0.5f);
+                }
+
+                // open edges also get the plane through them perpendicular to the face
+                for (int k = 0; k < 3; k++) {
+
+                    GLuint a = corners[k];
+                    GLuint b = corners[(k + 1) % 3];
+                    if (HasEdge(b, a)) {
+                        continue;
+                    }
+
+                    glm::vec3 edge = positions[b] - positions[a];
+                    float edgeLength = glm::length(edge);
+                    if (edgeLength == 0.0f) {
+                        continue;
+                    }
+                    glm::vec3 edgeNormal = glm::normalize(glm::cross(edge, normal));
+                    float distance = -glm::dot(edgeNormal, positions[a]);
+                    AddPlane(quadrics[remap[a]], edgeNormal, distance, edgeLength * edgeLength * EDGE_WEIGHT);
+                    AddPlane(quadrics[remap[b]], edgeNormal, distance, edgeLength * edgeLength * EDGE_WEIGHT);
+                }
+            }
+        }
+
+        // The wedge of target's position the twin of a seam vertex collapses onto
+        GLuint Simplifier::SeamTwin(GLuint vertex, GLuint target) const {
+
+            GLuint twin = wedge[vertex];
+            if (openNext[twin] != NO_VERTEX && remap[openNext[twin]] == remap[target]) {
+                return openNext[twin];
+            }
+            if (openPrevious[twin] != NO_VERTEX && remap[openPrevious[twin]] == remap[target]) {
+                return openPrevious[twin];
+            }
+            return NO_VERTEX;
+        }
+
+        bool Simplifier::CanCollapse(GLuint vertex, GLuint target) const {
+
+            bool alongOpenEdge = openNext[vertex] == target || openPrevious[vertex] == target;
+            switch (kinds[vertex]) {
+            case VERTEX_MANIFOLD:
+                return true;
+            case VERTEX_BORDER:
+                return kinds[target] == VERTEX_BORDER && alongOpenEdge;
+            case VERTEX_SEAM:
+                return kinds[target] == VERTEX_SEAM && alongOpenEdge && SeamTwin(vertex, target) != NO_VERTEX;
+            default:
+                return false;
+            }
+        }
+
+        // Shading error of giving the vertex the normal of the target, as a distance over the edge
+        float Simplifier::NormalError(GLuint vertex, GLuint target) const {
+
+            const glm::vec3& a = vertices[vertex].Normal;
+            const glm::vec3& b = vertices[target].Normal;
+            float lengths = glm::length(a) * glm::length(b);
+            float deviation = lengths > 0.0f ? 1.0f - glm::dot(a, b) / lengths : 0.0f;
+            return glm::length(positions[vertex] - positions[target]) * deviation * 0.5f;
+        }
+
+        float Simplifier::CollapseError(GLuint vertex, GLuint target) const {
+
+            float shading = NormalError(vertex, target);
+            if (kinds[vertex] == VERTEX_SEAM) {
+                shading = std::max(shading, NormalError(wedge[vertex], SeamTwin(vertex, target)));
+            }
+            return std::max(Evaluate(quadrics[remap[vertex]], positions[target]), shading * shading);
+        }
+
+        // True if moving the vertex's position onto the target turns over a triangle that survives
+        bool Simplifier::Flips(GLuint vertex, GLuint target) const {
+
+            GLuint position = remap[vertex];
+            const glm::vec3& moved = positions[target];
+
+            for (GLuint i = triangleOffsets[position]; i < triangleOffsets[position + 1]; i++) {
+
+                const GLuint* corners = &indices[triangles[i] * 3];
+                int k = remap[corners[0]] == position ? 0 : (remap[corners[1]] == position ? 1 : 2);
+                GLuint b = corners[(k + 1) % 3];
+                GLuint c = corners[(k + 2) % 3];
+                if (remap[b] == remap[target] || remap[c] == remap[target]) {
+                    continue;
+                }
+
+                const glm::vec3& p0 = positions[corners[k]];
+                glm::vec3 before = glm::cross(positions[b] - p0, positions[c] - p0);
+                glm::vec3 after = glm::cross(positions[b] - moved, positions[c] - moved);
+                if (glm::dot(before, after) <= FLIP_THRESHOLD * glm::length(before) * glm::length(after)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void Simplifier::BuildTriangleAdjacency() {
+
+            triangleOffsets.assign(vertexCount + 1, 0);
+            for (size_t i = 0; i < indices.size(); i++) {
+                triangleOffsets[remap[indices[i]] + 1]++;
+            }
+            for (size_t v = 0; v < vertexCount; v++) {
+                triangleOffsets[v + 1] += triangleOffsets[v];
+            }
+
+            triangles.resize(indices.size());
+            std::vector<GLuint> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); i++) {
+                triangles[fill[remap[indices[i]]]++] = (GLuint)(i / 3);
+            }
+        }
+
+        // Open edges that ended at a collapsed vertex now end at its target
+        void Simplifier::RemapOpenEdges(std::vector<GLuint>& open, const std::vector<GLuint>& collapseRemap) const {
+
+            for (GLuint v = 0; v < vertexCount; v++) {
+
+                GLuint other = open[v];
+                if (other == NO_VERTEX || other == v) {
+                    continue;
+                }
+                GLuint target = collapseRemap[other];
+                // the edge itself was collapsed, skip to the one after it
+                open[v] = target == v ? open[other] : target;
+            }
+        }
+
+        float Simplifier::Simplify(size_t targetIndexCount, float maxError) {
+
+            float errorLimit = maxError * scale;
+            errorLimit = maxError < FLT_MAX ? errorLimit * errorLimit : FLT_MAX;
+
+            std::vector<Collapse> collapses;
+            std::vector<GLuint> collapseRemap(vertexCount);
+            std::vector<unsigned char> touched(vertexCount);
+
+            while (indices.size() > targetIndexCount) {
+
+                // the cheapest direction of every edge (interior edges show up once per triangle)
+                collapses.clear();
+                for (size_t i = 0; i < indices.size(); i++) {
+
+                    GLuint a = indices[i];
+                    GLuint b = indices[i % 3 == 2 ? i - 2 : i + 1];
+                    if (remap[a] == remap[b]) {
+                        continue;
+                    }
+
+                    Collapse collapse = { NO_VERTEX, NO_VERTEX, FLT_MAX };
+                    if (CanCollapse(a, b)) {
+                        Collapse ab = { a, b, CollapseError(a, b) };
+                        collapse = ab;
+                    }
+                    if (CanCollapse(b, a)) {
+                        float ba = CollapseError(b, a);
+                        if (ba < collapse.error) {
+                            Collapse reverse = { b, a, ba };
+                            collapse = reverse;
+                        }
+                    }
+                    if (collapse.vertex != NO_VERTEX && collapse.error <= errorLimit) {
+                        collapses.push_back(collapse);
+                    }
+                }
+                if (collapses.empty()) {
+                    break;
+                }
+
+                std::sort(collapses.begin(), collapses.end(),
+                    [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+                // an interior collapse removes two triangles, stop the pass near the target
+                size_t triangleCount = indices.size() / 3;
+                size_t collapseGoal = std::max((triangleCount - targetIndexCount / 3) / 2, (size_t)1);
+
+                BuildTriangleAdjacency();
+                for (GLuint v = 0; v < vertexCount; v++) {
+                    collapseRemap[v] = v;
+                }
+                std::fill(touched.begin(), touched.end(), 0);
+
+                // the cheapest collapses whose 1-rings do not overlap, so their errors and flip
+                // checks, made against the positions before the pass, stay valid
+                size_t performed = 0;
+                size_t flipped = 0;
+                for (size_t i = 0; i < collapses.size() && performed < collapseGoal; i++) {
+
+                    // well past the cost of the goal's collapse, the next pass finds cheaper ones
+                    // next to the collapses made
+                    const Collapse& collapse = collapses[i];
+                    if (collapse.error > collapses[std::min(collapseGoal + flipped, collapses.size()) - 1].error * 3.0f) {
+                        break;
+                    }
+                    GLuint from = remap[collapse.vertex];
+                    GLuint to = remap[collapse.target];
+                    if (touched[from] || touched[to]) {
+                        continue;
+                    }
+                    if (Flips(collapse.vertex, collapse.target)) {
+                        flipped++;
+                        continue;
+                    }
+
+                    if (kinds[collapse.vertex] == VERTEX_SEAM) {
+                        collapseRemap[wedge[collapse.vertex]] = SeamTwin(collapse.vertex, collapse.target);
+                    }
+                    collapseRemap[collapse.vertex] = collapse.target;
+
+                    AddQuadric(quadrics[to], quadrics[from]);
+                    for (GLuint t = triangleOffsets[from]; t < triangleOffsets[from + 1]; t++) {
+
+                        const GLuint* corners = &indices[triangles[t] * 3];
+                        touched[remap[corners[0]]] = touched[remap[corners[1]]] = touched[remap[corners[2]]] = 1;
+                    }
+                    touched[to] = 1;
+                    error = std::max(error, collapse.error);
+                    performed++;
+                }
+                if (performed == 0) {
+                    break;
+                }
+
+                RemapOpenEdges(openNext, collapseRemap);
+                RemapOpenEdges(openPrevious, collapseRemap);
+
+                // collapsed triangles are the ones left with two corners at one position
+                size_t write = 0;
+                for (size_t t = 0; t < triangleCount; t++) {
+
+                    GLuint a = collapseRemap[indices[t * 3 + 0]];
+                    GLuint b = collapseRemap[indices[t * 3 + 1]];
+                    GLuint c = collapseRemap[indices[t * 3 + 2]];
+                    if (remap[a] != remap[b] && remap[b] != remap[c] && remap[c] != remap[a]) {
+                        indices[write++] = a;
+                        indices[write++] = b;
+                        indices[write++] = c;
+                    }
+                }
+                indices.resize(write);
+            }
+
+            return std::sqrt(error) / scale;
+        }
+    }
+
+    float SimplifyMesh(const gps::MeshData& mesh, const std::vector<GLuint>& indices, size_t targetIndexCount,
+                       float maxError, std::vector<GLuint>& result) {
+
+        Simplifier simplifier(mesh, indices);
+        float error = simplifier.Simplify(targetIndexCount, maxError);
+        result = simplifier.GetIndices();
+        return error;
+    }
+
+    void BuildMeshLods(gps::MeshData& mesh, float maxError) {
+
+        mesh.lods.clear();
+
+        // every level goes on from the one before, so the errors only grow
+        Simplifier simplifier(mesh, mesh.indices);
+        size_t previousCount = mesh.indices.size();
+        for (unsigned int level = 1; level <= MESH_LOD_LEVELS; level++) {
+
+            size_t target = (mesh.indices.size() / 3 >> level) * 3;
+            float error = simplifier.Simplify(target, maxError);
+
+            const std::vector<GLuint>& indices = simplifier.GetIndices();
+            if (indices.empty() || indices.size() > previousCount * (1.0f - MIN_LOD_REDUCTION)) {
+                break;
+            }
+
+            gps::MeshLod lod;
+            lod.indices = indices;
+            lod.error = error;
+            mesh.lods.push_back(lod);
+            previousCount = indices.size();
+        }
+    }
+}
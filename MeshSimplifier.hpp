@@ -0,0 +1,34 @@
+#ifndef MeshSimplifier_hpp
+#define MeshSimplifier_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Coarser levels built by BuildMeshLods, at most
+    const unsigned int MESH_LOD_LEVELS = 4;
+
+    // Quadric error metric simplification (Garland & Heckbert) by collapsing edges onto
+    // one of their vertices, so the simplified index buffers use the vertices of the mesh.
+    //
+    // Vertices sharing a position with another attribute set (UV or normal seams) collapse
+    // together with their twin along the seam, so seams stay closed and keep their texture
+    // coordinates on both sides. Open borders only collapse along themselves; positions with
+    // more than two attribute sets never move, nor do the vertices of mesh.splitBorder. The
+    // error of a collapse is the distance to the planes of the triangles it replaces, or the
+    // shading error of the normal change over the edge when that is larger. Errors are in
+    // model units.
+
+    // Simplifies the triangles of indices (over mesh.vertices) to at most targetIndexCount
+    // indices, making no collapse with an error above maxError. Returns the largest error made.
+    float SimplifyMesh(const gps::MeshData& mesh, const std::vector<GLuint>& indices, size_t targetIndexCount,
+                       float maxError, std::vector<GLuint>& result);
+
+    // Fills mesh.lods with up to MESH_LOD_LEVELS levels, each simplified to half the triangles
+    // of the one before. Stops at maxError, or when a level would not drop a fifth of the triangles.
+    void BuildMeshLods(gps::MeshData& mesh, float maxError);
+}
+
+#endif /* MeshSimplifier_hpp */
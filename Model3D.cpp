@@ -1,57 +1,424 @@
 #include "Model3D.hpp"
+#include "AllocationCounter.hpp"
+#include "GeometryArena.hpp"
+#include "GLState.hpp"
+#include "LinearArena.hpp"
+#include "MappedFile.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "ObjParser.hpp"
+#include "TextureRegistry.hpp"
+
+#include <algorithm>
+#include <utility>
 
 namespace gps {
 
+	namespace {
+
+		// a mesh moves to a coarser level only once its error is this far under the threshold,
+		// and back when it goes over, so it does not flicker at the switching distance
+		const float LOD_HYSTERESIS = 0.75f;
+
+		// Largest scale of the model matrix along any axis, to bring model errors to world space
+		float MaxScale(const glm::mat4& model) {
+
+			return std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		}
+
+		// Distance from the camera to the nearest point of a world space volume, where its error is largest
+		float NearestDistance(const gps::RenderQueue& queue, const gps::BoundingSphere& sphere) {
+
+			return std::max(glm::length(sphere.center - queue.GetCameraPosition()) - sphere.radius, 0.0f);
+		}
+
+		// Reads the .mtl files like tinyobj::MaterialFileReader, but from a memory-mapped file, and records their
+		// paths so that the mesh cache is invalidated when a material changes
+		class MaterialFileTracker : public tinyobj::MaterialReader {
+
+		public:
+			MaterialFileTracker(const std::string& basePath, std::vector<std::string>& openedFiles)
+				: basePath(basePath), openedFiles(openedFiles) {}
+
+			virtual bool operator()(const std::string& matId,
+									std::vector<tinyobj::material_t>* materials,
+									std::map<std::string, int>* matMap,
+									std::string* err) {
+
+				std::string filePath = basePath + matId;
+				openedFiles.push_back(filePath);
+
+				// parsed straight from the mapped file, a missing file still yields the default material
+				gps::MappedFile file;
+				bool found = file.Open(filePath);
+				gps::MemoryStreamBuf buffer(file.Data(), file.Size());
+				std::istream stream(&buffer);
+				tinyobj::LoadMtl(matMap, materials, &stream);
+
+				if (!found && err) {
+					(*err) += "WARN: Material file [ " + filePath + " ] not found. Created a default material.";
+				}
+
+				return true;
+			}
+
+		private:
+			std::string basePath;
+			std::vector<std::string>& openedFiles;
+		};
+	}
+
 	void Model3D::LoadModel(std::string fileName) {
 
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-		ReadOBJ(fileName, basePath);
+		LoadModel(fileName, basePath);
 	}
 
     void Model3D::LoadModel(std::string fileName, std::string basePath)	{
 
-		ReadOBJ(fileName, basePath);
+		if (!PrepareModel(fileName, basePath)) {
+
+			PrintLoadLog(std::cerr);
+			exit(1);
+		}
+		UploadModel();
+
+		// nothing else is loaded on this thread for now
+		gps::LinearArena::ForThread().Release();
+	}
+
+	bool Model3D::PrepareModel(std::string fileName, std::string basePath, unsigned int parseThreads) {
+
+		uint64_t heapAllocations = gps::GetThreadHeapAllocations();
+
+		if (!ReadOBJ(fileName, basePath, pendingMeshes, parseThreads)) {
+
+			loadLog << "ERROR: could not load " << fileName << std::endl;
+			gps::LinearArena::ForThread().Reset();
+			return false;
+		}
+
+		// cook (or read from the texture cache) every texture once, LoadTexture picks them up during the upload
+		bool compressTextures = gps::IsTextureCompressionSupported();
+		for (size_t m = 0; m < pendingMeshes.size(); m++) {
+
+			for (size_t t = 0; t < pendingMeshes[m].textures.size(); t++) {
+
+				const std::string& path = pendingMeshes[m].textures[t].path;
+				bool decoded = false;
+
+				for (size_t i = 0; i < pendingImages.size(); i++) {
+
+					if (pendingImages[i].path == path) {
+						decoded = true;
+						break;
+					}
+				}
+
+				// skipped when resident for another model, or being cooked for one prepared in parallel
+				if (!decoded && gps::TextureRegistry::Get().ClaimCooking(path)) {
+
+					pendingImages.push_back(gps::CookedTexture());
+					if (!gps::CookTexture(path, compressTextures, pendingImages.back())) {
+						gps::TextureRegistry::Get().EndCooking(path);
+						pendingImages.pop_back();
+					}
+				}
+			}
+		}
+
+		// made on this thread and by the parser threads, not by models prepared alongside
+		gps::LinearArena& arena = gps::LinearArena::ForThread();
+		if (gps::HEAP_ALLOCATIONS_COUNTED) {
+			loadLog << "Heap allocations : " << gps::GetThreadHeapAllocations() - heapAllocations << ", ";
+		}
+		loadLog << "Loader arena peak : " << arena.GetPeakBytes() / 1024 << " KB" << std::endl;
+		// the loader temporaries are gone, the next model on this thread reuses the arena blocks
+		arena.Reset();
+		return true;
+	}
+
+	void Model3D::UploadModel() {
+
+		PrintLoadLog(std::cout);
+
+		size_t vertexCount = 0;
+		// what the meshes would keep on the CPU after the upload
+		size_t geometryBytes = 0;
+		meshes.reserve(meshes.size() + pendingMeshes.size());
+		for (size_t m = 0; m < pendingMeshes.size(); m++) {
+
+			std::vector<gps::Texture> textures;
+			for (size_t t = 0; t < pendingMeshes[m].textures.size(); t++) {
+
+				const gps::Texture& texture = pendingMeshes[m].textures[t];
+				textures.push_back(LoadTexture(texture.path, texture.type));
+			}
+
+			vertexCount += pendingMeshes[m].vertices.size();
+			geometryBytes += pendingMeshes[m].vertices.size() * sizeof(gps::Vertex) + pendingMeshes[m].indices.size() * sizeof(GLuint);
+			bounds = m == 0 ? pendingMeshes[m].bounds : gps::MergeBounds(bounds, pendingMeshes[m].bounds);
+
+			// the mesh takes the pending geometry, and frees it right away unless it is retained,
+			// so the CPU copies of all meshes are never alive next to their uploads
+			meshes.emplace_back(std::move(pendingMeshes[m]), std::move(textures), vertexFormat, retainCpuData);
+		}
+
+		std::cout << "CPU geometry : " << geometryBytes / (1024.0 * 1024.0) << " MB "
+			<< (retainCpuData ? "retained" : "released after upload") << std::endl;
+
+		std::vector<gps::MeshData>().swap(pendingMeshes);
+		EndCooking();
+		std::vector<gps::CookedTexture>().swap(pendingImages);
+
+		if (vertexFormat == gps::VERTEX_FORMAT_PACKED) {
+
+			// worst vertex of all meshes, positions in model units
+			gps::PackingError error = { 0.0f, 0.0f, 0.0f };
+			for (size_t i = 0; i < meshes.size(); i++) {
+				const gps::PackingError& meshError = meshes[i].getPackingError();
+				error.position = std::max(error.position, meshError.position);
+				error.normal = std::max(error.normal, meshError.normal);
+				error.texCoords = std::max(error.texCoords, meshError.texCoords);
+			}
+
+			std::cout << "Packed vertices : " << vertexCount << " ("
+				<< vertexCount * gps::GetVertexSize(gps::VERTEX_FORMAT_FULL) / (1024.0 * 1024.0) << " MB -> "
+				<< vertexCount * gps::GetVertexSize(gps::VERTEX_FORMAT_PACKED) / (1024.0 * 1024.0) << " MB), max error "
+				<< error.position << " position, " << error.normal << " deg normal, " << error.texCoords << " uv" << std::endl;
+		}
+	}
+
+	void Model3D::PrintLoadLog(std::ostream& out) {
+
+		out << loadLog.str();
+		loadLog.str("");
+	}
+
+	void Model3D::SetOptimizeFlags(unsigned int flags) {
+
+		optimizeFlags = flags;
+	}
+
+	void Model3D::SetLodMaxError(float worldError, float placementScale) {
+
+		lodMaxError = worldError / placementScale;
+	}
+
+	void Model3D::SetVertexFormat(gps::VertexFormat format) {
+
+		vertexFormat = format;
+	}
+
+	void Model3D::SetSplitMeshes(bool split) {
+
+		splitMeshes = split;
+	}
+
+	void Model3D::SetRetainCpuData(bool retain) {
+
+		retainCpuData = retain;
+	}
+
+	void Model3D::SetUseMeshCache(bool use) {
+
+		useMeshCache = use;
+	}
+
+	const gps::Bounds& Model3D::GetBounds() const {
+
+		return bounds;
+	}
+
+	size_t Model3D::GetMeshCount() const {
+
+		return meshes.size();
 	}
 
 	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram) {
+	void Model3D::Draw(const gps::Shader& shaderProgram) {
 
 		for (int i = 0; i < meshes.size(); i++)
 			meshes[i].Draw(shaderProgram);
 	}
 
+	// Queue the draw of each mesh from the model
+	void Model3D::Submit(gps::RenderQueue& queue, gps::RenderLayer layer, const gps::Shader& shaderProgram, const glm::mat4& model,
+	                     gps::LodState* lodState) {
+
+		const gps::Frustum& frustum = queue.GetFrustum();
+
+		// the model bounds decide for all meshes, unless they cross a plane
+		gps::FrustumTest modelTest = frustum.Test(gps::TransformBounds(bounds, model));
+		if (modelTest == gps::FRUSTUM_OUTSIDE) {
+			queue.RecordCulling(0, meshes.size());
+			return;
+		}
+
+		if (lodState != NULL) {
+			lodState->levels.resize(meshes.size(), 0);
+		}
+
+		uint32_t transform = queue.AddTransform(model);
+		float scale = MaxScale(model);
+		size_t visible = 0;
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			gps::Bounds meshBounds = gps::TransformBounds(meshes[i].getBounds(), model);
+			if (modelTest == gps::FRUSTUM_INSIDE || frustum.Test(meshBounds) != gps::FRUSTUM_OUTSIDE) {
+
+				size_t previous = lodState != NULL ? lodState->levels[i] : 0;
+				size_t lod = SelectLod(meshes[i], queue, NearestDistance(queue, meshBounds.sphere), scale, previous);
+				if (lodState != NULL) {
+					lodState->levels[i] = (uint8_t)lod;
+				}
+
+				// packed meshes carry their own position decode
+				uint32_t meshTransform = meshes[i].getVertexFormat() == gps::VERTEX_FORMAT_PACKED
+					? queue.AddTransform(model, meshes[i].getPositionDecode()) : transform;
+				meshes[i].Submit(queue, layer, shaderProgram, meshTransform, meshBounds.box, 1, lod);
+				visible++;
+			}
+		}
+		queue.RecordCulling(visible, meshes.size() - visible);
+	}
+
+	// Queue one instanced draw per mesh for all the copies
+	void Model3D::SubmitInstances(gps::RenderQueue& queue, gps::RenderLayer layer, const gps::Shader& shaderProgram,
+	                              const std::vector<glm::mat4>& models) {
+
+		// copies are culled as a whole, by the model bounds
+		const gps::Frustum& frustum = queue.GetFrustum();
+		visibleModels.clear();
+		gps::Bounds visibleBounds;
+		float nearestDistance = FLT_MAX;
+		float nearestScale = 1.0f;
+		for (size_t i = 0; i < models.size(); i++) {
+
+			gps::Bounds copyBounds = gps::TransformBounds(bounds, models[i]);
+			if (frustum.Test(copyBounds) != gps::FRUSTUM_OUTSIDE) {
+				visibleBounds = visibleModels.empty() ? copyBounds : gps::MergeBounds(visibleBounds, copyBounds);
+				visibleModels.push_back(models[i]);
+
+				float distance = NearestDistance(queue, copyBounds.sphere);
+				if (distance < nearestDistance) {
+					nearestDistance = distance;
+					nearestScale = MaxScale(models[i]);
+				}
+			}
+		}
+		queue.RecordCulling(visibleModels.size() * meshes.size(), (models.size() - visibleModels.size()) * meshes.size());
+
+		if (visibleModels.empty())
+			return;
+
+		uint32_t transform = queue.AddTransforms(visibleModels);
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			// the nearest copy picks the level of all of them
+			size_t lod = SelectLod(meshes[i], queue, nearestDistance, nearestScale, 0);
+			uint32_t meshTransform = meshes[i].getVertexFormat() == gps::VERTEX_FORMAT_PACKED
+				? queue.AddTransforms(visibleModels, meshes[i].getPositionDecode()) : transform;
+			meshes[i].Submit(queue, layer, shaderProgram, meshTransform, visibleBounds.box, (uint32_t)visibleModels.size(), lod);
+		}
+	}
+
+	// Coarsest level whose error projects under the queue's threshold. Between that and the
+	// coarsest level under the hysteresis threshold the previous level is kept.
+	size_t Model3D::SelectLod(const gps::Mesh& mesh, const gps::RenderQueue& queue, float distance, float scale, size_t previous) const {
+
+		float limit = queue.GetLodErrorLimit(distance);
+		if (limit <= 0.0f) {
+			return 0;
+		}
+
+		size_t coarsest = 0;
+		size_t settled = 0;
+		for (size_t level = 1; level < mesh.getLodCount(); level++) {
+
+			float error = mesh.getLodError(level) * scale;
+			if (error <= limit) {
+				coarsest = level;
+			}
+			if (error <= limit * LOD_HYSTERESIS) {
+				settled = level;
+			}
+		}
+		return std::min(std::max(previous, settled), coarsest);
+	}
+
+	// Loads the geometry from the mesh cache, or parses the .obj file and refreshes the cache
+	bool Model3D::ReadOBJ(std::string fileName, std::string basePath, std::vector<gps::MeshData>& meshData, unsigned int parseThreads) {
+
+        loadLog << "Loading : " << fileName << std::endl;
+
+		std::string cacheFileName = gps::GetMeshCacheFileName(fileName);
+
+		uint32_t maxMeshVertices = splitMeshes ? (uint32_t)gps::GeometryArena::SHORT_INDEX_VERTICES : 0;
+		if (useMeshCache && gps::ReadMeshCache(cacheFileName, optimizeFlags, lodMaxError, maxMeshVertices, meshData)) {
+
+			loadLog << "# of meshes    : " << meshData.size() << " (from cache)" << std::endl;
+		}
+		else {
+
+			std::vector<std::string> sourceFiles;
+			if (!ParseOBJ(fileName, basePath, meshData, sourceFiles, parseThreads)) {
+				return false;
+			}
+
+			if (useMeshCache && !gps::WriteMeshCache(cacheFileName, sourceFiles, optimizeFlags, lodMaxError, maxMeshVertices, meshData)) {
+				loadLog << "WARNING: could not write mesh cache " << cacheFileName << std::endl;
+			}
+		}
+
+		// bounds come from the final vertices, the cache does not store them
+		for (size_t m = 0; m < meshData.size(); m++) {
+			meshData[m].bounds = gps::ComputeBounds(meshData[m].vertices);
+		}
+		return true;
+	}
+
 	// Does the parsing of the .obj file and fills in the data structure
-	void Model3D::ReadOBJ(std::string fileName, std::string basePath) {
+	bool Model3D::ParseOBJ(std::string fileName, std::string basePath, std::vector<gps::MeshData>& meshData, std::vector<std::string>& sourceFiles,
+	                       unsigned int parseThreads) {
 
-        std::cout << "Loading : " << fileName << std::endl;
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
 		int materialId;
 
 		std::string err;
-		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		sourceFiles.push_back(fileName);
+
+		MaterialFileTracker readMatFn(basePath, sourceFiles);
+		bool ret = gps::LoadObjParallel(&attrib, &shapes, &materials, &err, fileName, &readMatFn, parseThreads);
 
 		if (!err.empty()) {
 
-			// `err` may contain warning message.
-			std::cerr << err << std::endl;
+			// `err` may contain warning message, kept with the other messages of this model
+			loadLog << err << std::endl;
 		}
 
 		if (!ret) {
 
-			exit(1);
+			return false;
 		}
 
-		std::cout << "# of shapes    : " << shapes.size() << std::endl;
-		std::cout << "# of materials : " << materials.size() << std::endl;
+		loadLog << "# of shapes    : " << shapes.size() << std::endl;
+		loadLog << "# of materials : " << materials.size() << std::endl;
 
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
 
-			std::vector<gps::Vertex> vertices;
-			std::vector<GLuint> indices;
-			std::vector<gps::Texture> textures;
+			meshData.push_back(gps::MeshData());
+			std::vector<gps::Vertex>& vertices = meshData.back().vertices;
+			std::vector<GLuint>& indices = meshData.back().indices;
+			std::vector<gps::Texture>& textures = meshData.back().textures;
+
+			// one vertex and one index per face corner
+			vertices.reserve(shapes[s].mesh.indices.size());
+			indices.reserve(shapes[s].mesh.indices.size());
 
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
@@ -59,9 +426,6 @@ namespace gps {
 
 				int fv = shapes[s].mesh.num_face_vertices[f];
 
-				//gps::Texture currentTexture = LoadTexture("index1.png", "ambientTexture");
-				//textures.push_back(currentTexture);
-
 				// Loop over vertices in the face.
 				for (size_t v = 0; v < fv; v++) {
 
@@ -100,6 +464,11 @@ namespace gps {
 				index_offset += fv;
 			}
 
+			// one vertex was emitted per face corner, merge the duplicates into a real index buffer
+			gps::WeldStats weldStats = gps::WeldVertices(meshData.back());
+			loadLog << "Shape " << s << " welded  : " << weldStats.inputVertices << " -> " << weldStats.outputVertices
+				<< " vertices, " << indices.size() << " indices" << std::endl;
+
 			// get material id
 			// Only try to read materials if the .mtl file is present
 			size_t a = shapes[s].mesh.material_ids.size();
@@ -109,18 +478,18 @@ namespace gps {
 				materialId = shapes[s].mesh.material_ids[0];
 				if (materialId != -1) {
 
-					gps::Material currentMaterial;
-					currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
-					currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
-					currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
+					// textures are only referenced here, ReadOBJ loads them once the
+					// geometry is available (parsed or cached)
+					gps::Texture currentTexture;
+					currentTexture.id = 0;
 
 					//ambient texture
 					std::string ambientTexturePath = materials[materialId].ambient_texname;
 
 					if (!ambientTexturePath.empty()) {
 
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + ambientTexturePath, "ambientTexture");
+						currentTexture.type = "ambientTexture";
+						currentTexture.path = basePath + ambientTexturePath;
 						textures.push_back(currentTexture);
 					}
 
@@ -129,8 +498,8 @@ namespace gps {
 
 					if (!diffuseTexturePath.empty()) {
 
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + diffuseTexturePath, "diffuseTexture");
+						currentTexture.type = "diffuseTexture";
+						currentTexture.path = basePath + diffuseTexturePath;
 						textures.push_back(currentTexture);
 					}
 
@@ -139,15 +508,64 @@ namespace gps {
 
 					if (!specularTexturePath.empty()) {
 
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + specularTexturePath, "specularTexture");
+						currentTexture.type = "specularTexture";
+						currentTexture.path = basePath + specularTexturePath;
 						textures.push_back(currentTexture);
 					}
 				}
 			}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+			// chunks small enough for 16 bit indices, each one simplified and optimized on its own
+			size_t firstChunk = meshData.size() - 1;
+			if (splitMeshes && meshData.back().vertices.size() > gps::GeometryArena::SHORT_INDEX_VERTICES) {
+
+				std::vector<gps::MeshData> chunks;
+				gps::SplitMesh(meshData.back(), gps::GeometryArena::SHORT_INDEX_VERTICES, chunks);
+				loadLog << "Shape " << s << " split   : " << meshData.back().vertices.size() << " vertices -> "
+					<< chunks.size() << " chunks" << std::endl;
+
+				meshData.pop_back();
+				for (size_t c = 0; c < chunks.size(); c++) {
+					meshData.push_back(gps::MeshData());
+					std::swap(meshData.back(), chunks[c]);
+				}
+			}
+
+			for (size_t c = firstChunk; c < meshData.size(); c++) {
+
+				gps::MeshData& mesh = meshData[c];
+				std::ostringstream name;
+				name << "Shape " << s;
+				if (meshData.size() - firstChunk > 1) {
+					name << "." << c - firstChunk;
+				}
+
+				// coarser index buffers over the welded vertices, optimized with the full one below
+				if (lodMaxError > 0.0f) {
+
+					gps::BuildMeshLods(mesh, lodMaxError);
+					loadLog << name.str() << " LODs    : " << mesh.indices.size() / 3;
+					for (size_t l = 0; l < mesh.lods.size(); l++) {
+						loadLog << " -> " << mesh.lods[l].indices.size() / 3 << " (" << mesh.lods[l].error << ")";
+					}
+					loadLog << " triangles (error)" << std::endl;
+				}
+
+				if (optimizeFlags != gps::MESH_OPTIMIZE_NONE) {
+
+					gps::VertexCacheStats before = gps::AnalyzeVertexCache(mesh);
+					gps::OptimizeMesh(mesh, optimizeFlags);
+					gps::VertexCacheStats after = gps::AnalyzeVertexCache(mesh);
+
+					loadLog << name.str() << " ACMR    : " << before.acmr << " -> " << after.acmr
+						<< ", ATVR : " << before.atvr << " -> " << after.atvr << std::endl;
+				}
+
+				// only the simplifier needed it
+				std::vector<unsigned char>().swap(mesh.splitBorder);
+			}
 		}
+		return true;
 	}
 
 	// Retrieves a texture associated with the object - by its name and type
@@ -163,7 +581,25 @@ namespace gps {
 			}
 
 			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
+			currentTexture.id = 0;
+
+			const gps::CookedTexture* cooked = NULL;
+			for (size_t i = 0; i < pendingImages.size(); i++) {
+
+				if (pendingImages[i].path == path) {
+
+					//cooked by PrepareModel
+					cooked = &pendingImages[i];
+					break;
+				}
+			}
+
+			//shared with another model, by path or by identical content
+			currentTexture.id = gps::TextureRegistry::Get().Acquire(path, cooked != NULL ? cooked->contentHash : 0);
+
+			if (currentTexture.id == 0) {
+				currentTexture.id = cooked != NULL ? UploadTexture(*cooked) : ReadTextureFromFile(path.c_str());
+			}
 			currentTexture.type = std::string(type);
 			currentTexture.path = path;
 
@@ -172,85 +608,89 @@ namespace gps {
 			return currentTexture;
 		}
 
-	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
-
-		int x, y, n;
-		int force_channels = 4;
-		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
+	// Drops the registry claims of the images cooked by PrepareModel, the uploaded ones are already resident
+	void Model3D::EndCooking() {
 
-		if (!image_data) {
-			fprintf(stderr, "ERROR: could not load %s\n", file_name);
-			return false;
-		}
-		// NPOT check
-		if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
-			fprintf(
-				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name
-			);
+		for (size_t i = 0; i < pendingImages.size(); i++) {
+			gps::TextureRegistry::Get().EndCooking(pendingImages[i].path);
 		}
+	}
 
-		int width_in_bytes = x * 4;
-		unsigned char *top = NULL;
-		unsigned char *bottom = NULL;
-		unsigned char temp = 0;
-		int half_height = y / 2;
-
-		for (int row = 0; row < half_height; row++) {
+	// Reads the pixel data from an image file (or its texture cache) and loads it into the video memory
+	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
 
-			top = image_data + row * width_in_bytes;
-			bottom = image_data + (y - row - 1) * width_in_bytes;
+		gps::CookedTexture image;
+		if (!gps::CookTexture(file_name, gps::IsTextureCompressionSupported(), image)) {
+			return 0;
+		}
 
-			for (int col = 0; col < width_in_bytes; col++) {
+		return UploadTexture(image);
+	}
 
-				temp = *top;
-				*top = *bottom;
-				*bottom = temp;
-				top++;
-				bottom++;
-			}
-		}
+	// Loads the cooked mip chain into the video memory and registers it for the other models
+	GLuint Model3D::UploadTexture(const gps::CookedTexture& image) {
 
 		GLuint textureID;
 		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_SRGB, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
-			0,
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			image_data
-		);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		gps::GLState::Get().BindTexture(0, textureID);
+
+		for (size_t level = 0; level < image.levels.size(); level++) {
+
+			const gps::TextureLevel& mip = image.levels[level];
+			if (image.IsCompressed()) {
+
+				glCompressedTexImage2D(
+					GL_TEXTURE_2D,
+					(GLint)level,
+					image.internalFormat,
+					mip.width,
+					mip.height,
+					0,
+					(GLsizei)mip.size,
+					&image.data[mip.offset]
+				);
+			}
+			else {
+
+				glTexImage2D(
+					GL_TEXTURE_2D,
+					(GLint)level,
+					image.internalFormat,
+					mip.width,
+					mip.height,
+					0,
+					GL_RGBA,
+					GL_UNSIGNED_BYTE,
+					&image.data[mip.offset]
+				);
+			}
+		}
+		// the mip chain comes precomputed from the cooker
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
 
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
+
+		gps::TextureRegistry::Get().Add(image.path, image.contentHash, textureID, image.data.size());
 
 		return textureID;
 	}
 
 	Model3D::~Model3D() {
 
+		// prepared but never uploaded
+		EndCooking();
+
         for (size_t i = 0; i < loadedTextures.size(); i++) {
 
-            glDeleteTextures(1, &loadedTextures.at(i).id);
+            gps::TextureRegistry::Get().Release(loadedTextures.at(i).id);
         }
 
         for (size_t i = 0; i < meshes.size(); i++) {
 
-            GLuint VBO = meshes.at(i).getBuffers().VBO;
-            GLuint EBO = meshes.at(i).getBuffers().EBO;
-            GLuint VAO = meshes.at(i).getBuffers().VAO;
-            glDeleteBuffers(1, &VBO);
-            glDeleteBuffers(1, &EBO);
-            glDeleteVertexArrays(1, &VAO);
+            gps::GeometryArena::Get().Free(meshes.at(i).getGeometry());
         }
 	}
 }
@@ -2,16 +2,27 @@
 #define Model3D_hpp
 
 #include "Mesh.hpp"
+#include "MeshOptimizer.hpp"
+#include "TextureCooker.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
 
+#include <cfloat>
+#include <cstdint>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
 
 namespace gps {
 
+    // Levels of detail one placement of a model drew last frame, one per mesh. Kept by the
+    // caller and passed to every Submit of that placement, so levels change with hysteresis.
+    struct LodState {
+        std::vector<uint8_t> levels;
+    };
+
     class Model3D {
 
     public:
@@ -21,22 +32,111 @@ namespace gps {
 
 		void LoadModel(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram);
+		// CPU part of LoadModel - reads the geometry and decodes the textures,
+		// does not touch OpenGL so it can run on a worker thread. Returns false if
+		// the .obj file could not be read, PrintLoadLog then tells why.
+		// parseThreads limits the threads parsing the .obj file, 0 uses one per hardware thread.
+		bool PrepareModel(std::string fileName, std::string basePath, unsigned int parseThreads = 0);
+
+		// GL part of LoadModel - uploads what PrepareModel produced,
+		// must run on the thread that owns the OpenGL context
+		void UploadModel();
+
+		// Prints and clears the messages of PrepareModel (UploadModel does it on success)
+		void PrintLoadLog(std::ostream& out);
+
+		// Selects the MeshOptimizeFlags passes run on the meshes, must be called before LoadModel
+		void SetOptimizeFlags(unsigned int flags);
+
+		// Largest error of the generated levels of detail in world units, for a model placed with
+		// a uniform scale of placementScale. 0 generates none. Must be called before LoadModel.
+		void SetLodMaxError(float worldError, float placementScale = 1.0f);
+
+		// Stores the vertices of the meshes in this format (see PackedVertex), must be called before
+		// UploadModel. Packed meshes need programs that take the position decode through the model
+		// matrix, which every program drawing through the RenderQueue does except the sky's.
+		void SetVertexFormat(gps::VertexFormat format);
+
+		// Splits the shapes with more vertices than 16 bit indices address into chunks that
+		// fit (see SplitMesh), so every mesh of the model draws with 16 bit indices. Must be
+		// called before LoadModel.
+		void SetSplitMeshes(bool split);
+
+		// Keeps the full detail vertices and indices of the meshes in Mesh::vertices / indices
+		// after the upload, for collision or triangle picking. Off by default: the GPU has the
+		// only copy. Must be called before UploadModel.
+		void SetRetainCpuData(bool retain);
+
+		// Off parses the .obj file even when the mesh cache is valid, and does not rewrite
+		// the cache. Must be called before LoadModel.
+		void SetUseMeshCache(bool use);
+
+		void Draw(const gps::Shader& shaderProgram);
+
+		// Adds the draws of all meshes to the queue, placed by the model matrix. Meshes
+		// outside the queue's frustum are skipped (the whole model when its bounds are).
+		// Each mesh is drawn at the coarsest level of detail within the queue's LOD threshold,
+		// lodState keeps the levels of this placement between frames (see LodState).
+		void Submit(gps::RenderQueue& queue, gps::RenderLayer layer, const gps::Shader& shaderProgram, const glm::mat4& model,
+		            gps::LodState* lodState = NULL);
+
+		// Adds one instanced draw per mesh placing a copy at each model matrix. With a
+		// program that reads the per-draw data (see RenderQueue) every mesh is a single
+		// draw call, whatever the number of copies. Copies outside the frustum are skipped,
+		// the level of detail of each mesh is the one of the nearest copy.
+		void SubmitInstances(gps::RenderQueue& queue, gps::RenderLayer layer, const gps::Shader& shaderProgram,
+		                     const std::vector<glm::mat4>& models);
+
+		// Model space volumes holding all meshes
+		const gps::Bounds& GetBounds() const;
+
+		size_t GetMeshCount() const;
 
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
 		// Associated textures
         std::vector<gps::Texture> loadedTextures;
+		// Model space volumes holding all meshes
+		gps::Bounds bounds = gps::Bounds();
+		// Matrices of the copies that passed culling, kept to reuse the storage every frame
+		std::vector<glm::mat4> visibleModels;
+		// Load-time mesh optimization passes
+		unsigned int optimizeFlags = gps::MESH_OPTIMIZE_ALL;
+		// Largest error of the levels of detail, model space
+		float lodMaxError = FLT_MAX;
+		gps::VertexFormat vertexFormat = gps::VERTEX_FORMAT_FULL;
+		bool splitMeshes = false;
+		bool retainCpuData = false;
+		bool useMeshCache = true;
 
-		// Does the parsing of the .obj file and fills in the data structure
-		void ReadOBJ(std::string fileName, std::string basePath);
+		// Geometry and images produced by PrepareModel, released by UploadModel
+		std::vector<gps::MeshData> pendingMeshes;
+		std::vector<gps::CookedTexture> pendingImages;
+		// Messages of PrepareModel, printed by UploadModel so models prepared in parallel do not interleave
+		std::ostringstream loadLog;
+
+		// Level of detail of a mesh distance away from the camera, for a placement scaling it by scale
+		size_t SelectLod(const gps::Mesh& mesh, const gps::RenderQueue& queue, float distance, float scale, size_t previous) const;
+
+		// Loads the geometry from the mesh cache or the .obj file
+		bool ReadOBJ(std::string fileName, std::string basePath, std::vector<gps::MeshData>& meshData, unsigned int parseThreads);
+
+		// Does the parsing of the .obj file, also returns the files it was built from
+		bool ParseOBJ(std::string fileName, std::string basePath, std::vector<gps::MeshData>& meshData, std::vector<std::string>& sourceFiles,
+		              unsigned int parseThreads);
 
 		// Retrieves a texture associated with the object - by its name and type
 		gps::Texture LoadTexture(std::string path, std::string type);
 
 		// Reads the pixel data from an image file and loads it into the video memory
 		GLuint ReadTextureFromFile(const char* file_name);
+
+		// Loads a cooked texture into the video memory and adds it to the TextureRegistry
+		GLuint UploadTexture(const gps::CookedTexture& image);
+
+		// Ends the TextureRegistry claims taken for pendingImages
+		void EndCooking();
     };
 }
 
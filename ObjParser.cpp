@@ -0,0 +1,709 @@
+#include "ObjParser.hpp"
+#include "AllocationCounter.hpp"
+#include "LinearArena.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <utility>
+
+namespace gps {
+
+    namespace {
+
+        // files smaller than this are not worth splitting
+        const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+        // marks a texcoord/normal index missing from a face corner
+        const int ABSENT_INDEX = INT_MIN;
+
+        // first block of a chunk's arena, about what the faces of a MIN_CHUNK_SIZE chunk take
+        const size_t CHUNK_ARENA_BLOCK_SIZE = 1 << 20;
+
+        // Face corner with the indices as written in the file (not yet made zero-based)
+        struct RawCorner {
+            int v;
+            int vt;
+            int vn;
+        };
+
+        // Face line, with the number of v/vn/vt lines seen so far in its chunk,
+        // needed to resolve relative (negative) indices once the chunk offsets are known
+        struct RawFace {
+            size_t firstCorner;
+            size_t cornerCount;
+            int vCount;
+            int vnCount;
+            int vtCount;
+        };
+
+        enum CommandType {
+            COMMAND_FACES,
+            COMMAND_USEMTL,
+            COMMAND_MTLLIB,
+            COMMAND_GROUP,
+            COMMAND_OBJECT,
+            COMMAND_TAG
+        };
+
+        // Lines that change the shape/material state are replayed in file order during the
+        // merge. COMMAND_FACES covers a run of consecutive faces, the others a stored line.
+        struct Command {
+            CommandType type;
+            size_t first;
+            size_t count;
+        };
+
+        // The faces and commands are read until the merge ends, so they live in the chunk's
+        // own arena (the parsing threads are gone by then) and go away with the chunk
+        struct Chunk {
+            Chunk()
+                : begin(NULL), end(NULL), arena(CHUNK_ARENA_BLOCK_SIZE),
+                  corners(arena), faces(arena), commands(arena) {}
+
+            const char* begin;
+            const char* end;
+
+            LinearArena arena;
+
+            std::vector<float> v;
+            std::vector<float> vn;
+            std::vector<float> vt;
+            ArenaVector<RawCorner> corners;
+            ArenaVector<RawFace> faces;
+            ArenaVector<Command> commands;
+            std::vector<std::string> lines;
+        };
+
+        struct FaceRef {
+            const Chunk* chunk;
+            size_t face;
+            int vBase;
+            int vnBase;
+            int vtBase;
+        };
+
+#define OBJ_IS_SPACE(x) (((x) == ' ') || ((x) == '\t'))
+#define OBJ_IS_DIGIT(x) \
+(static_cast<unsigned int>((x) - '0') < static_cast<unsigned int>(10))
+#define OBJ_IS_NEW_LINE(x) (((x) == '\r') || ((x) == '\n') || ((x) == '\0'))
+
+        // The number parsing below mirrors tiny_obj_loader.h (MIT, Syoyo Fujita and
+        // contributors) so both loaders produce bit-identical floats and indices.
+
+        inline int FixIndex(int idx, int n) {
+            if (idx > 0) return idx - 1;
+            if (idx == 0) return 0;
+            return n + idx;  // negative value = relative
+        }
+
+        bool TryParseDouble(const char* s, const char* s_end, double* result) {
+            if (s >= s_end) {
+                return false;
+            }
+
+            double mantissa = 0.0;
+            int exponent = 0;
+            char sign = '+';
+            char exp_sign = '+';
+            char const* curr = s;
+            int read = 0;
+            bool end_not_reached = false;
+
+            if (*curr == '+' || *curr == '-') {
+                sign = *curr;
+                curr++;
+            } else if (OBJ_IS_DIGIT(*curr)) { /* Pass through. */
+            } else {
+                goto fail;
+            }
+
+            end_not_reached = (curr != s_end);
+            while (end_not_reached && OBJ_IS_DIGIT(*curr)) {
+                mantissa *= 10;
+                mantissa += static_cast<int>(*curr - 0x30);
+                curr++;
+                read++;
+                end_not_reached = (curr != s_end);
+            }
+
+            if (read == 0) goto fail;
+            if (!end_not_reached) goto assemble;
+
+            if (*curr == '.') {
+                curr++;
+                read = 1;
+                end_not_reached = (curr != s_end);
+                while (end_not_reached && OBJ_IS_DIGIT(*curr)) {
+                    static const double pow_lut[] = {
+                        1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001,
+                    };
+                    const int lut_entries = sizeof pow_lut / sizeof pow_lut[0];
+
+                    mantissa += static_cast<int>(*curr - 0x30) *
+                    (read < lut_entries ? pow_lut[read] : pow(10.0, -read));
+                    read++;
+                    curr++;
+                    end_not_reached = (curr != s_end);
+                }
+            } else if (*curr == 'e' || *curr == 'E') {
+            } else {
+                goto assemble;
+            }
+
+            if (!end_not_reached) goto assemble;
+
+            if (*curr == 'e' || *curr == 'E') {
+                curr++;
+                end_not_reached = (curr != s_end);
+                if (end_not_reached && (*curr == '+' || *curr == '-')) {
+                    exp_sign = *curr;
+                    curr++;
+                } else if (OBJ_IS_DIGIT(*curr)) { /* Pass through. */
+                } else {
+                    goto fail;
+                }
+
+                read = 0;
+                end_not_reached = (curr != s_end);
+                while (end_not_reached && OBJ_IS_DIGIT(*curr)) {
+                    exponent *= 10;
+                    exponent += static_cast<int>(*curr - 0x30);
+                    curr++;
+                    read++;
+                    end_not_reached = (curr != s_end);
+                }
+                exponent *= (exp_sign == '+' ? 1 : -1);
+                if (read == 0) goto fail;
+            }
+
+        assemble:
+            *result = (sign == '+' ? 1 : -1) *
+            (exponent ? ldexp(mantissa * pow(5.0, exponent), exponent) : mantissa);
+            return true;
+        fail:
+            return false;
+        }
+
+        inline float ParseFloat(const char** token, double default_value = 0.0) {
+            (*token) += strspn((*token), " \t");
+            const char* end = (*token) + strcspn((*token), " \t\r");
+            double val = default_value;
+            TryParseDouble((*token), end, &val);
+            float f = static_cast<float>(val);
+            (*token) = end;
+            return f;
+        }
+
+        inline std::string ParseString(const char** token) {
+            (*token) += strspn((*token), " \t");
+            size_t e = strcspn((*token), " \t\r");
+            std::string s((*token), &(*token)[e]);
+            (*token) += e;
+            return s;
+        }
+
+        // Same as tinyobj's parseTriple, without resolving the indices
+        RawCorner ParseRawCorner(const char** token) {
+            RawCorner corner;
+            corner.vt = ABSENT_INDEX;
+            corner.vn = ABSENT_INDEX;
+
+            corner.v = atoi((*token));
+            (*token) += strcspn((*token), "/ \t\r");
+            if ((*token)[0] != '/') {
+                return corner;
+            }
+            (*token)++;
+
+            // i//k
+            if ((*token)[0] == '/') {
+                (*token)++;
+                corner.vn = atoi((*token));
+                (*token) += strcspn((*token), "/ \t\r");
+                return corner;
+            }
+
+            // i/j/k or i/j
+            corner.vt = atoi((*token));
+            (*token) += strcspn((*token), "/ \t\r");
+            if ((*token)[0] != '/') {
+                return corner;
+            }
+
+            // i/j/k
+            (*token)++;  // skip '/'
+            corner.vn = atoi((*token));
+            (*token) += strcspn((*token), "/ \t\r");
+            return corner;
+        }
+
+        // First whitespace separated word, like sscanf("%s")
+        std::string ParseName(const char* token) {
+            while (*token != '\0' && isspace((unsigned char)*token)) {
+                token++;
+            }
+            const char* end = token;
+            while (*end != '\0' && !isspace((unsigned char)*end)) {
+                end++;
+            }
+            return std::string(token, end);
+        }
+
+        void AddCommand(Chunk& chunk, CommandType type, const char* token) {
+            Command command;
+            command.type = type;
+            command.first = chunk.lines.size();
+            command.count = 1;
+            chunk.commands.push_back(command);
+            chunk.lines.push_back(token);
+        }
+
+        // Parses the attribute and face lines of one chunk, records the other lines
+        void ParseChunk(Chunk& chunk) {
+            std::string linebuf;
+            const char* p = chunk.begin;
+
+            while (p < chunk.end) {
+                // lines end in \n, \r\n or \r, like tinyobj's safeGetline
+                const char* lineEnd = p;
+                while (lineEnd < chunk.end && *lineEnd != '\n' && *lineEnd != '\r') {
+                    lineEnd++;
+                }
+                linebuf.assign(p, lineEnd);
+
+                p = lineEnd;
+                if (p < chunk.end) {
+                    p += (*p == '\r' && p + 1 < chunk.end && p[1] == '\n') ? 2 : 1;
+                }
+
+                if (linebuf.empty()) {
+                    continue;
+                }
+
+                // Skip leading space.
+                const char* token = linebuf.c_str();
+                token += strspn(token, " \t");
+
+                if (token[0] == '\0') continue;  // empty line
+
+                if (token[0] == '#') continue;  // comment line
+
+                // vertex
+                if (token[0] == 'v' && OBJ_IS_SPACE((token[1]))) {
+                    token += 2;
+                    float x = ParseFloat(&token);
+                    float y = ParseFloat(&token);
+                    float z = ParseFloat(&token);
+                    chunk.v.push_back(x);
+                    chunk.v.push_back(y);
+                    chunk.v.push_back(z);
+                    continue;
+                }
+
+                // normal
+                if (token[0] == 'v' && token[1] == 'n' && OBJ_IS_SPACE((token[2]))) {
+                    token += 3;
+                    float x = ParseFloat(&token);
+                    float y = ParseFloat(&token);
+                    float z = ParseFloat(&token);
+                    chunk.vn.push_back(x);
+                    chunk.vn.push_back(y);
+                    chunk.vn.push_back(z);
+                    continue;
+                }
+
+                // texcoord
+                if (token[0] == 'v' && token[1] == 't' && OBJ_IS_SPACE((token[2]))) {
+                    token += 3;
+                    float x = ParseFloat(&token);
+                    float y = ParseFloat(&token);
+                    chunk.vt.push_back(x);
+                    chunk.vt.push_back(y);
+                    continue;
+                }
+
+                // face
+                if (token[0] == 'f' && OBJ_IS_SPACE((token[1]))) {
+                    token += 2;
+                    token += strspn(token, " \t");
+
+                    RawFace face;
+                    face.firstCorner = chunk.corners.size();
+                    face.vCount = static_cast<int>(chunk.v.size() / 3);
+                    face.vnCount = static_cast<int>(chunk.vn.size() / 3);
+                    face.vtCount = static_cast<int>(chunk.vt.size() / 2);
+
+                    while (!OBJ_IS_NEW_LINE(token[0])) {
+                        chunk.corners.push_back(ParseRawCorner(&token));
+                        token += strspn(token, " \t\r");
+                    }
+                    face.cornerCount = chunk.corners.size() - face.firstCorner;
+
+                    if (!chunk.commands.empty() && chunk.commands.back().type == COMMAND_FACES) {
+                        chunk.commands.back().count++;
+                    }
+                    else {
+                        Command command;
+                        command.type = COMMAND_FACES;
+                        command.first = chunk.faces.size();
+                        command.count = 1;
+                        chunk.commands.push_back(command);
+                    }
+                    chunk.faces.push_back(face);
+                    continue;
+                }
+
+                if ((0 == strncmp(token, "usemtl", 6)) && OBJ_IS_SPACE((token[6]))) {
+                    AddCommand(chunk, COMMAND_USEMTL, token);
+                    continue;
+                }
+
+                if ((0 == strncmp(token, "mtllib", 6)) && OBJ_IS_SPACE((token[6]))) {
+                    AddCommand(chunk, COMMAND_MTLLIB, token);
+                    continue;
+                }
+
+                if (token[0] == 'g' && OBJ_IS_SPACE((token[1]))) {
+                    AddCommand(chunk, COMMAND_GROUP, token);
+                    continue;
+                }
+
+                if (token[0] == 'o' && OBJ_IS_SPACE((token[1]))) {
+                    AddCommand(chunk, COMMAND_OBJECT, token);
+                    continue;
+                }
+
+                if (token[0] == 't' && OBJ_IS_SPACE(token[1])) {
+                    AddCommand(chunk, COMMAND_TAG, token);
+                    continue;
+                }
+
+                // Ignore unknown command.
+            }
+        }
+
+        // Same as tinyobj's exportFaceGroupToShape, with triangulation
+        bool ExportFaceGroupToShape(tinyobj::shape_t* shape, const std::vector<FaceRef>& faceGroup,
+                                    const std::vector<tinyobj::tag_t>& tags, int material_id,
+                                    const std::string& name) {
+            if (faceGroup.empty()) {
+                return false;
+            }
+
+            // sized once per group, a material change adds its faces to the same shape
+            size_t triangleCount = 0;
+            for (size_t i = 0; i < faceGroup.size(); i++) {
+                const RawFace& face = faceGroup[i].chunk->faces[faceGroup[i].face];
+                triangleCount += face.cornerCount > 2 ? face.cornerCount - 2 : 0;
+            }
+            shape->mesh.indices.reserve(shape->mesh.indices.size() + triangleCount * 3);
+            shape->mesh.num_face_vertices.reserve(shape->mesh.num_face_vertices.size() + triangleCount);
+            shape->mesh.material_ids.reserve(shape->mesh.material_ids.size() + triangleCount);
+
+            for (size_t i = 0; i < faceGroup.size(); i++) {
+                const FaceRef& ref = faceGroup[i];
+                const RawFace& face = ref.chunk->faces[ref.face];
+                const RawCorner* corners = &ref.chunk->corners[face.firstCorner];
+
+                int vSize = ref.vBase + face.vCount;
+                int vnSize = ref.vnBase + face.vnCount;
+                int vtSize = ref.vtBase + face.vtCount;
+
+                tinyobj::index_t fan[3];
+                for (size_t k = 0; k < face.cornerCount; k++) {
+                    const RawCorner& corner = corners[k];
+
+                    tinyobj::index_t idx;
+                    idx.vertex_index = FixIndex(corner.v, vSize);
+                    idx.normal_index = corner.vn == ABSENT_INDEX ? -1 : FixIndex(corner.vn, vnSize);
+                    idx.texcoord_index = corner.vt == ABSENT_INDEX ? -1 : FixIndex(corner.vt, vtSize);
+
+                    // Polygon -> triangle fan conversion
+                    if (k < 2) {
+                        fan[k == 0 ? 0 : 2] = idx;
+                        continue;
+                    }
+                    fan[1] = fan[2];
+                    fan[2] = idx;
+
+                    shape->mesh.indices.push_back(fan[0]);
+                    shape->mesh.indices.push_back(fan[1]);
+                    shape->mesh.indices.push_back(fan[2]);
+
+                    shape->mesh.num_face_vertices.push_back(3);
+                    shape->mesh.material_ids.push_back(material_id);
+                }
+            }
+
+            shape->name = name;
+            shape->mesh.tags = tags;
+
+            return true;
+        }
+
+        // Same as tinyobj's parseTagTriple
+        void ParseTagSizes(const char** token, int* num_ints, int* num_floats, int* num_strings) {
+            *num_ints = 0;
+            *num_floats = 0;
+            *num_strings = 0;
+
+            *num_ints = atoi((*token));
+            (*token) += strcspn((*token), "/ \t\r");
+            if ((*token)[0] != '/') {
+                return;
+            }
+            (*token)++;
+
+            *num_floats = atoi((*token));
+            (*token) += strcspn((*token), "/ \t\r");
+            if ((*token)[0] != '/') {
+                return;
+            }
+            (*token)++;
+
+            *num_strings = atoi((*token));
+            (*token) += strcspn((*token), "/ \t\r") + 1;
+        }
+
+        tinyobj::tag_t ParseTag(const char* token) {
+            tinyobj::tag_t tag;
+
+            token += 2;
+            tag.name = ParseName(token);
+            token += tag.name.size() + 1;
+
+            int num_ints, num_floats, num_strings;
+            ParseTagSizes(&token, &num_ints, &num_floats, &num_strings);
+
+            tag.intValues.resize(static_cast<size_t>(num_ints));
+            for (size_t i = 0; i < static_cast<size_t>(num_ints); ++i) {
+                tag.intValues[i] = atoi(token);
+                token += strcspn(token, "/ \t\r") + 1;
+            }
+
+            tag.floatValues.resize(static_cast<size_t>(num_floats));
+            for (size_t i = 0; i < static_cast<size_t>(num_floats); ++i) {
+                tag.floatValues[i] = ParseFloat(&token);
+                token += strcspn(token, "/ \t\r") + 1;
+            }
+
+            tag.stringValues.resize(static_cast<size_t>(num_strings));
+            for (size_t i = 0; i < static_cast<size_t>(num_strings); ++i) {
+                tag.stringValues[i] = ParseName(token);
+                token += tag.stringValues[i].size() + 1;
+            }
+
+            return tag;
+        }
+    }
+
+    bool LoadObjParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                         std::vector<tinyobj::material_t>* materials, std::string* err,
+                         const std::string& fileName, tinyobj::MaterialReader* readMatFn,
+                         unsigned int threadCount) {
+
+        attrib->vertices.clear();
+        attrib->normals.clear();
+        attrib->texcoords.clear();
+        shapes->clear();
+
+        MappedFile file;
+        if (!file.Open(fileName)) {
+            if (err) {
+                (*err) = "Cannot open file [" + fileName + "]\n";
+            }
+            return false;
+        }
+
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        // a few chunks per thread, so one slow chunk does not hold the others back
+        size_t chunkCount = std::min((size_t)threadCount * 4, file.Size() / MIN_CHUNK_SIZE);
+        chunkCount = std::max(chunkCount, (size_t)1);
+
+        // split after a '\n', so no line (and no "\r\n") spans two chunks
+        std::vector<Chunk> chunks(chunkCount);
+        const char* fileBegin = file.Data();
+        const char* fileEnd = file.Data() + file.Size();
+        const char* chunkBegin = fileBegin;
+
+        for (size_t c = 0; c < chunkCount; c++) {
+
+            const char* chunkEnd = fileEnd;
+            if (c + 1 < chunkCount) {
+
+                chunkEnd = std::max(chunkBegin, fileBegin + file.Size() / chunkCount * (c + 1));
+                const char* newLine = (const char*)memchr(chunkEnd, '\n', fileEnd - chunkEnd);
+                chunkEnd = newLine ? newLine + 1 : fileEnd;
+            }
+
+            chunks[c].begin = chunkBegin;
+            chunks[c].end = chunkEnd;
+            chunkBegin = chunkEnd;
+        }
+
+        std::atomic<size_t> nextChunk(0);
+        // heap allocations of the workers, counted as the caller's (see AllocationCounter.hpp)
+        std::atomic<uint64_t> workerAllocations(0);
+        std::vector<std::thread> workers;
+        unsigned int workerCount = (unsigned int)std::min((size_t)threadCount, chunkCount);
+
+        for (unsigned int t = 1; t < workerCount; t++) {
+
+            workers.push_back(std::thread([&]() {
+                uint64_t allocations = GetThreadHeapAllocations();
+                for (size_t c = nextChunk++; c < chunkCount; c = nextChunk++) {
+                    ParseChunk(chunks[c]);
+                }
+                workerAllocations += GetThreadHeapAllocations() - allocations;
+            }));
+        }
+        for (size_t c = nextChunk++; c < chunkCount; c = nextChunk++) {
+            ParseChunk(chunks[c]);
+        }
+        for (size_t t = 0; t < workers.size(); t++) {
+            workers[t].join();
+        }
+        AddThreadHeapAllocations(workerAllocations);
+
+        // merge the attributes
+        size_t vTotal = 0, vnTotal = 0, vtTotal = 0;
+        for (size_t c = 0; c < chunkCount; c++) {
+            vTotal += chunks[c].v.size();
+            vnTotal += chunks[c].vn.size();
+            vtTotal += chunks[c].vt.size();
+        }
+
+        std::vector<float> v, vn, vt;
+        v.reserve(vTotal);
+        vn.reserve(vnTotal);
+        vt.reserve(vtTotal);
+
+        // replay the shape/material lines in order, like tinyobj::LoadObj does while reading
+        std::vector<tinyobj::tag_t> tags;
+        std::vector<FaceRef> faceGroup;
+        std::string name;
+
+        std::map<std::string, int> material_map;
+        int material = -1;
+
+        tinyobj::shape_t shape;
+
+        for (size_t c = 0; c < chunkCount; c++) {
+
+            Chunk& chunk = chunks[c];
+            int vBase = static_cast<int>(v.size() / 3);
+            int vnBase = static_cast<int>(vn.size() / 3);
+            int vtBase = static_cast<int>(vt.size() / 2);
+
+            v.insert(v.end(), chunk.v.begin(), chunk.v.end());
+            vn.insert(vn.end(), chunk.vn.begin(), chunk.vn.end());
+            vt.insert(vt.end(), chunk.vt.begin(), chunk.vt.end());
+            std::vector<float>().swap(chunk.v);
+            std::vector<float>().swap(chunk.vn);
+            std::vector<float>().swap(chunk.vt);
+
+            for (size_t i = 0; i < chunk.commands.size(); i++) {
+
+                const Command& command = chunk.commands[i];
+
+                if (command.type == COMMAND_FACES) {
+
+                    for (size_t f = command.first; f < command.first + command.count; f++) {
+                        FaceRef ref = { &chunk, f, vBase, vnBase, vtBase };
+                        faceGroup.push_back(ref);
+                    }
+                    continue;
+                }
+
+                const char* token = chunk.lines[command.first].c_str();
+
+                if (command.type == COMMAND_USEMTL) {
+
+                    std::string materialName = ParseName(token + 7);
+
+                    int newMaterialId = -1;
+                    std::map<std::string, int>::const_iterator found = material_map.find(materialName);
+                    if (found != material_map.end()) {
+                        newMaterialId = found->second;
+                    }
+
+                    if (newMaterialId != material) {
+                        ExportFaceGroupToShape(&shape, faceGroup, tags, material, name);
+                        faceGroup.clear();
+                        material = newMaterialId;
+                    }
+                }
+                else if (command.type == COMMAND_MTLLIB) {
+
+                    if (readMatFn) {
+                        std::string err_mtl;
+                        bool ok = (*readMatFn)(ParseName(token + 7), materials, &material_map, &err_mtl);
+                        if (err) {
+                            (*err) += err_mtl;
+                        }
+
+                        if (!ok) {
+                            return false;
+                        }
+                    }
+                }
+                else if (command.type == COMMAND_GROUP) {
+
+                    // flush previous face group.
+                    if (ExportFaceGroupToShape(&shape, faceGroup, tags, material, name)) {
+                        shapes->push_back(std::move(shape));
+                    }
+
+                    shape = tinyobj::shape_t();
+                    faceGroup.clear();
+
+                    std::vector<std::string> names;
+                    while (!OBJ_IS_NEW_LINE(token[0])) {
+                        names.push_back(ParseString(&token));
+                        token += strspn(token, " \t\r");  // skip tag
+                    }
+
+                    // names[0] must be 'g', so skip the 0th element.
+                    name = names.size() > 1 ? names[1] : "";
+                }
+                else if (command.type == COMMAND_OBJECT) {
+
+                    // flush previous face group.
+                    if (ExportFaceGroupToShape(&shape, faceGroup, tags, material, name)) {
+                        shapes->push_back(std::move(shape));
+                    }
+
+                    faceGroup.clear();
+                    shape = tinyobj::shape_t();
+
+                    name = ParseName(token + 2);
+                }
+                else if (command.type == COMMAND_TAG) {
+
+                    tags.push_back(ParseTag(token));
+                }
+            }
+        }
+
+        bool ret = ExportFaceGroupToShape(&shape, faceGroup, tags, material, name);
+        if (ret || shape.mesh.indices.size()) {
+            shapes->push_back(std::move(shape));
+        }
+
+        attrib->vertices.swap(v);
+        attrib->normals.swap(vn);
+        attrib->texcoords.swap(vt);
+
+        return true;
+    }
+}
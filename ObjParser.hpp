@@ -0,0 +1,23 @@
+#ifndef ObjParser_hpp
+#define ObjParser_hpp
+
+#include "tiny_obj_loader.h"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Multithreaded replacement for tinyobj::LoadObj (with triangulation).
+    // The memory-mapped file is split into chunks on line boundaries, the v/vn/vt/f
+    // lines of every chunk are parsed concurrently, then the chunks are merged in
+    // order and the shapes are built exactly like tiny_obj_loader would, so the
+    // output is identical. Small files are parsed on the calling thread.
+    // threadCount = 0 uses one thread per hardware thread.
+    bool LoadObjParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                         std::vector<tinyobj::material_t>* materials, std::string* err,
+                         const std::string& fileName, tinyobj::MaterialReader* readMatFn,
+                         unsigned int threadCount = 0);
+}
+
+#endif /* ObjParser_hpp */
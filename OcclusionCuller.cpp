@@ -0,0 +1,199 @@
+#include "OcclusionCuller.hpp"
+
+#include "GLState.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+
+        constexpr UniformName HI_Z_UNIFORM = HashUniformName("hiZ");
+        constexpr UniformName HI_Z_LEVELS_UNIFORM = HashUniformName("hiZLevels");
+        constexpr UniformName VIEW_PROJECTION_UNIFORM = HashUniformName("viewProjection");
+    }
+
+    OcclusionCuller::OcclusionCuller()
+        : hiZTexture(0), levelCount(0), depthBuffer(0), emptyVertexArray(0), testVertexArray(0),
+          commandSourceBuffer(0), boundsBuffer(0), viewProjection(1.0f) {}
+
+    void OcclusionCuller::Create(const gps::FrameUniforms& frameUniforms) {
+
+        depthShader.loadShader("shaders/occluder.vert", "shaders/occluder.frag");
+        frameUniforms.Attach(depthShader);
+        downsampleShader.loadShader("shaders/fullscreen.vert", "shaders/hiz_downsample.frag");
+
+        std::vector<const char*> varyings;
+        varyings.push_back("command");
+        varyings.push_back("baseInstance");
+        testShader.loadTransformFeedbackShader("shaders/occlusion_test.vert", varyings);
+
+        GLState& state = GLState::Get();
+
+        // the pyramid, every level allocated so the texture is complete
+        levelCount = 1;
+        while ((WIDTH >> levelCount) > 0 || (HEIGHT >> levelCount) > 0) {
+            levelCount++;
+        }
+        glGenTextures(1, &hiZTexture);
+        state.BindTexture(HI_Z_UNIT, hiZTexture);
+        for (GLint level = 0; level < levelCount; level++) {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, std::max(1, WIDTH >> level), std::max(1, HEIGHT >> level), 0, GL_RED, GL_FLOAT, NULL);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, WIDTH, HEIGHT);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        levelFramebuffers.resize(levelCount);
+        glGenFramebuffers(levelCount, levelFramebuffers.data());
+        for (GLint level = 0; level < levelCount; level++) {
+
+            glBindFramebuffer(GL_FRAMEBUFFER, levelFramebuffers[level]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, hiZTexture, level);
+            if (level == 0) {
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+            }
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                std::cerr << "Hi-Z framebuffer " << level << " is incomplete" << std::endl;
+            }
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glGenVertexArrays(1, &emptyVertexArray);
+
+        // the test reads the commands and boxes as vertex attributes, one vertex per command
+        glGenBuffers(1, &commandSourceBuffer);
+        glGenBuffers(1, &boundsBuffer);
+        glGenVertexArrays(1, &testVertexArray);
+        state.BindVertexArray(testVertexArray);
+
+        glBindBuffer(GL_ARRAY_BUFFER, commandSourceBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribIPointer(0, 4, GL_UNSIGNED_INT, sizeof(DrawElementsIndirectCommand), (GLvoid*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(DrawElementsIndirectCommand), (GLvoid*)offsetof(DrawElementsIndirectCommand, baseInstance));
+
+        glBindBuffer(GL_ARRAY_BUFFER, boundsBuffer);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(OcclusionBounds), (GLvoid*)0);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(OcclusionBounds), (GLvoid*)offsetof(OcclusionBounds, extent));
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        state.BindVertexArray(0);
+
+        downsampleShader.setUniform(HI_Z_UNIFORM, (GLint)HI_Z_UNIT);
+        testShader.setUniform(HI_Z_UNIFORM, (GLint)HI_Z_UNIT);
+        testShader.setUniform(HI_Z_LEVELS_UNIFORM, levelCount);
+    }
+
+    void OcclusionCuller::Delete() {
+
+        if (hiZTexture == 0) {
+            return;
+        }
+
+        GLState& state = GLState::Get();
+        glDeleteTextures(1, &hiZTexture);
+        state.ForgetTexture(hiZTexture);
+        glDeleteRenderbuffers(1, &depthBuffer);
+        glDeleteFramebuffers((GLsizei)levelFramebuffers.size(), levelFramebuffers.data());
+        glDeleteVertexArrays(1, &emptyVertexArray);
+        glDeleteVertexArrays(1, &testVertexArray);
+        state.ForgetVertexArray(emptyVertexArray);
+        state.ForgetVertexArray(testVertexArray);
+        glDeleteBuffers(1, &commandSourceBuffer);
+        glDeleteBuffers(1, &boundsBuffer);
+
+        hiZTexture = depthBuffer = emptyVertexArray = testVertexArray = commandSourceBuffer = boundsBuffer = 0;
+        levelFramebuffers.clear();
+    }
+
+    const gps::Shader& OcclusionCuller::GetDepthShader() const {
+
+        return depthShader;
+    }
+
+    void OcclusionCuller::BuildHiZ(gps::RenderQueue& occluders, const glm::mat4& viewProjection) {
+
+        this->viewProjection = viewProjection;
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+        // level 0: depth of the occluders, far where there are none
+        const GLfloat farDepth = 1.0f;
+        glBindFramebuffer(GL_FRAMEBUFFER, levelFramebuffers[0]);
+        glViewport(0, 0, WIDTH, HEIGHT);
+        glClearBufferfv(GL_COLOR, 0, &farDepth);
+        glClearBufferfv(GL_DEPTH, 0, &farDepth);
+        occluders.Execute();
+
+        // each level from the one below, which is the only level the texture exposes meanwhile
+        // (sampling the level being rendered to would be a feedback loop)
+        GLState& state = GLState::Get();
+        state.SetEnabled(GL_DEPTH_TEST, false);
+        state.UseProgram(downsampleShader.shaderProgram);
+        state.BindVertexArray(emptyVertexArray);
+        state.BindTexture(HI_Z_UNIT, hiZTexture);
+        state.SelectTextureUnit(HI_Z_UNIT);
+
+        for (GLint level = 1; level < levelCount; level++) {
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, levelFramebuffers[level]);
+            glViewport(0, 0, std::max(1, WIDTH >> level), std::max(1, HEIGHT >> level));
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+        state.SetEnabled(GL_DEPTH_TEST, true);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    void OcclusionCuller::CullCommands(const std::vector<DrawElementsIndirectCommand>& commands, const std::vector<OcclusionBounds>& bounds,
+                                       GLuint commandBuffer) {
+
+        glBindBuffer(GL_ARRAY_BUFFER, commandSourceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, boundsBuffer);
+        glBufferData(GL_ARRAY_BUFFER, bounds.size() * sizeof(OcclusionBounds), bounds.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, commandBuffer);
+        glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+        if (commands.empty()) {
+            return;
+        }
+
+        GLState& state = GLState::Get();
+        testShader.setUniform(VIEW_PROJECTION_UNIFORM, viewProjection);
+        state.UseProgram(testShader.shaderProgram);
+        state.BindVertexArray(testVertexArray);
+        state.BindTexture(HI_Z_UNIT, hiZTexture);
+
+        // vertices only, nothing is rasterized
+        state.SetEnabled(GL_RASTERIZER_DISCARD, true);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, commandBuffer);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, (GLsizei)commands.size());
+        glEndTransformFeedback();
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        state.SetEnabled(GL_RASTERIZER_DISCARD, false);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef OcclusionCuller_hpp
+#define OcclusionCuller_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "FrameUniforms.hpp"
+#include "RenderQueue.hpp"
+#include "Shader.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Hierarchical Z-buffer occlusion culling of the multi-draw indirect commands.
+    //
+    // BuildHiZ draws a queue of occluders depth only into level 0 of a WIDTH x HEIGHT
+    // R32F texture and reduces it into a mip pyramid where each texel holds the farthest
+    // depth of the texels below it. CullCommands then runs one transform feedback vertex
+    // per command: it projects the command's box, picks the level where the box covers
+    // at most 2x2 texels and writes the command into the indirect buffer with no
+    // instances if the box is behind all of them. The results never come back to the CPU.
+    // GL 4.1 has no compute shaders, transform feedback does the same job.
+    class OcclusionCuller {
+
+    public:
+        // power of two, so every level is exactly half of the one below
+        static const GLsizei WIDTH = 512;
+        static const GLsizei HEIGHT = 256;
+        // unit of the pyramid, below RenderQueue::DRAW_DATA_UNIT
+        static const GLuint HI_Z_UNIT = 14;
+
+        OcclusionCuller();
+
+        // Loads the programs and creates the pyramid, needs a current context
+        void Create(const gps::FrameUniforms& frameUniforms);
+        void Delete();
+
+        // Program the occluders are submitted with, it reads view and projection from FrameData
+        const gps::Shader& GetDepthShader() const;
+
+        // Executes the occluder queue into the pyramid and reduces it. viewProjection must be the
+        // one of the frame the commands are culled for. Restores framebuffer 0 and the viewport,
+        // leaves the polygon mode at GL_FILL.
+        void BuildHiZ(gps::RenderQueue& occluders, const glm::mat4& viewProjection);
+
+        // Reallocates commandBuffer and writes the commands to it, culled against the pyramid
+        void CullCommands(const std::vector<DrawElementsIndirectCommand>& commands, const std::vector<OcclusionBounds>& bounds,
+                          GLuint commandBuffer);
+
+    private:
+        gps::Shader depthShader;
+        gps::Shader downsampleShader;
+        gps::Shader testShader;
+
+        GLuint hiZTexture;
+        GLint levelCount;
+        // one per level, level 0 also has the depth buffer of the occluder pass
+        std::vector<GLuint> levelFramebuffers;
+        GLuint depthBuffer;
+
+        // the full screen triangle has no attributes, core profile still needs a VAO
+        GLuint emptyVertexArray;
+        GLuint testVertexArray;
+        GLuint commandSourceBuffer;
+        GLuint boundsBuffer;
+
+        glm::mat4 viewProjection;
+    };
+}
+
+#endif /* OcclusionCuller_hpp */
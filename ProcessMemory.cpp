@@ -0,0 +1,80 @@
+#include "ProcessMemory.hpp"
+
+#if defined (_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #include <psapi.h>
+#elif defined (__APPLE__)
+    #include <mach/mach.h>
+    #include <sys/resource.h>
+#else
+    #include <cstdio>
+    #include <cstring>
+#endif
+
+#include <iostream>
+
+namespace gps {
+
+#if defined (_WIN32)
+    ProcessMemory GetProcessMemory() {
+
+        ProcessMemory memory = { 0, 0 };
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            memory.residentBytes = counters.WorkingSetSize;
+            memory.peakResidentBytes = counters.PeakWorkingSetSize;
+        }
+        return memory;
+    }
+#elif defined (__APPLE__)
+    ProcessMemory GetProcessMemory() {
+
+        ProcessMemory memory = { 0, 0 };
+        mach_task_basic_info_data_t info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS) {
+            memory.residentBytes = info.resident_size;
+        }
+
+        // bytes on macOS
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+            memory.peakResidentBytes = (size_t)usage.ru_maxrss;
+        }
+        return memory;
+    }
+#else
+    ProcessMemory GetProcessMemory() {
+
+        ProcessMemory memory = { 0, 0 };
+        FILE* status = fopen("/proc/self/status", "r");
+        if (status == NULL) {
+            return memory;
+        }
+
+        // "VmRSS:     1234 kB", VmHWM is the peak
+        char line[256];
+        while (fgets(line, sizeof(line), status) != NULL) {
+
+            unsigned long kilobytes;
+            if (strncmp(line, "VmRSS:", 6) == 0 && sscanf(line + 6, "%lu", &kilobytes) == 1) {
+                memory.residentBytes = (size_t)kilobytes * 1024;
+            }
+            else if (strncmp(line, "VmHWM:", 6) == 0 && sscanf(line + 6, "%lu", &kilobytes) == 1) {
+                memory.peakResidentBytes = (size_t)kilobytes * 1024;
+            }
+        }
+        fclose(status);
+        return memory;
+    }
+#endif
+
+    void PrintProcessMemory(const std::string& label) {
+
+        ProcessMemory memory = GetProcessMemory();
+        std::cout << label << " : " << memory.residentBytes / (1024.0 * 1024.0) << " MB resident, "
+            << memory.peakResidentBytes / (1024.0 * 1024.0) << " MB peak" << std::endl;
+    }
+}
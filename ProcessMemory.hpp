@@ -0,0 +1,22 @@
+#ifndef ProcessMemory_hpp
+#define ProcessMemory_hpp
+
+#include <cstddef>
+#include <string>
+
+namespace gps {
+
+    // Resident set size of the process, as reported by the OS (0 where it is not available)
+    struct ProcessMemory {
+        size_t residentBytes;
+        // largest resident size since the process started
+        size_t peakResidentBytes;
+    };
+
+    ProcessMemory GetProcessMemory();
+
+    // Prints the current and peak resident size after the label
+    void PrintProcessMemory(const std::string& label);
+}
+
+#endif /* ProcessMemory_hpp */
@@ -0,0 +1,566 @@
+#include "RenderQueue.hpp"
+
+#include "GLState.hpp"
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+#include "OcclusionCuller.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+
+        constexpr UniformName MODEL_UNIFORM = HashUniformName("model");
+        constexpr UniformName NORMAL_MATRIX_UNIFORM = HashUniformName("normalMatrix");
+        constexpr UniformName DRAW_DATA_UNIFORM = HashUniformName("drawData");
+        constexpr UniformName DRAW_INDEX_OFFSET_UNIFORM = HashUniformName("drawIndexOffset");
+
+        // RGBA32F texels per draw: model matrix, then normal matrix columns
+        const size_t DRAW_DATA_TEXELS = 7;
+        // texture buffer size every GL 4.1 context has
+        const GLint MIN_TEXTURE_BUFFER_TEXELS = 1 << 16;
+        const size_t NO_WINDOW = (size_t)-1;
+
+        // key fields, from the most significant bits down
+        const int LAYER_SHIFT = 60;
+        const int PROGRAM_SHIFT = 50;
+        const int TEXTURE_SET_SHIFT = 36;
+        const int VAO_SHIFT = 20;
+        const uint64_t PROGRAM_MASK = (1u << 10) - 1;
+        const uint64_t TEXTURE_SET_MASK = (1u << 14) - 1;
+        const uint64_t VAO_MASK = (1u << 16) - 1;
+        const uint64_t DEPTH_MASK = (1u << 20) - 1;
+
+        void ApplyLayerState(GLState& state, RenderLayer layer) {
+
+            bool background = layer == RENDER_LAYER_BACKGROUND;
+            state.SetEnabled(GL_DEPTH_TEST, !background);
+            state.SetEnabled(GL_CULL_FACE, !background);
+        }
+    }
+
+    RenderQueue::RenderQueue()
+        : view(1.0f), farPlane(1.0f), submitMode(SUBMIT_DIRECT), meshesVisible(0), meshesCulled(0),
+          trianglesSubmitted(0), trianglesFullDetail(0), cameraPosition(0.0f), lodPixelScale(0.0f), lodThreshold(0.0f),
+          lodViewportHeight(0),
+          occlusionCuller(NULL), drawDataBuffer(0), drawDataTexture(0), commandBuffer(0), uploadedWindow(NO_WINDOW) {
+
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    bool RenderQueue::IsMultiDrawIndirectSupported() {
+
+#if defined (__APPLE__)
+        // macOS stops at OpenGL 4.1
+        return false;
+#else
+        // base instances (4.2) are what the draw index attribute is built on
+        return GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && (GLEW_VERSION_4_2 || GLEW_ARB_base_instance));
+#endif
+    }
+
+    size_t RenderQueue::GetMaxDrawDataInstances() {
+
+        static size_t maxInstances = 0;
+        if (maxInstances == 0) {
+
+            GLint maxTexels = 0;
+            glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+            maxInstances = (size_t)std::max(maxTexels, MIN_TEXTURE_BUFFER_TEXELS) / DRAW_DATA_TEXELS;
+        }
+        return maxInstances;
+    }
+
+    void RenderQueue::SetSubmitMode(SubmitMode mode) {
+
+        submitMode = mode;
+    }
+
+    SubmitMode RenderQueue::GetSubmitMode() const {
+
+        return submitMode;
+    }
+
+    void RenderQueue::SetOcclusionCuller(gps::OcclusionCuller* culler) {
+
+        occlusionCuller = culler;
+    }
+
+    void RenderQueue::Begin(const glm::mat4& view, const glm::mat4& projection, float farPlane) {
+
+        this->view = view;
+        this->farPlane = farPlane;
+        frustum.Extract(projection * view);
+        cameraPosition = glm::vec3(glm::inverse(view)[3]);
+        // projection[1][1] is cot(fovy / 2), half the viewport spans 1 / that at distance 1
+        lodPixelScale = projection[1][1] * (float)lodViewportHeight * 0.5f;
+        meshesVisible = 0;
+        meshesCulled = 0;
+        trianglesSubmitted = 0;
+        trianglesFullDetail = 0;
+        transforms.clear();
+        items.clear();
+        sortEntries.clear();
+    }
+
+    const gps::Frustum& RenderQueue::GetFrustum() const {
+
+        return frustum;
+    }
+
+    void RenderQueue::RecordCulling(size_t visible, size_t culled) {
+
+        meshesVisible += visible;
+        meshesCulled += culled;
+    }
+
+    void RenderQueue::RecordTriangles(size_t submitted, size_t fullDetail) {
+
+        trianglesSubmitted += submitted;
+        trianglesFullDetail += fullDetail;
+    }
+
+    void RenderQueue::SetLodThreshold(float pixels, int viewportHeight) {
+
+        lodThreshold = pixels;
+        lodViewportHeight = viewportHeight;
+    }
+
+    float RenderQueue::GetLodErrorLimit(float distance) const {
+
+        if (lodThreshold <= 0.0f || lodPixelScale <= 0.0f) {
+            return 0.0f;
+        }
+        return lodThreshold * distance / lodPixelScale;
+    }
+
+    const glm::vec3& RenderQueue::GetCameraPosition() const {
+
+        return cameraPosition;
+    }
+
+    uint32_t RenderQueue::AddTransform(const glm::mat4& model) {
+
+        Transform transform;
+        transform.model = model;
+        // distance along the view direction of the model origin
+        transform.depth = -(view * model[3]).z;
+        transform.hasNormalMatrix = false;
+        transforms.push_back(transform);
+        return (uint32_t)transforms.size() - 1;
+    }
+
+    uint32_t RenderQueue::AddTransforms(const std::vector<glm::mat4>& models) {
+
+        uint32_t first = (uint32_t)transforms.size();
+        for (size_t i = 0; i < models.size(); i++) {
+            AddTransform(models[i]);
+        }
+        return first;
+    }
+
+    uint32_t RenderQueue::AddTransform(const glm::mat4& model, const glm::mat4& positionDecode) {
+
+        uint32_t index = AddTransform(model * positionDecode);
+        // the decode scales each axis on its own, the normals must not see it
+        Transform& transform = transforms[index];
+        transform.depth = -(view * model[3]).z;
+        transform.normalMatrix = glm::inverseTranspose(glm::mat3(view * model));
+        transform.hasNormalMatrix = true;
+        return index;
+    }
+
+    uint32_t RenderQueue::AddTransforms(const std::vector<glm::mat4>& models, const glm::mat4& positionDecode) {
+
+        uint32_t first = (uint32_t)transforms.size();
+        for (size_t i = 0; i < models.size(); i++) {
+            AddTransform(models[i], positionDecode);
+        }
+        return first;
+    }
+
+    uint32_t RenderQueue::GetTextureSet(const std::vector<gps::Texture>& textures, const std::vector<gps::UniformName>& samplers) {
+
+        TextureSet set;
+        for (size_t i = 0; i < textures.size(); i++) {
+            set.ids.push_back(textures[i].id);
+        }
+        set.samplers = samplers;
+
+        uint64_t hash = HashBytes(set.ids.data(), set.ids.size() * sizeof(GLuint));
+        hash = HashBytes(set.samplers.data(), set.samplers.size() * sizeof(UniformName), hash);
+
+        typedef std::unordered_multimap<uint64_t, uint32_t>::const_iterator SetIterator;
+        std::pair<SetIterator, SetIterator> candidates = textureSetsByHash.equal_range(hash);
+        for (SetIterator it = candidates.first; it != candidates.second; ++it) {
+
+            const TextureSet& candidate = textureSets[it->second];
+            if (candidate.ids == set.ids && candidate.samplers == set.samplers) {
+                return it->second;
+            }
+        }
+
+        textureSets.push_back(set);
+        uint32_t index = (uint32_t)textureSets.size() - 1;
+        textureSetsByHash.insert(std::make_pair(hash, index));
+        return index;
+    }
+
+    uint64_t RenderQueue::MakeKey(RenderLayer layer, const DrawItem& item) const {
+
+        float depth = transforms[item.transform].depth / farPlane;
+        depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+
+        return ((uint64_t)layer << LAYER_SHIFT)
+            | (((uint64_t)item.shader->shaderProgram & PROGRAM_MASK) << PROGRAM_SHIFT)
+            | (((uint64_t)item.textureSet & TEXTURE_SET_MASK) << TEXTURE_SET_SHIFT)
+            | (((uint64_t)item.vao & VAO_MASK) << VAO_SHIFT)
+            | (uint64_t)(depth * DEPTH_MASK);
+    }
+
+    void RenderQueue::Submit(RenderLayer layer, const DrawItem& item) {
+
+        // no item needs more draw data than the buffer holds
+        size_t maxInstances = GetMaxDrawDataInstances();
+        if (item.instanceCount > maxInstances) {
+
+            DrawItem part = item;
+            for (uint32_t first = 0; first < item.instanceCount; first += (uint32_t)maxInstances) {
+
+                part.transform = item.transform + first;
+                part.instanceCount = (uint32_t)std::min(maxInstances, (size_t)(item.instanceCount - first));
+                Submit(layer, part);
+            }
+            return;
+        }
+
+        SortEntry entry;
+        entry.key = MakeKey(layer, item);
+        entry.item = (uint32_t)items.size();
+        sortEntries.push_back(entry);
+        items.push_back(item);
+    }
+
+    void RenderQueue::Execute() {
+
+        memset(&stats, 0, sizeof(stats));
+        stats.meshesVisible = meshesVisible;
+        stats.meshesCulled = meshesCulled;
+        stats.trianglesSubmitted = trianglesSubmitted;
+        stats.trianglesFullDetail = trianglesFullDetail;
+        std::sort(sortEntries.begin(), sortEntries.end(),
+            [](const SortEntry& a, const SortEntry& b) { return a.key < b.key; });
+
+        programTransforms.clear();
+        samplerUnits.clear();
+
+        bool drawDataUsed = false;
+        for (size_t e = 0; e < sortEntries.size() && !drawDataUsed; e++) {
+            drawDataUsed = items[sortEntries[e].item].shader->getUniformLocation(DRAW_DATA_UNIFORM) != -1;
+        }
+        bool multiDraw = submitMode == SUBMIT_INDIRECT && IsMultiDrawIndirectSupported();
+        if (drawDataUsed) {
+            UploadDrawData(multiDraw);
+        }
+
+        GLState& state = GLState::Get();
+        size_t first = 0;
+        while (first < sortEntries.size()) {
+
+            // the run of items that share all the state of the first one
+            const DrawItem& item = items[sortEntries[first].item];
+            RenderLayer layer = (RenderLayer)(sortEntries[first].key >> LAYER_SHIFT);
+
+            size_t last = first + 1;
+            while (last < sortEntries.size()) {
+
+                const DrawItem& next = items[sortEntries[last].item];
+                if ((RenderLayer)(sortEntries[last].key >> LAYER_SHIFT) != layer || next.shader != item.shader
+                    || next.textureSet != item.textureSet || next.vao != item.vao) {
+                    break;
+                }
+                last++;
+            }
+
+            const gps::Shader& shader = *item.shader;
+            ApplyLayerState(state, layer);
+            state.UseProgram(shader.shaderProgram);
+            BindTextures(shader, textureSets[item.textureSet]);
+            state.BindVertexArray(item.vao);
+
+            if (shader.getUniformLocation(DRAW_DATA_UNIFORM) != -1) {
+                DrawWithDrawData(shader, first, last, multiDraw);
+            }
+            else {
+                DrawDirect(shader, first, last);
+            }
+            stats.draws += last - first;
+            for (size_t e = first; e < last; e++) {
+                stats.instances += items[sortEntries[e].item].instanceCount;
+            }
+
+            first = last;
+        }
+
+        // leave the state the rest of the frame expects
+        ApplyLayerState(state, RENDER_LAYER_OPAQUE);
+    }
+
+    void RenderQueue::Delete() {
+
+        if (drawDataTexture != 0) {
+            glDeleteTextures(1, &drawDataTexture);
+            GLState::Get().ForgetTexture(drawDataTexture);
+            glDeleteBuffers(1, &drawDataBuffer);
+            glDeleteBuffers(1, &commandBuffer);
+            drawDataTexture = drawDataBuffer = commandBuffer = 0;
+        }
+    }
+
+    const glm::mat3& RenderQueue::GetNormalMatrix(uint32_t transform) {
+
+        Transform& data = transforms[transform];
+        if (!data.hasNormalMatrix) {
+            data.normalMatrix = glm::inverseTranspose(glm::mat3(view * data.model));
+            data.hasNormalMatrix = true;
+        }
+        return data.normalMatrix;
+    }
+
+    void RenderQueue::SetSamplerUnit(const gps::Shader& shader, GLint location, GLint unit) {
+
+        uint64_t sampler = ((uint64_t)shader.shaderProgram << 32) | (uint32_t)location;
+        std::unordered_map<uint64_t, GLint>::iterator set = samplerUnits.find(sampler);
+        if (set == samplerUnits.end() || set->second != unit) {
+            glUniform1i(location, unit);
+            samplerUnits[sampler] = unit;
+            stats.uniformUploads++;
+        }
+        else {
+            stats.uniformUploadsAvoided++;
+        }
+    }
+
+    void RenderQueue::BindTextures(const gps::Shader& shader, const TextureSet& textures) {
+
+        for (size_t unit = 0; unit < textures.ids.size(); unit++) {
+
+            // a texture no sampler of this program reads is not bound at all
+            GLint samplerLocation = shader.getUniformLocation(textures.samplers[unit]);
+            if (samplerLocation == -1) {
+                continue;
+            }
+
+            SetSamplerUnit(shader, samplerLocation, (GLint)unit);
+            GLState::Get().BindTexture((GLuint)unit, textures.ids[unit]);
+        }
+    }
+
+    void RenderQueue::SetTransformUniforms(const gps::Shader& shader, uint32_t transform) {
+
+        GLint modelLocation = shader.getUniformLocation(MODEL_UNIFORM);
+        GLint normalMatrixLocation = shader.getUniformLocation(NORMAL_MATRIX_UNIFORM);
+        size_t transformUniforms = (modelLocation != -1 ? 1 : 0) + (normalMatrixLocation != -1 ? 1 : 0);
+
+        std::unordered_map<GLuint, uint32_t>::iterator lastTransform = programTransforms.find(shader.shaderProgram);
+        if (lastTransform != programTransforms.end() && lastTransform->second == transform) {
+            stats.uniformUploadsAvoided += transformUniforms;
+            return;
+        }
+
+        if (modelLocation != -1) {
+            glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &transforms[transform].model[0][0]);
+        }
+        if (normalMatrixLocation != -1) {
+            glUniformMatrix3fv(normalMatrixLocation, 1, GL_FALSE, &GetNormalMatrix(transform)[0][0]);
+        }
+        programTransforms[shader.shaderProgram] = transform;
+        stats.uniformUploads += transformUniforms;
+    }
+
+    void RenderQueue::UploadDrawData(bool multiDraw) {
+
+        size_t maxInstances = GetMaxDrawDataInstances();
+        commands.resize(sortEntries.size());
+        drawDataWindows.clear();
+        size_t instanceCount = 0;
+        size_t largestWindow = 0;
+        for (size_t e = 0; e < sortEntries.size(); e++) {
+
+            const DrawItem& item = items[sortEntries[e].item];
+
+            // Submit split the items, any one fits in a window of its own
+            if (drawDataWindows.empty() || drawDataWindows.back().instanceCount + item.instanceCount > maxInstances) {
+
+                DrawDataWindow window;
+                window.firstEntry = e;
+                window.firstInstance = instanceCount;
+                window.instanceCount = 0;
+                drawDataWindows.push_back(window);
+            }
+            DrawDataWindow& window = drawDataWindows.back();
+
+            DrawElementsIndirectCommand& command = commands[e];
+            command.count = (GLuint)item.geometry.indexCount;
+            command.instanceCount = item.instanceCount;
+            command.firstIndex = item.geometry.firstIndex;
+            command.baseVertex = item.geometry.baseVertex;
+            // the draw index attribute returns baseInstance + the instance number
+            command.baseInstance = (GLuint)window.instanceCount;
+            window.instanceCount += item.instanceCount;
+            instanceCount += item.instanceCount;
+            largestWindow = std::max(largestWindow, window.instanceCount);
+        }
+
+        // all windows one after the other, in the order of the sorted items
+        drawData.resize(instanceCount * DRAW_DATA_TEXELS);
+        size_t drawIndex = 0;
+        for (size_t e = 0; e < sortEntries.size(); e++) {
+
+            const DrawItem& item = items[sortEntries[e].item];
+            for (uint32_t instance = 0; instance < item.instanceCount; instance++) {
+
+                uint32_t transform = item.transform + instance;
+                const glm::mat4& model = transforms[transform].model;
+                const glm::mat3& normalMatrix = GetNormalMatrix(transform);
+
+                glm::vec4* texels = &drawData[drawIndex++ * DRAW_DATA_TEXELS];
+                for (int column = 0; column < 4; column++) {
+                    texels[column] = model[column];
+                }
+                for (int column = 0; column < 3; column++) {
+                    texels[4 + column] = glm::vec4(normalMatrix[column], 0.0f);
+                }
+            }
+        }
+
+        if (drawDataTexture == 0) {
+            glGenBuffers(1, &drawDataBuffer);
+            glGenBuffers(1, &commandBuffer);
+            glGenTextures(1, &drawDataTexture);
+        }
+
+        // the draws upload the windows as they reach them
+        uploadedWindow = NO_WINDOW;
+
+        if (multiDraw && occlusionCuller) {
+
+            // the culler writes the commands, without the instances of hidden opaque items
+            occlusionBounds.resize(sortEntries.size());
+            for (size_t e = 0; e < sortEntries.size(); e++) {
+
+                const DrawItem& item = items[sortEntries[e].item];
+                bool tested = (RenderLayer)(sortEntries[e].key >> LAYER_SHIFT) == RENDER_LAYER_OPAQUE;
+                occlusionBounds[e].center = glm::vec4(item.bounds.center, tested ? 1.0f : 0.0f);
+                occlusionBounds[e].extent = glm::vec4(item.bounds.extent, 0.0f);
+            }
+            occlusionCuller->CullCommands(commands, occlusionBounds, commandBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        }
+        else if (multiDraw) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+        }
+        GeometryArena::Get().ReserveDrawIndices(largestWindow);
+    }
+
+    void RenderQueue::UploadDrawDataWindow(size_t window) {
+
+        if (window == uploadedWindow) {
+            return;
+        }
+        const DrawDataWindow& data = drawDataWindows[window];
+
+        // reallocating the whole store each time lets the driver orphan the copy in flight
+        glBindBuffer(GL_TEXTURE_BUFFER, drawDataBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, data.instanceCount * DRAW_DATA_TEXELS * sizeof(glm::vec4),
+            drawData.data() + data.firstInstance * DRAW_DATA_TEXELS, GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        stats.drawDataUploads++;
+        stats.largestDrawDataUpload = std::max(stats.largestDrawDataUpload, data.instanceCount);
+
+        // the texture keeps pointing at the buffer object across glBufferData, attach once
+        if (GLState::Get().BindTexture(DRAW_DATA_UNIT, drawDataTexture, GL_TEXTURE_BUFFER)) {
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataBuffer);
+        }
+        uploadedWindow = window;
+    }
+
+    void RenderQueue::DrawDirect(const gps::Shader& shader, size_t first, size_t last) {
+
+        for (size_t e = first; e < last; e++) {
+
+            const DrawItem& item = items[sortEntries[e].item];
+            for (uint32_t instance = 0; instance < item.instanceCount; instance++) {
+
+                SetTransformUniforms(shader, item.transform + instance);
+                glDrawElementsBaseVertex(GL_TRIANGLES, item.geometry.indexCount, item.geometry.indexType,
+                    GeometryArena::IndexOffset(item.geometry), item.geometry.baseVertex);
+                stats.drawCalls++;
+            }
+        }
+    }
+
+    void RenderQueue::DrawWithDrawData(const gps::Shader& shader, size_t first, size_t last, bool multiDraw) {
+
+        SetSamplerUnit(shader, shader.getUniformLocation(DRAW_DATA_UNIFORM), (GLint)DRAW_DATA_UNIT);
+        GLint offsetLocation = shader.getUniformLocation(DRAW_INDEX_OFFSET_UNIFORM);
+
+        // a run shares its VAO, so its index buffer and type
+        GLenum indexType = items[sortEntries[first].item].geometry.indexType;
+
+        // the runs come in sorted order, so their windows never go back
+        size_t window = uploadedWindow == NO_WINDOW ? 0 : uploadedWindow;
+        for (size_t start = first; start < last; ) {
+
+            while (window + 1 < drawDataWindows.size() && drawDataWindows[window + 1].firstEntry <= start) {
+                window++;
+            }
+            size_t end = window + 1 < drawDataWindows.size() ? std::min(last, drawDataWindows[window + 1].firstEntry) : last;
+            UploadDrawDataWindow(window);
+
+            if (multiDraw) {
+
+                glUniform1i(offsetLocation, 0);
+                glMultiDrawElementsIndirect(GL_TRIANGLES, indexType,
+                    (const void*)(start * sizeof(DrawElementsIndirectCommand)), (GLsizei)(end - start), 0);
+                stats.drawCalls++;
+            }
+            else {
+
+                // same commands, one draw call each; without base instances the attribute
+                // starts at 0 for every draw, the offset moves it to the draw's data
+                for (size_t e = start; e < end; e++) {
+
+                    const DrawElementsIndirectCommand& command = commands[e];
+                    glUniform1i(offsetLocation, (GLint)command.baseInstance);
+                    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)command.count, indexType,
+                        (const void*)((uintptr_t)command.firstIndex * GeometryArena::GetIndexSize(indexType)), (GLsizei)command.instanceCount, command.baseVertex);
+                    stats.drawCalls++;
+                }
+            }
+            start = end;
+        }
+    }
+
+    const RenderQueueStats& RenderQueue::GetStats() const {
+
+        return stats;
+    }
+
+    void RenderQueue::PrintStats() const {
+
+        std::cout << "Render queue : " << stats.draws << " draws (" << stats.instances << " instances) in "
+            << stats.drawCalls << " draw calls, "
+            << stats.drawDataUploads << " draw data uploads (at most " << stats.largestDrawDataUpload << " instances), "
+            << stats.uniformUploads << " uniform uploads (" << stats.uniformUploadsAvoided << " avoided), "
+            << stats.meshesVisible << " meshes visible, " << stats.meshesCulled << " culled, "
+            << stats.trianglesSubmitted << " triangles (" << stats.trianglesFullDetail << " at full detail)" << std::endl;
+    }
+}
@@ -0,0 +1,265 @@
+#ifndef RenderQueue_hpp
+#define RenderQueue_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Frustum.hpp"
+#include "GeometryArena.hpp"
+#include "Shader.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace gps {
+
+    struct Texture;
+    class OcclusionCuller;
+
+    // Layers are drawn in order, each with its own fixed depth / cull state
+    enum RenderLayer {
+        // no depth test, no face culling (skydome)
+        RENDER_LAYER_BACKGROUND = 0,
+        // depth tested, back faces culled
+        RENDER_LAYER_OPAQUE = 1
+    };
+
+    // One indexed draw, as submitted by a mesh
+    struct DrawItem {
+        const gps::Shader* shader;
+        GLuint vao;
+        // indices and base vertex inside the VAO's buffers
+        gps::GeometryRange geometry;
+        // from RenderQueue::GetTextureSet
+        uint32_t textureSet;
+        // from RenderQueue::AddTransform(s), the first of instanceCount consecutive transforms
+        uint32_t transform;
+        uint32_t instanceCount;
+        // world space box around all instances, for occlusion culling
+        gps::BoundingBox bounds;
+    };
+
+    // How Execute issues the draws of programs that read the per-draw data
+    // (programs without it always get one draw call per instance, transforms set as uniforms)
+    enum SubmitMode {
+        // one instanced draw call per item
+        SUBMIT_DIRECT = 0,
+        // one glMultiDrawElementsIndirect per run of items sharing program and textures,
+        // one instanced draw call per item on contexts without it
+        SUBMIT_INDIRECT = 1
+    };
+
+    // Layout of one command in the GL_DRAW_INDIRECT_BUFFER
+    struct DrawElementsIndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // World space box of the draw of one command, as read by shaders/occlusion_test.vert
+    struct OcclusionBounds {
+        // w is 1 to test the command, 0 to always draw it
+        glm::vec4 center;
+        glm::vec4 extent;
+    };
+
+    // Items and instances drawn by the last Execute, the GL draw calls that took, and the per draw
+    // uniforms uploaded or skipped because the program already had them (binds are
+    // counted by GLState). Mesh copies kept or dropped by frustum culling, and triangles
+    // at the chosen levels of detail, are counted by the submitters (RecordCulling, RecordTriangles).
+    struct RenderQueueStats {
+        size_t draws;
+        size_t instances;
+        size_t drawCalls;
+        // windows of the draw data buffer uploaded, and the instances in the largest one
+        size_t drawDataUploads;
+        size_t largestDrawDataUpload;
+        size_t uniformUploads;
+        size_t uniformUploadsAvoided;
+        size_t meshesVisible;
+        size_t meshesCulled;
+        size_t trianglesSubmitted;
+        // the same draws at full detail
+        size_t trianglesFullDetail;
+    };
+
+    // Collects the draws of a frame and issues them sorted by a 64 bit key
+    //     layer (4) | program (10) | texture set (14) | VAO (16) | depth (20)
+    // so draws sharing a program, textures or VAO end up next to each other, front
+    // to back within the same state. Binds go through GLState, which drops the ones
+    // that match the previous draw. Key fields are truncated GL names: they only decide
+    // the order, state changes are always decided by comparing the real values.
+    //
+    // Programs with a "drawData" samplerBuffer get the model and normal matrix of each
+    // instance from it (7 RGBA32F texels per instance: the model columns, then the
+    // normal matrix columns), at the index given by the GeometryArena::DRAW_INDEX_ATTRIBUTE
+    // attribute plus the "drawIndexOffset" uniform. They are the ones that can draw
+    // many instances, or many items, in one call. The buffer holds GL_MAX_TEXTURE_BUFFER_SIZE
+    // texels at most (64K, about 9k instances, on GL 4.1): larger frames are drawn in
+    // windows of consecutive items, each uploaded before its draws, and larger instanced
+    // items are split when submitted.
+    class RenderQueue {
+
+    public:
+        // Unit of the per-draw data buffer texture, above the units meshes use
+        static const GLuint DRAW_DATA_UNIT = 15;
+
+        RenderQueue();
+
+        // True if the context has glMultiDrawElementsIndirect with base instances (GL 4.3),
+        // requires an initialized GLEW
+        static bool IsMultiDrawIndirectSupported();
+
+        // Instances whose draw data fits in one upload of the buffer, from GL_MAX_TEXTURE_BUFFER_SIZE,
+        // requires a current context
+        static size_t GetMaxDrawDataInstances();
+
+        void SetSubmitMode(SubmitMode mode);
+        SubmitMode GetSubmitMode() const;
+
+        // Culls the opaque items against the culler's Hi-Z pyramid before the multi-draws
+        // (only the indirect path can take draws the CPU never sees), NULL to draw everything
+        void SetOcclusionCuller(gps::OcclusionCuller* culler);
+
+        // Starts a frame, view is used for the normal matrices and the depth of each
+        // transform, farPlane is the distance mapped to the largest depth key.
+        // The culling frustum is extracted from projection * view.
+        void Begin(const glm::mat4& view, const glm::mat4& projection, float farPlane);
+
+        // Frustum of the current frame, submitters test their bounds against it
+        const gps::Frustum& GetFrustum() const;
+        // Counts mesh copies a submitter queued or skipped after testing them
+        void RecordCulling(size_t visible, size_t culled);
+        // Counts the triangles of a queued draw, and what it would have drawn at full detail
+        void RecordTriangles(size_t submitted, size_t fullDetail);
+
+        // Levels of detail may be off by this many pixels on a viewport viewportHeight pixels
+        // tall. 0 (the default) keeps every mesh at full detail.
+        void SetLodThreshold(float pixels, int viewportHeight);
+        // Largest world space error a level of detail may have this far from the camera, 0 when off
+        float GetLodErrorLimit(float distance) const;
+        // World space, from the view of Begin
+        const glm::vec3& GetCameraPosition() const;
+
+        // Stores a model matrix for the draws of this frame, returns its index
+        uint32_t AddTransform(const glm::mat4& model);
+        // Stores consecutive model matrices, returns the index of the first one
+        uint32_t AddTransforms(const std::vector<glm::mat4>& models);
+        // Same for the meshes of packed vertices: positionDecode is applied before each model
+        // matrix, the normal matrix and the sort depth still come from the model matrix alone
+        uint32_t AddTransform(const glm::mat4& model, const glm::mat4& positionDecode);
+        uint32_t AddTransforms(const std::vector<glm::mat4>& models, const glm::mat4& positionDecode);
+
+        // Index of the set of textures a mesh binds, texture i goes to unit i and
+        // its sampler is samplers[i]. Sets are kept across frames.
+        uint32_t GetTextureSet(const std::vector<gps::Texture>& textures, const std::vector<gps::UniformName>& samplers);
+
+        void Submit(RenderLayer layer, const DrawItem& item);
+
+        // Sorts and draws everything submitted since Begin
+        void Execute();
+
+        // Deletes the buffers of the indirect path
+        void Delete();
+
+        const RenderQueueStats& GetStats() const;
+        void PrintStats() const;
+
+    private:
+        struct TextureSet {
+            std::vector<GLuint> ids;
+            std::vector<gps::UniformName> samplers;
+        };
+
+        struct Transform {
+            glm::mat4 model;
+            float depth;
+            // computed by the first draw that needs it
+            bool hasNormalMatrix;
+            glm::mat3 normalMatrix;
+        };
+
+        struct SortEntry {
+            uint64_t key;
+            uint32_t item;
+        };
+
+        // Sorted items whose draw data fits in the texture buffer at once
+        struct DrawDataWindow {
+            size_t firstEntry;
+            size_t firstInstance;
+            size_t instanceCount;
+        };
+
+        glm::mat4 view;
+        float farPlane;
+        SubmitMode submitMode;
+
+        gps::Frustum frustum;
+        size_t meshesVisible;
+        size_t meshesCulled;
+        size_t trianglesSubmitted;
+        size_t trianglesFullDetail;
+
+        glm::vec3 cameraPosition;
+        // pixels per world unit at distance 1, and the error allowed in pixels
+        float lodPixelScale;
+        float lodThreshold;
+        int lodViewportHeight;
+
+        std::vector<TextureSet> textureSets;
+        // texture sets by the hash of their contents
+        std::unordered_multimap<uint64_t, uint32_t> textureSetsByHash;
+
+        std::vector<Transform> transforms;
+        std::vector<DrawItem> items;
+        std::vector<SortEntry> sortEntries;
+
+        // uniforms are program state: last transform and sampler unit set in each
+        // program during the current Execute
+        std::unordered_map<GLuint, uint32_t> programTransforms;
+        std::unordered_map<uint64_t, GLint> samplerUnits;
+
+        // draw data path: texels per instance, command per sorted item
+        std::vector<glm::vec4> drawData;
+        std::vector<DrawElementsIndirectCommand> commands;
+        std::vector<gps::OcclusionBounds> occlusionBounds;
+        gps::OcclusionCuller* occlusionCuller;
+        GLuint drawDataBuffer;
+        GLuint drawDataTexture;
+        GLuint commandBuffer;
+        // the command base instances count from the start of their window
+        std::vector<DrawDataWindow> drawDataWindows;
+        // in the buffer, NO_WINDOW before the first draw of a frame
+        size_t uploadedWindow;
+
+        RenderQueueStats stats;
+
+        uint64_t MakeKey(RenderLayer layer, const DrawItem& item) const;
+        const glm::mat3& GetNormalMatrix(uint32_t transform);
+
+        void SetSamplerUnit(const gps::Shader& shader, GLint location, GLint unit);
+        void BindTextures(const gps::Shader& shader, const TextureSet& textures);
+        void SetTransformUniforms(const gps::Shader& shader, uint32_t transform);
+
+        // Fills the draw data of all sorted items and uploads their commands
+        void UploadDrawData(bool multiDraw);
+        // Puts the draw data of a window in the buffer, if it is not there already
+        void UploadDrawDataWindow(size_t window);
+        // Draws the sorted items [first, last), which share their state
+        void DrawDirect(const gps::Shader& shader, size_t first, size_t last);
+        void DrawWithDrawData(const gps::Shader& shader, size_t first, size_t last, bool multiDraw);
+    };
+}
+
+#endif /* RenderQueue_hpp */
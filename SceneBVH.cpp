@@ -0,0 +1,458 @@
+#include "SceneBVH.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace gps {
+
+    namespace {
+
+        const int BIN_COUNT = 16;
+        // ranges this small are never split
+        const uint32_t MIN_SPLIT_SIZE = 3;
+        // leaves above this size are split even when the heuristic prefers a leaf
+        const uint32_t MAX_LEAF_SIZE = 8;
+        // cost of visiting a node, relative to testing one object
+        const float TRAVERSAL_COST = 1.0f;
+        // deeper ranges are split at the median, which bounds the depth by
+        // MAX_SAH_DEPTH + log2(objects), so the traversal stacks below never overflow
+        const int MAX_SAH_DEPTH = 32;
+        const int STACK_SIZE = MAX_SAH_DEPTH + 64;
+
+        float SurfaceArea(const glm::vec3& minimum, const glm::vec3& maximum) {
+
+            glm::vec3 size = maximum - minimum;
+            return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+        }
+
+        gps::BoundingBox ToBox(const glm::vec3& minimum, const glm::vec3& maximum) {
+
+            gps::BoundingBox box;
+            box.center = (minimum + maximum) * 0.5f;
+            box.extent = (maximum - minimum) * 0.5f;
+            return box;
+        }
+
+        // Distance along the ray to the box (0 if the origin is inside), false if it is missed
+        // or farther than maxDistance
+        bool IntersectRay(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance,
+                          const glm::vec3& minimum, const glm::vec3& maximum, float& distance) {
+
+            glm::vec3 t1 = (minimum - origin) * inverseDirection;
+            glm::vec3 t2 = (maximum - origin) * inverseDirection;
+            glm::vec3 nearT = glm::min(t1, t2);
+            glm::vec3 farT = glm::max(t1, t2);
+
+            float enter = std::max(std::max(nearT.x, nearT.y), std::max(nearT.z, 0.0f));
+            float exit = std::min(std::min(farT.x, farT.y), std::min(farT.z, maxDistance));
+            distance = enter;
+            return enter <= exit;
+        }
+
+        bool Overlaps(const glm::vec3& minimumA, const glm::vec3& maximumA, const glm::vec3& minimumB, const glm::vec3& maximumB) {
+
+            return minimumA.x <= maximumB.x && minimumB.x <= maximumA.x
+                && minimumA.y <= maximumB.y && minimumB.y <= maximumA.y
+                && minimumA.z <= maximumB.z && minimumB.z <= maximumA.z;
+        }
+
+        struct Bin {
+            glm::vec3 minimum;
+            glm::vec3 maximum;
+            uint32_t count;
+        };
+    }
+
+    SceneBVH::SceneBVH() {}
+
+    void SceneBVH::Build(const std::vector<gps::BoundingBox>& boxes) {
+
+        uint32_t count = (uint32_t)boxes.size();
+
+        objectMinimum.resize(count);
+        objectMaximum.resize(count);
+        objectLeaves.assign(count, 0);
+        objectIndices.resize(count);
+
+        std::vector<glm::vec3> centroids(count);
+        for (uint32_t i = 0; i < count; i++) {
+
+            objectMinimum[i] = boxes[i].center - boxes[i].extent;
+            objectMaximum[i] = boxes[i].center + boxes[i].extent;
+            centroids[i] = boxes[i].center;
+            objectIndices[i] = i;
+        }
+
+        nodes.clear();
+        parents.clear();
+        if (count == 0) {
+            return;
+        }
+
+        // a binary tree over n leaves never has more than 2n - 1 nodes
+        nodes.reserve(2 * (size_t)count - 1);
+        parents.reserve(2 * (size_t)count - 1);
+        BuildNode(0, 0, count, centroids, 0);
+        // the reserve was for the worst case
+        nodes.shrink_to_fit();
+        parents.shrink_to_fit();
+    }
+
+    uint32_t SceneBVH::BuildNode(uint32_t parent, uint32_t first, uint32_t count,
+                                 const std::vector<glm::vec3>& centroids, int depth) {
+
+        uint32_t index = (uint32_t)nodes.size();
+        nodes.push_back(Node());
+        parents.push_back(parent);
+
+        // box of the objects and of their centroids
+        glm::vec3 minimum = objectMinimum[objectIndices[first]];
+        glm::vec3 maximum = objectMaximum[objectIndices[first]];
+        glm::vec3 centroidMinimum = centroids[objectIndices[first]];
+        glm::vec3 centroidMaximum = centroidMinimum;
+        for (uint32_t i = first + 1; i < first + count; i++) {
+
+            uint32_t object = objectIndices[i];
+            minimum = glm::min(minimum, objectMinimum[object]);
+            maximum = glm::max(maximum, objectMaximum[object]);
+            centroidMinimum = glm::min(centroidMinimum, centroids[object]);
+            centroidMaximum = glm::max(centroidMaximum, centroids[object]);
+        }
+
+        Node& node = nodes[index];
+        node.minimum = minimum;
+        node.maximum = maximum;
+        node.first = first;
+        node.count = count;
+        node.right = 0;
+
+        // best binned split over the 3 axes, cost = area * objects on each side
+        int bestAxis = -1;
+        int bestBin = 0;
+        float bestCost = std::numeric_limits<float>::max();
+        if (count >= MIN_SPLIT_SIZE && depth < MAX_SAH_DEPTH) {
+
+            for (int axis = 0; axis < 3; axis++) {
+
+                float extent = centroidMaximum[axis] - centroidMinimum[axis];
+                if (extent <= 0.0f) {
+                    continue;
+                }
+
+                Bin bins[BIN_COUNT];
+                for (int b = 0; b < BIN_COUNT; b++) {
+                    bins[b].minimum = glm::vec3(std::numeric_limits<float>::max());
+                    bins[b].maximum = glm::vec3(-std::numeric_limits<float>::max());
+                    bins[b].count = 0;
+                }
+
+                float scale = BIN_COUNT / extent;
+                for (uint32_t i = first; i < first + count; i++) {
+
+                    uint32_t object = objectIndices[i];
+                    int b = std::min(BIN_COUNT - 1, (int)((centroids[object][axis] - centroidMinimum[axis]) * scale));
+                    bins[b].minimum = glm::min(bins[b].minimum, objectMinimum[object]);
+                    bins[b].maximum = glm::max(bins[b].maximum, objectMaximum[object]);
+                    bins[b].count++;
+                }
+
+                // left side costs of every split plane, then the right side sweep adds its own
+                float leftCost[BIN_COUNT - 1];
+                glm::vec3 sideMinimum = bins[0].minimum;
+                glm::vec3 sideMaximum = bins[0].maximum;
+                uint32_t sideCount = 0;
+                for (int b = 0; b < BIN_COUNT - 1; b++) {
+
+                    sideMinimum = glm::min(sideMinimum, bins[b].minimum);
+                    sideMaximum = glm::max(sideMaximum, bins[b].maximum);
+                    sideCount += bins[b].count;
+                    leftCost[b] = sideCount == 0 ? 0.0f : SurfaceArea(sideMinimum, sideMaximum) * sideCount;
+                }
+
+                sideMinimum = bins[BIN_COUNT - 1].minimum;
+                sideMaximum = bins[BIN_COUNT - 1].maximum;
+                sideCount = 0;
+                for (int b = BIN_COUNT - 1; b > 0; b--) {
+
+                    sideMinimum = glm::min(sideMinimum, bins[b].minimum);
+                    sideMaximum = glm::max(sideMaximum, bins[b].maximum);
+                    sideCount += bins[b].count;
+                    if (sideCount == 0 || sideCount == count) {
+                        continue;
+                    }
+
+                    float cost = leftCost[b - 1] + SurfaceArea(sideMinimum, sideMaximum) * sideCount;
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestBin = b;
+                    }
+                }
+            }
+        }
+
+        uint32_t leftCount;
+        if (bestAxis >= 0) {
+
+            // a split is worth it if a visit of both children costs less than testing every object
+            float area = SurfaceArea(minimum, maximum);
+            if (TRAVERSAL_COST * area + bestCost >= area * count && count <= MAX_LEAF_SIZE) {
+                leftCount = 0;
+            }
+            else {
+
+                float scale = BIN_COUNT / (centroidMaximum[bestAxis] - centroidMinimum[bestAxis]);
+                int axis = bestAxis;
+                int bin = bestBin;
+                float binOrigin = centroidMinimum[axis];
+                // same binning as above, so rounding cannot move an object to the other side
+                uint32_t* middle = std::partition(&objectIndices[first], &objectIndices[first] + count, [&](uint32_t object) {
+                    return std::min(BIN_COUNT - 1, (int)((centroids[object][axis] - binOrigin) * scale)) < bin;
+                });
+                leftCount = (uint32_t)(middle - &objectIndices[first]);
+            }
+        }
+        else if (count > MAX_LEAF_SIZE || (depth >= MAX_SAH_DEPTH && count >= MIN_SPLIT_SIZE)) {
+
+            // equal centroids or too deep: split at the median along the longest centroid axis
+            glm::vec3 extent = centroidMaximum - centroidMinimum;
+            int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+            leftCount = count / 2;
+            std::nth_element(&objectIndices[first], &objectIndices[first] + leftCount, &objectIndices[first] + count,
+                [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+        }
+        else {
+            leftCount = 0;
+        }
+
+        if (leftCount == 0 || leftCount == count) {
+
+            for (uint32_t i = first; i < first + count; i++) {
+                objectLeaves[objectIndices[i]] = index;
+            }
+            return index;
+        }
+
+        // the left child is the next node
+        BuildNode(index, first, leftCount, centroids, depth + 1);
+        uint32_t right = BuildNode(index, first + leftCount, count - leftCount, centroids, depth + 1);
+        nodes[index].right = right;
+        return index;
+    }
+
+    void SceneBVH::FitNode(uint32_t index) {
+
+        Node& node = nodes[index];
+        if (node.right == 0) {
+
+            node.minimum = objectMinimum[objectIndices[node.first]];
+            node.maximum = objectMaximum[objectIndices[node.first]];
+            for (uint32_t i = node.first + 1; i < node.first + node.count; i++) {
+                node.minimum = glm::min(node.minimum, objectMinimum[objectIndices[i]]);
+                node.maximum = glm::max(node.maximum, objectMaximum[objectIndices[i]]);
+            }
+        }
+        else {
+
+            const Node& left = nodes[index + 1];
+            const Node& right = nodes[node.right];
+            node.minimum = glm::min(left.minimum, right.minimum);
+            node.maximum = glm::max(left.maximum, right.maximum);
+        }
+    }
+
+    void SceneBVH::Update(uint32_t object, const gps::BoundingBox& box) {
+
+        objectMinimum[object] = box.center - box.extent;
+        objectMaximum[object] = box.center + box.extent;
+
+        uint32_t index = objectLeaves[object];
+        while (true) {
+
+            FitNode(index);
+            if (index == 0) {
+                break;
+            }
+            index = parents[index];
+        }
+    }
+
+    void SceneBVH::Refit() {
+
+        // children always come after their parent
+        for (size_t i = nodes.size(); i > 0; i--) {
+            FitNode((uint32_t)i - 1);
+        }
+    }
+
+    size_t SceneBVH::Cull(const gps::Frustum& frustum, std::vector<uint32_t>& visible) const {
+
+        if (nodes.empty()) {
+            return 0;
+        }
+
+        uint32_t stack[STACK_SIZE];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        size_t tested = 0;
+
+        while (stackSize > 0) {
+
+            uint32_t index = stack[--stackSize];
+            const Node& node = nodes[index];
+            tested++;
+
+            FrustumTest test = frustum.TestBox(ToBox(node.minimum, node.maximum));
+            if (test == FRUSTUM_OUTSIDE) {
+                continue;
+            }
+
+            if (test == FRUSTUM_INSIDE || (node.right == 0 && node.count == 1)) {
+                visible.insert(visible.end(), objectIndices.begin() + node.first, objectIndices.begin() + node.first + node.count);
+            }
+            else if (node.right == 0) {
+
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+
+                    uint32_t object = objectIndices[i];
+                    if (frustum.TestBox(ToBox(objectMinimum[object], objectMaximum[object])) != FRUSTUM_OUTSIDE) {
+                        visible.push_back(object);
+                    }
+                }
+            }
+            else {
+                stack[stackSize++] = node.right;
+                stack[stackSize++] = index + 1;
+            }
+        }
+        return tested;
+    }
+
+    bool SceneBVH::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                           uint32_t& object, float& distance, size_t* nodesVisited) const {
+
+        size_t visited = 0;
+        bool hit = false;
+        float nearest = maxDistance;
+        // a zero component gives an infinite slab, which the min / max of IntersectRay handle
+        glm::vec3 inverseDirection = glm::vec3(1.0f) / direction;
+
+        struct Entry {
+            uint32_t node;
+            float distance;
+        };
+        Entry stack[STACK_SIZE];
+        int stackSize = 0;
+
+        float rootDistance;
+        if (!nodes.empty() && IntersectRay(origin, inverseDirection, nearest, nodes[0].minimum, nodes[0].maximum, rootDistance)) {
+            Entry root = { 0, rootDistance };
+            stack[stackSize++] = root;
+        }
+
+        while (stackSize > 0) {
+
+            Entry entry = stack[--stackSize];
+            // something nearer was found since it was pushed
+            if (entry.distance > nearest) {
+                continue;
+            }
+            visited++;
+
+            const Node& node = nodes[entry.node];
+            if (node.right == 0) {
+
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+
+                    float t;
+                    uint32_t candidate = objectIndices[i];
+                    if (IntersectRay(origin, inverseDirection, nearest, objectMinimum[candidate], objectMaximum[candidate], t)) {
+                        nearest = t;
+                        object = candidate;
+                        hit = true;
+                    }
+                }
+                continue;
+            }
+
+            // the nearer child is pushed last, so it is visited first
+            Entry left = { entry.node + 1, 0.0f };
+            Entry right = { node.right, 0.0f };
+            bool hitLeft = IntersectRay(origin, inverseDirection, nearest, nodes[left.node].minimum, nodes[left.node].maximum, left.distance);
+            bool hitRight = IntersectRay(origin, inverseDirection, nearest, nodes[right.node].minimum, nodes[right.node].maximum, right.distance);
+            if (hitLeft && hitRight && left.distance < right.distance) {
+                stack[stackSize++] = right;
+                stack[stackSize++] = left;
+            }
+            else {
+                if (hitLeft) {
+                    stack[stackSize++] = left;
+                }
+                if (hitRight) {
+                    stack[stackSize++] = right;
+                }
+            }
+        }
+
+        if (nodesVisited) {
+            *nodesVisited = visited;
+        }
+        distance = nearest;
+        return hit;
+    }
+
+    void SceneBVH::Query(const gps::BoundingBox& box, std::vector<uint32_t>& objects) const {
+
+        if (nodes.empty()) {
+            return;
+        }
+
+        glm::vec3 minimum = box.center - box.extent;
+        glm::vec3 maximum = box.center + box.extent;
+
+        uint32_t stack[STACK_SIZE];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while (stackSize > 0) {
+
+            uint32_t index = stack[--stackSize];
+            const Node& node = nodes[index];
+            if (!Overlaps(node.minimum, node.maximum, minimum, maximum)) {
+                continue;
+            }
+
+            if (node.right == 0) {
+
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+
+                    uint32_t object = objectIndices[i];
+                    if (Overlaps(objectMinimum[object], objectMaximum[object], minimum, maximum)) {
+                        objects.push_back(object);
+                    }
+                }
+            }
+            else {
+                stack[stackSize++] = node.right;
+                stack[stackSize++] = index + 1;
+            }
+        }
+    }
+
+    size_t SceneBVH::GetObjectCount() const {
+
+        return objectIndices.size();
+    }
+
+    size_t SceneBVH::GetNodeCount() const {
+
+        return nodes.size();
+    }
+
+    size_t SceneBVH::GetMemoryUsage() const {
+
+        return nodes.capacity() * sizeof(Node) + parents.capacity() * sizeof(uint32_t)
+            + objectIndices.capacity() * sizeof(uint32_t) + objectLeaves.capacity() * sizeof(uint32_t)
+            + (objectMinimum.capacity() + objectMaximum.capacity()) * sizeof(glm::vec3);
+    }
+}
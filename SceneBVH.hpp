@@ -0,0 +1,79 @@
+#ifndef SceneBVH_hpp
+#define SceneBVH_hpp
+
+#include "Bounds.hpp"
+#include "Frustum.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Bounding volume hierarchy over the world space boxes of placed objects, for
+    // culling, picking and overlap queries that do not touch every object.
+    //
+    // Built top down with the surface area heuristic (binned centroids). Objects
+    // that move keep their place in the tree: Update refits the boxes on the way to
+    // the root, so the tree gets looser but stays correct until the next Build.
+    // Objects are the indices of the boxes given to Build.
+    class SceneBVH {
+
+    public:
+        SceneBVH();
+
+        void Build(const std::vector<gps::BoundingBox>& boxes);
+
+        // Moves one object, refitting its leaf and the nodes above it
+        void Update(uint32_t object, const gps::BoundingBox& box);
+        // Recomputes every node box from the object boxes, after many Updates
+        void Refit();
+
+        // Appends the objects whose boxes are not outside the frustum. Subtrees
+        // fully inside are appended without testing their objects.
+        // Returns the number of nodes tested.
+        size_t Cull(const gps::Frustum& frustum, std::vector<uint32_t>& visible) const;
+
+        // Nearest object box hit by origin + t * direction, t in [0, maxDistance]
+        bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                     uint32_t& object, float& distance, size_t* nodesVisited = NULL) const;
+
+        // Appends the objects whose boxes overlap box
+        void Query(const gps::BoundingBox& box, std::vector<uint32_t>& objects) const;
+
+        size_t GetObjectCount() const;
+        size_t GetNodeCount() const;
+        // Bytes allocated for the nodes and the per object data
+        size_t GetMemoryUsage() const;
+
+    private:
+        // 36 bytes. Nodes are stored depth first, so the left child of node i is i + 1.
+        // Every node covers objectIndices[first, first + count).
+        struct Node {
+            glm::vec3 minimum;
+            uint32_t first;
+            glm::vec3 maximum;
+            uint32_t count;
+            // 0 for leaves (the root is never a right child)
+            uint32_t right;
+        };
+
+        std::vector<Node> nodes;
+        // objects in tree order
+        std::vector<uint32_t> objectIndices;
+        // per object: its box as min / max, and its leaf
+        std::vector<glm::vec3> objectMinimum;
+        std::vector<glm::vec3> objectMaximum;
+        std::vector<uint32_t> objectLeaves;
+        // per node
+        std::vector<uint32_t> parents;
+
+        // Splits objectIndices[first, first + count) under a new node, returns its index
+        uint32_t BuildNode(uint32_t parent, uint32_t first, uint32_t count, const std::vector<glm::vec3>& centroids, int depth);
+        void FitNode(uint32_t node);
+    };
+}
+
+#endif /* SceneBVH_hpp */
@@ -7,27 +7,28 @@
 //
 
 #include "Shader.hpp"
+#include "GLState.hpp"
 
 namespace gps {
-    std::string Shader::readShaderFile(std::string fileName) {
+    GLuint Shader::compileShaderFile(GLenum shaderType, std::string fileName) {
 
-        std::ifstream shaderFile;
-        std::string shaderString;
-        
-        //open shader file
-        shaderFile.open(fileName);
-        
-        std::stringstream shaderStringStream;
-        
-        //read shader content into stream
-        shaderStringStream << shaderFile.rdbuf();
-        
-        //close shader file
-        shaderFile.close();
-        
-        //convert stream into GLchar array
-        shaderString = shaderStringStream.str();
-        return shaderString;
+        GLuint shader = glCreateShader(shaderType);
+
+        //map the shader file, the driver reads the source straight from the page cache
+        MappedFile shaderFile;
+        if (!shaderFile.Open(fileName)) {
+            std::cout << "Shader file " << fileName << " could not be opened" << std::endl;
+        }
+
+        //pass the exact length, the mapped source is not null terminated
+        const GLchar* shaderString = shaderFile.Data() != nullptr ? shaderFile.Data() : "";
+        GLint shaderLength = (GLint)shaderFile.Size();
+        glShaderSource(shader, 1, &shaderString, &shaderLength);
+        glCompileShader(shader);
+        //check compilation status
+        shaderCompileLog(shader);
+
+        return shader;
     }
     
     void Shader::shaderCompileLog(GLuint shaderId) {
@@ -61,24 +62,10 @@ namespace gps {
     void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName) {
 
         //read, parse and compile the vertex shader
-        std::string v = readShaderFile(vertexShaderFileName);
-        const GLchar* vertexShaderString = v.c_str();
-        GLuint vertexShader;
-        vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
-        glCompileShader(vertexShader);
-        //check compilation status
-        shaderCompileLog(vertexShader);
+        GLuint vertexShader = compileShaderFile(GL_VERTEX_SHADER, vertexShaderFileName);
         
-        //read, parse and compile the vertex shader
-        std::string f = readShaderFile(fragmentShaderFileName);
-        const GLchar* fragmentShaderString = f.c_str();
-        GLuint fragmentShader;
-        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
-        glCompileShader(fragmentShader);
-        //check compilation status
-        shaderCompileLog(fragmentShader);
+        //read, parse and compile the fragment shader
+        GLuint fragmentShader = compileShaderFile(GL_FRAGMENT_SHADER, fragmentShaderFileName);
         
         //attach and link the shader programs
         this->shaderProgram = glCreateProgram();
@@ -89,11 +76,117 @@ namespace gps {
         glDeleteShader(fragmentShader);
         //check linking info
         shaderLinkLog(this->shaderProgram);
+
+        readUniformLocations();
     }
     
-    void Shader::useShaderProgram() {
+    void Shader::loadTransformFeedbackShader(std::string vertexShaderFileName, const std::vector<const char*>& varyings) {
+
+        GLuint vertexShader = compileShaderFile(GL_VERTEX_SHADER, vertexShaderFileName);
+
+        //the captured outputs must be declared before linking
+        this->shaderProgram = glCreateProgram();
+        glAttachShader(this->shaderProgram, vertexShader);
+        glTransformFeedbackVaryings(this->shaderProgram, (GLsizei)varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(this->shaderProgram);
+        glDeleteShader(vertexShader);
+        shaderLinkLog(this->shaderProgram);
+
+        readUniformLocations();
+    }
+
+    void Shader::useShaderProgram() const {
+
+        gps::GLState::Get().UseProgram(this->shaderProgram);
+    }
+
+    void Shader::readUniformLocations() {
+
+        uniformLocations.clear();
+
+        GLint uniformCount = 0;
+        GLint maxNameLength = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORMS, &uniformCount);
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+        std::vector<GLchar> nameBuffer(maxNameLength + 1);
+        std::unordered_map<UniformName, std::string> names;
+
+        for (GLint i = 0; i < uniformCount; i++) {
+
+            GLint arraySize = 0;
+            GLenum type = 0;
+            GLsizei nameLength = 0;
+            glGetActiveUniform(this->shaderProgram, (GLuint)i, (GLsizei)nameBuffer.size(), &nameLength, &arraySize, &type, nameBuffer.data());
+
+            std::string name(nameBuffer.data(), nameLength);
+            GLint location = glGetUniformLocation(this->shaderProgram, name.c_str());
+            // uniforms inside blocks have no location
+            if (location < 0) {
+                continue;
+            }
+
+            //arrays are reported as "name[0]", register "name" and every "name[i]"
+            std::vector<std::string> aliases(1, name);
+            size_t bracket = name.find('[');
+            if (bracket != std::string::npos) {
+
+                std::string base = name.substr(0, bracket);
+                aliases[0] = base;
+                for (GLint element = 0; element < arraySize; element++) {
+                    aliases.push_back(base + "[" + std::to_string(element) + "]");
+                }
+            }
+
+            for (size_t a = 0; a < aliases.size(); a++) {
+
+                UniformName hash = HashUniformName(aliases[a].c_str());
+                std::unordered_map<UniformName, std::string>::iterator other = names.find(hash);
+                if (other != names.end() && other->second != aliases[a]) {
+                    std::cout << "Uniform names " << other->second << " and " << aliases[a] << " have the same hash" << std::endl;
+                }
+                names[hash] = aliases[a];
+
+                // array elements are consecutive locations
+                uniformLocations[hash] = a == 0 ? location : location + (GLint)(a - 1);
+            }
+        }
+    }
+
+    GLint Shader::getUniformLocation(UniformName name) const {
+
+        std::unordered_map<UniformName, GLint>::const_iterator found = uniformLocations.find(name);
+        return found != uniformLocations.end() ? found->second : -1;
+    }
+
+    GLint Shader::getUniformLocation(const char* name) const {
+
+        return getUniformLocation(HashUniformName(name));
+    }
+
+    void Shader::setUniform(UniformName name, GLint value) const {
+
+        glProgramUniform1i(this->shaderProgram, getUniformLocation(name), value);
+    }
+
+    void Shader::setUniform(UniformName name, GLfloat value) const {
+
+        glProgramUniform1f(this->shaderProgram, getUniformLocation(name), value);
+    }
+
+    void Shader::setUniform(UniformName name, const glm::vec3& value) const {
+
+        glProgramUniform3fv(this->shaderProgram, getUniformLocation(name), 1, &value[0]);
+    }
+
+    void Shader::setUniform(UniformName name, const glm::mat3& value) const {
+
+        glProgramUniformMatrix3fv(this->shaderProgram, getUniformLocation(name), 1, GL_FALSE, &value[0][0]);
+    }
+
+    void Shader::setUniform(UniformName name, const glm::mat4& value) const {
 
-        glUseProgram(this->shaderProgram);
+        glProgramUniformMatrix4fv(this->shaderProgram, getUniformLocation(name), 1, GL_FALSE, &value[0][0]);
     }
 
 }
@@ -17,22 +17,57 @@
     #include <GL/glew.h>
 #endif
 
+#include "MappedFile.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 
 namespace gps {
+
+    // Uniform names are looked up by their FNV-1a hash. Being constexpr, names written
+    // in the code can be hashed at compile time:
+    //     constexpr gps::UniformName VIEW_UNIFORM = gps::HashUniformName("view");
+    typedef uint32_t UniformName;
+
+    constexpr UniformName HashUniformName(const char* name, UniformName hash = 2166136261u) {
+        return *name == '\0' ? hash : HashUniformName(name + 1, (hash ^ (unsigned char)*name) * 16777619u);
+    }
     
     class Shader {
 
     public:
         GLuint shaderProgram;
         void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
-        void useShaderProgram();
+        // Vertex shader only program whose outputs are captured, interleaved, by transform feedback
+        void loadTransformFeedbackShader(std::string vertexShaderFileName, const std::vector<const char*>& varyings);
+        void useShaderProgram() const;
+
+        // Location of an active uniform from the table built after linking, -1 if the
+        // program has no such uniform (same as glGetUniformLocation, without the driver call)
+        GLint getUniformLocation(UniformName name) const;
+        GLint getUniformLocation(const char* name) const;
+
+        // Set a uniform of this program, it does not need to be the one in use
+        void setUniform(UniformName name, GLint value) const;
+        void setUniform(UniformName name, GLfloat value) const;
+        void setUniform(UniformName name, const glm::vec3& value) const;
+        void setUniform(UniformName name, const glm::mat3& value) const;
+        void setUniform(UniformName name, const glm::mat4& value) const;
     
     private:
-        std::string readShaderFile(std::string fileName);
+        // active uniforms by hashed name, filled in by loadShader
+        std::unordered_map<UniformName, GLint> uniformLocations;
+
+        void readUniformLocations();
+        GLuint compileShaderFile(GLenum shaderType, std::string fileName);
         void shaderCompileLog(GLuint shaderId);
         void shaderLinkLog(GLuint shaderProgramId);
     };
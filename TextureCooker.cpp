@@ -0,0 +1,624 @@
+#include "TextureCooker.hpp"
+#include "MappedFile.hpp"
+#include "TextureProcessing.hpp"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+
+        const char TEXTURE_CACHE_MAGIC[4] = { 'G', 'P', 'S', 'T' };
+        // bump whenever the layout of the file or the cooking itself changes
+        const uint32_t TEXTURE_CACHE_VERSION = 2;
+
+        // Laid out like a KTX header: GL format of the levels, size, level count
+        struct TextureCacheHeader {
+            char magic[4];
+            uint32_t version;
+            uint64_t sourceHash;
+            uint64_t contentHash;
+            uint32_t glInternalFormat;
+            uint32_t pixelWidth;
+            uint32_t pixelHeight;
+            uint32_t levelCount;
+        };
+
+        struct TextureCacheLevel {
+            uint32_t width;
+            uint32_t height;
+            uint32_t offset;
+            uint32_t size;
+        };
+
+        // 8 bit RGBA image, top row first after the OpenGL flip
+        struct Image {
+            int width;
+            int height;
+            std::vector<unsigned char> pixels;
+        };
+
+        // Conversion tables, built once (function-local statics are thread-safe)
+        struct SrgbTables {
+            float toLinear[256];
+            // 12 bit input precision is plenty for 8 bit output
+            unsigned char toSrgb[4096];
+
+            SrgbTables() {
+                for (int i = 0; i < 256; i++) {
+                    float c = i / 255.0f;
+                    toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+                }
+                for (int i = 0; i < 4096; i++) {
+                    float c = i / 4095.0f;
+                    float s = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+                    toSrgb[i] = (unsigned char)(s * 255.0f + 0.5f);
+                }
+            }
+        };
+
+        const SrgbTables& GetSrgbTables() {
+
+            static const SrgbTables tables;
+            return tables;
+        }
+
+        // 2x2 box filter, colors averaged in linear space and alpha as is
+        void Downsample(const Image& source, Image& destination) {
+
+            const SrgbTables& tables = GetSrgbTables();
+
+            destination.width = source.width > 1 ? source.width / 2 : 1;
+            destination.height = source.height > 1 ? source.height / 2 : 1;
+            destination.pixels.resize((size_t)destination.width * destination.height * 4);
+
+            for (int y = 0; y < destination.height; y++) {
+
+                int y0 = y * 2 < source.height ? y * 2 : source.height - 1;
+                int y1 = y0 + 1 < source.height ? y0 + 1 : y0;
+
+                for (int x = 0; x < destination.width; x++) {
+
+                    int x0 = x * 2 < source.width ? x * 2 : source.width - 1;
+                    int x1 = x0 + 1 < source.width ? x0 + 1 : x0;
+
+                    const unsigned char* p[4] = {
+                        &source.pixels[((size_t)y0 * source.width + x0) * 4],
+                        &source.pixels[((size_t)y0 * source.width + x1) * 4],
+                        &source.pixels[((size_t)y1 * source.width + x0) * 4],
+                        &source.pixels[((size_t)y1 * source.width + x1) * 4]
+                    };
+
+                    unsigned char* out = &destination.pixels[((size_t)y * destination.width + x) * 4];
+                    for (int c = 0; c < 3; c++) {
+                        float sum = tables.toLinear[p[0][c]] + tables.toLinear[p[1][c]] + tables.toLinear[p[2][c]] + tables.toLinear[p[3][c]];
+                        out[c] = tables.toSrgb[(int)(sum * 0.25f * 4095.0f + 0.5f)];
+                    }
+                    out[3] = (unsigned char)((p[0][3] + p[1][3] + p[2][3] + p[3][3] + 2) / 4);
+                }
+            }
+        }
+
+        uint16_t PackColor565(const float color[3]) {
+
+            int r = (int)(color[0] * 31.0f / 255.0f + 0.5f);
+            int g = (int)(color[1] * 63.0f / 255.0f + 0.5f);
+            int b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+            r = r < 0 ? 0 : (r > 31 ? 31 : r);
+            g = g < 0 ? 0 : (g > 63 ? 63 : g);
+            b = b < 0 ? 0 : (b > 31 ? 31 : b);
+            return (uint16_t)((r << 11) | (g << 5) | b);
+        }
+
+        void UnpackColor565(uint16_t packed, int color[3]) {
+
+            int r = (packed >> 11) & 31;
+            int g = (packed >> 5) & 63;
+            int b = packed & 31;
+            color[0] = (r << 3) | (r >> 2);
+            color[1] = (g << 2) | (g >> 4);
+            color[2] = (b << 3) | (b >> 2);
+        }
+
+        // Picks the closest palette entry for every pixel, returns the index bits and the squared error
+        uint32_t FitColorIndices(const unsigned char block[64], uint16_t color0, uint16_t color1, int& error) {
+
+            int palette[4][3];
+            UnpackColor565(color0, palette[0]);
+            UnpackColor565(color1, palette[1]);
+            for (int c = 0; c < 3; c++) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+
+            uint32_t indices = 0;
+            error = 0;
+            for (int i = 0; i < 16; i++) {
+
+                int best = 0;
+                int bestDistance = 0x7fffffff;
+                for (int p = 0; p < 4; p++) {
+
+                    int dr = block[i * 4 + 0] - palette[p][0];
+                    int dg = block[i * 4 + 1] - palette[p][1];
+                    int db = block[i * 4 + 2] - palette[p][2];
+                    int distance = dr * dr + dg * dg + db * db;
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+
+                indices |= (uint32_t)best << (i * 2);
+                error += bestDistance;
+            }
+            return indices;
+        }
+
+        void WriteColorBlock(uint16_t color0, uint16_t color1, uint32_t indices, unsigned char* out) {
+
+            out[0] = (unsigned char)(color0 & 0xff);
+            out[1] = (unsigned char)(color0 >> 8);
+            out[2] = (unsigned char)(color1 & 0xff);
+            out[3] = (unsigned char)(color1 >> 8);
+            for (int i = 0; i < 4; i++) {
+                out[4 + i] = (unsigned char)(indices >> (i * 8));
+            }
+        }
+
+        // BC1 color block: endpoints on the principal axis of the pixel colors, then one
+        // least squares refit of the endpoints to the chosen indices. Always uses the
+        // 4 color mode (color0 > color1), so the same block is valid inside BC3.
+        void EncodeColorBlock(const unsigned char block[64], unsigned char* out) {
+
+            float mean[3] = { 0.0f, 0.0f, 0.0f };
+            for (int i = 0; i < 16; i++) {
+                for (int c = 0; c < 3; c++) {
+                    mean[c] += block[i * 4 + c];
+                }
+            }
+            for (int c = 0; c < 3; c++) {
+                mean[c] /= 16.0f;
+            }
+
+            float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+            for (int i = 0; i < 16; i++) {
+
+                float r = block[i * 4 + 0] - mean[0];
+                float g = block[i * 4 + 1] - mean[1];
+                float b = block[i * 4 + 2] - mean[2];
+                covariance[0] += r * r;
+                covariance[1] += r * g;
+                covariance[2] += r * b;
+                covariance[3] += g * g;
+                covariance[4] += g * b;
+                covariance[5] += b * b;
+            }
+
+            // power iteration for the dominant eigenvector
+            float axis[3] = { 1.0f, 1.0f, 1.0f };
+            for (int iteration = 0; iteration < 8; iteration++) {
+
+                float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+                float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+                float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+                float length = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+                if (length < 1e-6f) {
+                    break;
+                }
+                axis[0] = x / length;
+                axis[1] = y / length;
+                axis[2] = z / length;
+            }
+
+            int minIndex = 0, maxIndex = 0;
+            float minProjection = 1e30f, maxProjection = -1e30f;
+            for (int i = 0; i < 16; i++) {
+
+                float projection = block[i * 4 + 0] * axis[0] + block[i * 4 + 1] * axis[1] + block[i * 4 + 2] * axis[2];
+                if (projection < minProjection) {
+                    minProjection = projection;
+                    minIndex = i;
+                }
+                if (projection > maxProjection) {
+                    maxProjection = projection;
+                    maxIndex = i;
+                }
+            }
+
+            float endpoint0[3], endpoint1[3];
+            for (int c = 0; c < 3; c++) {
+                endpoint0[c] = block[maxIndex * 4 + c];
+                endpoint1[c] = block[minIndex * 4 + c];
+            }
+
+            uint16_t bestColor0 = 0, bestColor1 = 0;
+            uint32_t bestIndices = 0;
+            int bestError = 0x7fffffff;
+
+            for (int pass = 0; pass < 2; pass++) {
+
+                uint16_t color0 = PackColor565(endpoint0);
+                uint16_t color1 = PackColor565(endpoint1);
+                if (color0 < color1) {
+                    std::swap(color0, color1);
+                }
+
+                int error;
+                uint32_t indices = 0;
+                if (color0 == color1) {
+                    // flat block, every pixel takes color0
+                    FitColorIndices(block, color0, color1, error);
+                }
+                else {
+                    indices = FitColorIndices(block, color0, color1, error);
+                }
+
+                if (error < bestError) {
+                    bestError = error;
+                    bestColor0 = color0;
+                    bestColor1 = color1;
+                    bestIndices = indices;
+                }
+
+                if (pass == 1 || color0 == color1) {
+                    break;
+                }
+
+                // refit: solve for the endpoints that best reproduce the pixels with these indices
+                static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+                float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+                float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+                for (int i = 0; i < 16; i++) {
+
+                    float a = weights[(indices >> (i * 2)) & 3];
+                    float b = 1.0f - a;
+                    aa += a * a;
+                    ab += a * b;
+                    bb += b * b;
+                    for (int c = 0; c < 3; c++) {
+                        ax[c] += a * block[i * 4 + c];
+                        bx[c] += b * block[i * 4 + c];
+                    }
+                }
+
+                float determinant = aa * bb - ab * ab;
+                if (std::fabs(determinant) < 1e-6f) {
+                    break;
+                }
+                for (int c = 0; c < 3; c++) {
+                    endpoint0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+                    endpoint1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+                }
+            }
+
+            WriteColorBlock(bestColor0, bestColor1, bestIndices, out);
+        }
+
+        // BC3 alpha block: min/max endpoints with the 8 value palette
+        void EncodeAlphaBlock(const unsigned char block[64], unsigned char* out) {
+
+            int alpha0 = 0, alpha1 = 255;
+            for (int i = 0; i < 16; i++) {
+                alpha0 = std::max(alpha0, (int)block[i * 4 + 3]);
+                alpha1 = std::min(alpha1, (int)block[i * 4 + 3]);
+            }
+
+            out[0] = (unsigned char)alpha0;
+            out[1] = (unsigned char)alpha1;
+
+            uint64_t indices = 0;
+            if (alpha0 > alpha1) {
+
+                int palette[8];
+                palette[0] = alpha0;
+                palette[1] = alpha1;
+                for (int p = 1; p < 7; p++) {
+                    palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+                }
+
+                for (int i = 0; i < 16; i++) {
+
+                    int best = 0;
+                    int bestDistance = 256;
+                    for (int p = 0; p < 8; p++) {
+
+                        int distance = std::abs(block[i * 4 + 3] - palette[p]);
+                        if (distance < bestDistance) {
+                            bestDistance = distance;
+                            best = p;
+                        }
+                    }
+                    indices |= (uint64_t)best << (i * 3);
+                }
+            }
+
+            for (int i = 0; i < 6; i++) {
+                out[2 + i] = (unsigned char)(indices >> (i * 8));
+            }
+        }
+
+        size_t GetLevelSize(GLenum internalFormat, int width, int height) {
+
+            size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+            switch (internalFormat) {
+            case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+                return blocks * 8;
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+                return blocks * 16;
+            default:
+                return (size_t)width * height * 4;
+            }
+        }
+
+        // Appends one level in the texture's format, edge pixels are repeated in partial blocks
+        void AppendLevel(const Image& image, CookedTexture& texture) {
+
+            TextureLevel level;
+            level.width = image.width;
+            level.height = image.height;
+            level.offset = texture.data.size();
+            level.size = GetLevelSize(texture.internalFormat, image.width, image.height);
+            texture.data.resize(level.offset + level.size);
+            texture.levels.push_back(level);
+
+            unsigned char* out = &texture.data[level.offset];
+            if (!texture.IsCompressed()) {
+                memcpy(out, image.pixels.data(), level.size);
+                return;
+            }
+
+            bool withAlpha = texture.internalFormat == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+            unsigned char block[64];
+
+            for (int by = 0; by < image.height; by += 4) {
+                for (int bx = 0; bx < image.width; bx += 4) {
+
+                    for (int i = 0; i < 16; i++) {
+
+                        int x = std::min(bx + (i & 3), image.width - 1);
+                        int y = std::min(by + (i >> 2), image.height - 1);
+                        memcpy(&block[i * 4], &image.pixels[((size_t)y * image.width + x) * 4], 4);
+                    }
+
+                    if (withAlpha) {
+                        EncodeAlphaBlock(block, out);
+                        out += 8;
+                    }
+                    EncodeColorBlock(block, out);
+                    out += 8;
+                }
+            }
+        }
+
+        // Reads the pixel data from an image file as RGBA, flipped for OpenGL
+        bool DecodeImage(const std::string& fileName, Image& image) {
+
+            int x, y, n;
+            // decoded with its own channel count, the expansion to RGBA is fused with the flip below
+            unsigned char* image_data = stbi_load(fileName.c_str(), &x, &y, &n, 0);
+
+            if (!image_data) {
+                fprintf(stderr, "ERROR: could not load %s\n", fileName.c_str());
+                return false;
+            }
+            // NPOT check
+            if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
+                fprintf(stderr, "WARNING: texture %s is not power-of-2 dimensions\n", fileName.c_str());
+            }
+
+            image.width = x;
+            image.height = y;
+            image.pixels.resize((size_t)x * y * 4);
+
+            size_t source_row_bytes = (size_t)x * n;
+            for (int row = 0; row < y; row++) {
+                ConvertRowToRGBA(image_data + (size_t)(y - row - 1) * source_row_bytes, n, &image.pixels[(size_t)row * x * 4], x);
+            }
+
+            stbi_image_free(image_data);
+            return true;
+        }
+
+        bool ReadTextureCache(const std::string& cacheFileName, const std::string& imageFileName, bool compress, CookedTexture& texture) {
+
+            MappedFile file;
+            if (!file.Open(cacheFileName)) {
+                return false;
+            }
+
+            TextureCacheHeader header;
+            if (file.Size() < sizeof(header)) {
+                return false;
+            }
+            memcpy(&header, file.Data(), sizeof(header));
+
+            bool compressed = header.glInternalFormat == GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+                || header.glInternalFormat == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+            if (memcmp(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic)) != 0
+                || header.version != TEXTURE_CACHE_VERSION
+                || compressed != compress
+                || header.levelCount == 0) {
+
+                return false;
+            }
+
+            if (HashFileStamps(std::vector<std::string>(1, imageFileName)) != header.sourceHash) {
+
+                std::cout << "Texture cache out of date : " << cacheFileName << std::endl;
+                return false;
+            }
+
+            size_t levelsEnd = sizeof(header) + (size_t)header.levelCount * sizeof(TextureCacheLevel);
+            if (file.Size() < levelsEnd) {
+                return false;
+            }
+
+            const char* data = file.Data() + levelsEnd;
+            size_t dataSize = file.Size() - levelsEnd;
+
+            CookedTexture cached;
+            cached.path = imageFileName;
+            cached.internalFormat = header.glInternalFormat;
+            cached.contentHash = header.contentHash;
+            cached.levels.resize(header.levelCount);
+
+            for (size_t i = 0; i < cached.levels.size(); i++) {
+
+                TextureCacheLevel entry;
+                memcpy(&entry, file.Data() + sizeof(header) + i * sizeof(entry), sizeof(entry));
+
+                if (entry.offset > dataSize || entry.size > dataSize - entry.offset
+                    || entry.size != GetLevelSize(header.glInternalFormat, entry.width, entry.height)) {
+
+                    return false;
+                }
+
+                cached.levels[i].width = (int)entry.width;
+                cached.levels[i].height = (int)entry.height;
+                cached.levels[i].offset = entry.offset;
+                cached.levels[i].size = entry.size;
+            }
+
+            cached.data.assign(data, data + dataSize);
+
+            texture.path = cached.path;
+            texture.internalFormat = cached.internalFormat;
+            texture.contentHash = cached.contentHash;
+            texture.levels.swap(cached.levels);
+            texture.data.swap(cached.data);
+            return true;
+        }
+
+        bool WriteTextureCache(const std::string& cacheFileName, const std::string& imageFileName, const CookedTexture& texture) {
+
+            // write to a temporary file first, so a crash never leaves a truncated cache behind
+            std::string tempFileName = MakeTempFileName(cacheFileName);
+            std::ofstream out(tempFileName.c_str(), std::ios::binary | std::ios::trunc);
+            if (!out) {
+                return false;
+            }
+
+            TextureCacheHeader header;
+            memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic));
+            header.version = TEXTURE_CACHE_VERSION;
+            header.sourceHash = HashFileStamps(std::vector<std::string>(1, imageFileName));
+            header.contentHash = texture.contentHash;
+            header.glInternalFormat = texture.internalFormat;
+            header.pixelWidth = (uint32_t)texture.levels[0].width;
+            header.pixelHeight = (uint32_t)texture.levels[0].height;
+            header.levelCount = (uint32_t)texture.levels.size();
+            out.write((const char*)&header, sizeof(header));
+
+            for (size_t i = 0; i < texture.levels.size(); i++) {
+
+                TextureCacheLevel entry;
+                entry.width = (uint32_t)texture.levels[i].width;
+                entry.height = (uint32_t)texture.levels[i].height;
+                entry.offset = (uint32_t)texture.levels[i].offset;
+                entry.size = (uint32_t)texture.levels[i].size;
+                out.write((const char*)&entry, sizeof(entry));
+            }
+
+            out.write((const char*)texture.data.data(), texture.data.size());
+
+            out.close();
+            if (!out) {
+                remove(tempFileName.c_str());
+                return false;
+            }
+
+            remove(cacheFileName.c_str());
+            if (rename(tempFileName.c_str(), cacheFileName.c_str()) != 0) {
+                remove(tempFileName.c_str());
+                return false;
+            }
+
+            return true;
+        }
+    }
+
+    bool CookedTexture::IsCompressed() const {
+
+        return internalFormat == GL_COMPRESSED_SRGB_S3TC_DXT1_EXT || internalFormat == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+    }
+
+    bool IsTextureCompressionSupported() {
+
+#if defined (__APPLE__)
+        // every OpenGL 4.1 driver on macOS exposes S3TC
+        return true;
+#else
+        return GLEW_EXT_texture_compression_s3tc == GL_TRUE;
+#endif
+    }
+
+    std::string GetTextureCacheFileName(const std::string& imageFileName) {
+
+        return imageFileName + ".texcache";
+    }
+
+    bool CookTexture(const std::string& imageFileName, bool compress, CookedTexture& texture) {
+
+        std::string cacheFileName = GetTextureCacheFileName(imageFileName);
+        if (ReadTextureCache(cacheFileName, imageFileName, compress, texture)) {
+            return true;
+        }
+
+        Image image;
+        if (!DecodeImage(imageFileName, image)) {
+            return false;
+        }
+
+        bool opaque = true;
+        for (size_t i = 3; i < image.pixels.size() && opaque; i += 4) {
+            opaque = image.pixels[i] == 255;
+        }
+
+        CookedTexture cooked;
+        cooked.path = imageFileName;
+        if (compress) {
+            cooked.internalFormat = opaque ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+        }
+        else {
+            cooked.internalFormat = opaque ? GL_SRGB8 : GL_SRGB8_ALPHA8;
+        }
+
+        // full mip chain, each level filtered from the previous one
+        AppendLevel(image, cooked);
+        while (image.width > 1 || image.height > 1) {
+
+            Image next;
+            Downsample(image, next);
+            AppendLevel(next, cooked);
+            image.width = next.width;
+            image.height = next.height;
+            image.pixels.swap(next.pixels);
+        }
+
+        cooked.contentHash = HashBytes(&cooked.internalFormat, sizeof(cooked.internalFormat));
+        for (size_t i = 0; i < cooked.levels.size(); i++) {
+            cooked.contentHash = HashBytes(&cooked.levels[i].width, sizeof(cooked.levels[i].width), cooked.contentHash);
+            cooked.contentHash = HashBytes(&cooked.levels[i].height, sizeof(cooked.levels[i].height), cooked.contentHash);
+        }
+        cooked.contentHash = HashBytes(cooked.data.data(), cooked.data.size(), cooked.contentHash);
+
+        if (!WriteTextureCache(cacheFileName, imageFileName, cooked)) {
+            std::cout << "Could not write the texture cache " << cacheFileName << std::endl;
+        }
+
+        texture.path = cooked.path;
+        texture.internalFormat = cooked.internalFormat;
+        texture.contentHash = cooked.contentHash;
+        texture.levels.swap(cooked.levels);
+        texture.data.swap(cooked.data);
+        return true;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef TextureCooker_hpp
+#define TextureCooker_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// EXT_texture_sRGB + EXT_texture_compression_s3tc formats
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+    #define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+    #define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+namespace gps {
+
+    // Texture cooking: an image is decoded once, its full mip chain is built on the
+    // CPU (filtered in linear space) and block compressed to BC1 (opaque) or BC3
+    // (with alpha) sRGB, then stored next to the image in a small KTX-like cache
+    // file. Later loads only map the cache and hand the levels to the driver.
+
+    // One mip level inside CookedTexture::data
+    struct TextureLevel {
+        int width;
+        int height;
+        size_t offset;
+        size_t size;
+    };
+
+    struct CookedTexture {
+        std::string path;
+        // GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT,
+        // or GL_SRGB8 / GL_SRGB8_ALPHA8 with RGBA pixels when compression is not available
+        GLenum internalFormat;
+        // level 0 is the full size image, down to 1x1
+        std::vector<TextureLevel> levels;
+        std::vector<unsigned char> data;
+        // hash of the format, level sizes and data, identifies the same image under other paths
+        uint64_t contentHash;
+
+        bool IsCompressed() const;
+    };
+
+    // True if the context can sample S3TC textures, requires an initialized GLEW
+    bool IsTextureCompressionSupported();
+
+    // Returns the cache file name used for a given image file
+    std::string GetTextureCacheFileName(const std::string& imageFileName);
+
+    // Loads the texture from its cache, or decodes the image, cooks it and refreshes
+    // the cache. compress selects BC1/BC3 or uncompressed levels. Returns false if
+    // the image cannot be loaded.
+    bool CookTexture(const std::string& imageFileName, bool compress, CookedTexture& texture);
+}
+
+#endif /* TextureCooker_hpp */
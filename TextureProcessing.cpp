@@ -0,0 +1,273 @@
+#include "TextureProcessing.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined (_M_X64) || defined (_M_IX86) || defined (__x86_64__) || defined (__i386__)
+    #define GPS_TEXTURE_X86
+    #include <immintrin.h>
+    #if defined (_MSC_VER)
+        #include <intrin.h>
+        // MSVC accepts AVX2 intrinsics in any function
+        #define GPS_TARGET_AVX2
+        #define GPS_TARGET_SSE2
+    #else
+        #define GPS_TARGET_AVX2 __attribute__((target("avx2")))
+        #define GPS_TARGET_SSE2 __attribute__((target("sse2")))
+    #endif
+#endif
+
+namespace gps {
+
+    namespace {
+
+        // Scalar kernels, also used for the tails of the SIMD loops
+
+        void SwapBytesScalar(unsigned char* a, unsigned char* b, size_t count) {
+
+            std::swap_ranges(a, a + count, b);
+        }
+
+        void ConvertRowScalar(const unsigned char* source, int channels, unsigned char* destination, size_t width) {
+
+            for (size_t x = 0; x < width; x++) {
+
+                const unsigned char* in = source + x * channels;
+                unsigned char* out = destination + x * 4;
+                switch (channels) {
+                case 1:
+                    out[0] = out[1] = out[2] = in[0];
+                    out[3] = 255;
+                    break;
+                case 2:
+                    out[0] = out[1] = out[2] = in[0];
+                    out[3] = in[1];
+                    break;
+                case 3:
+                    out[0] = in[0];
+                    out[1] = in[1];
+                    out[2] = in[2];
+                    out[3] = 255;
+                    break;
+                default:
+                    memcpy(out, in, 4);
+                    break;
+                }
+            }
+        }
+
+        void PremultiplyScalar(unsigned char* pixels, size_t pixelCount) {
+
+            for (size_t i = 0; i < pixelCount; i++) {
+
+                unsigned char* p = pixels + i * 4;
+                unsigned int a = p[3];
+                for (int c = 0; c < 3; c++) {
+                    // exact round(x * a / 255)
+                    unsigned int t = p[c] * a + 128;
+                    p[c] = (unsigned char)((t + (t >> 8)) >> 8);
+                }
+            }
+        }
+
+#if defined (GPS_TEXTURE_X86)
+        GPS_TARGET_SSE2 void SwapBytesSSE2(unsigned char* a, unsigned char* b, size_t count) {
+
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16) {
+
+                __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+                __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+                _mm_storeu_si128((__m128i*)(a + i), vb);
+                _mm_storeu_si128((__m128i*)(b + i), va);
+            }
+            SwapBytesScalar(a + i, b + i, count - i);
+        }
+
+        GPS_TARGET_AVX2 void SwapBytesAVX2(unsigned char* a, unsigned char* b, size_t count) {
+
+            size_t i = 0;
+            for (; i + 64 <= count; i += 64) {
+
+                __m256i va0 = _mm256_loadu_si256((const __m256i*)(a + i));
+                __m256i va1 = _mm256_loadu_si256((const __m256i*)(a + i + 32));
+                __m256i vb0 = _mm256_loadu_si256((const __m256i*)(b + i));
+                __m256i vb1 = _mm256_loadu_si256((const __m256i*)(b + i + 32));
+                _mm256_storeu_si256((__m256i*)(a + i), vb0);
+                _mm256_storeu_si256((__m256i*)(a + i + 32), vb1);
+                _mm256_storeu_si256((__m256i*)(b + i), va0);
+                _mm256_storeu_si256((__m256i*)(b + i + 32), va1);
+            }
+            SwapBytesScalar(a + i, b + i, count - i);
+        }
+
+        GPS_TARGET_AVX2 void ConvertRGBRowAVX2(const unsigned char* source, unsigned char* destination, size_t width) {
+
+            // in each 128 bit lane: 4 RGB pixels (12 bytes) to 4 RGBA pixels, alpha byte from the mask
+            const __m256i shuffle = _mm256_setr_epi8(
+                0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+            const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+
+            size_t x = 0;
+            // 8 pixels per step, the second 16 byte load reads up to byte 28, so keep 4 bytes of slack
+            for (; x + 8 <= width && (width - x) * 3 >= 28; x += 8) {
+
+                const unsigned char* in = source + x * 3;
+                __m128i low = _mm_loadu_si128((const __m128i*)in);
+                __m128i high = _mm_loadu_si128((const __m128i*)(in + 12));
+                __m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+                pixels = _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha);
+                _mm256_storeu_si256((__m256i*)(destination + x * 4), pixels);
+            }
+            ConvertRowScalar(source + x * 3, 3, destination + x * 4, width - x);
+        }
+
+        GPS_TARGET_SSE2 void PremultiplySSE2(unsigned char* pixels, size_t pixelCount) {
+
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i round = _mm_set1_epi16(128);
+            // keeps the original alpha in the 16 bit lanes of the alpha channel
+            const __m128i alphaLanes = _mm_set_epi16((short)0xffff, 0, 0, 0, (short)0xffff, 0, 0, 0);
+
+            size_t i = 0;
+            for (; i + 4 <= pixelCount; i += 4) {
+
+                __m128i rgba = _mm_loadu_si128((const __m128i*)(pixels + i * 4));
+
+                __m128i halves[2] = { _mm_unpacklo_epi8(rgba, zero), _mm_unpackhi_epi8(rgba, zero) };
+                for (int h = 0; h < 2; h++) {
+
+                    // broadcast the alpha of each pixel to its 4 lanes
+                    __m128i a = _mm_shufflelo_epi16(halves[h], _MM_SHUFFLE(3, 3, 3, 3));
+                    a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+                    // alpha lanes are multiplied by 255, which the division maps back to alpha
+                    a = _mm_or_si128(_mm_andnot_si128(alphaLanes, a), _mm_and_si128(alphaLanes, _mm_set1_epi16(255)));
+
+                    __m128i t = _mm_add_epi16(_mm_mullo_epi16(halves[h], a), round);
+                    halves[h] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+                }
+
+                _mm_storeu_si128((__m128i*)(pixels + i * 4), _mm_packus_epi16(halves[0], halves[1]));
+            }
+            PremultiplyScalar(pixels + i * 4, pixelCount - i);
+        }
+
+        GPS_TARGET_AVX2 void PremultiplyAVX2(unsigned char* pixels, size_t pixelCount) {
+
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i round = _mm256_set1_epi16(128);
+            const __m256i alphaLanes = _mm256_set_epi16((short)0xffff, 0, 0, 0, (short)0xffff, 0, 0, 0,
+                                                        (short)0xffff, 0, 0, 0, (short)0xffff, 0, 0, 0);
+            const __m256i opaque = _mm256_set1_epi16(255);
+
+            size_t i = 0;
+            for (; i + 8 <= pixelCount; i += 8) {
+
+                __m256i rgba = _mm256_loadu_si256((const __m256i*)(pixels + i * 4));
+
+                // unpack works per 128 bit lane, packus below restores the same order
+                __m256i halves[2] = { _mm256_unpacklo_epi8(rgba, zero), _mm256_unpackhi_epi8(rgba, zero) };
+                for (int h = 0; h < 2; h++) {
+
+                    __m256i a = _mm256_shufflelo_epi16(halves[h], _MM_SHUFFLE(3, 3, 3, 3));
+                    a = _mm256_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+                    a = _mm256_blendv_epi8(a, opaque, alphaLanes);
+
+                    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(halves[h], a), round);
+                    halves[h] = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+                }
+
+                _mm256_storeu_si256((__m256i*)(pixels + i * 4), _mm256_packus_epi16(halves[0], halves[1]));
+            }
+            PremultiplyScalar(pixels + i * 4, pixelCount - i);
+        }
+
+        bool CpuSupportsAVX2() {
+
+#if defined (_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7) {
+                return false;
+            }
+            __cpuid(info, 1);
+            // OSXSAVE and AVX, then the OS must save the YMM registers
+            if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6) {
+                return false;
+            }
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") != 0;
+#endif
+        }
+#endif
+    }
+
+    TextureSimdLevel GetTextureSimdLevel() {
+
+#if defined (GPS_TEXTURE_X86)
+        // SSE2 is part of x86-64 and of every CPU that runs OpenGL 4.1
+        static const TextureSimdLevel level = CpuSupportsAVX2() ? TEXTURE_SIMD_AVX2 : TEXTURE_SIMD_SSE2;
+        return level;
+#else
+        return TEXTURE_SIMD_SCALAR;
+#endif
+    }
+
+    void FlipRows(unsigned char* pixels, size_t rowBytes, int rows, TextureSimdLevel level) {
+
+        for (int row = 0; row < rows / 2; row++) {
+
+            unsigned char* top = pixels + row * rowBytes;
+            unsigned char* bottom = pixels + (rows - row - 1) * rowBytes;
+
+#if defined (GPS_TEXTURE_X86)
+            if (level == TEXTURE_SIMD_AVX2) {
+                SwapBytesAVX2(top, bottom, rowBytes);
+                continue;
+            }
+            if (level == TEXTURE_SIMD_SSE2) {
+                SwapBytesSSE2(top, bottom, rowBytes);
+                continue;
+            }
+#endif
+            SwapBytesScalar(top, bottom, rowBytes);
+        }
+    }
+
+    void ConvertRowToRGBA(const unsigned char* source, int channels, unsigned char* destination, size_t width,
+                          TextureSimdLevel level) {
+
+        if (channels == 4) {
+            memcpy(destination, source, width * 4);
+            return;
+        }
+
+#if defined (GPS_TEXTURE_X86)
+        // RGB expansion needs a byte shuffle (SSSE3 and up), the SSE2 level stays on the scalar loop
+        if (channels == 3 && level == TEXTURE_SIMD_AVX2) {
+            ConvertRGBRowAVX2(source, destination, width);
+            return;
+        }
+#endif
+        ConvertRowScalar(source, channels, destination, width);
+    }
+
+    void PremultiplyAlpha(unsigned char* pixels, size_t pixelCount, TextureSimdLevel level) {
+
+#if defined (GPS_TEXTURE_X86)
+        if (level == TEXTURE_SIMD_AVX2) {
+            PremultiplyAVX2(pixels, pixelCount);
+            return;
+        }
+        if (level == TEXTURE_SIMD_SSE2) {
+            PremultiplySSE2(pixels, pixelCount);
+            return;
+        }
+#endif
+        PremultiplyScalar(pixels, pixelCount);
+    }
+}
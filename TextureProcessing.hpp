@@ -0,0 +1,31 @@
+#ifndef TextureProcessing_hpp
+#define TextureProcessing_hpp
+
+#include <cstddef>
+
+namespace gps {
+
+    // Pixel kernels used while preparing textures, each with a scalar version and
+    // SSE2 / AVX2 versions picked at run time on x86 (see Benchmark.cpp for timings)
+    enum TextureSimdLevel {
+        TEXTURE_SIMD_SCALAR = 0,
+        TEXTURE_SIMD_SSE2 = 1,
+        TEXTURE_SIMD_AVX2 = 2
+    };
+
+    // Best level supported by the CPU
+    TextureSimdLevel GetTextureSimdLevel();
+
+    // Flips an image upside down in place, by swapping rows of rowBytes bytes
+    void FlipRows(unsigned char* pixels, size_t rowBytes, int rows, TextureSimdLevel level = GetTextureSimdLevel());
+
+    // Converts one row of 1, 2, 3 or 4 channel pixels to RGBA
+    // (grey is replicated to RGB, missing alpha is set to 255), source and destination must not overlap
+    void ConvertRowToRGBA(const unsigned char* source, int channels, unsigned char* destination, size_t width,
+                          TextureSimdLevel level = GetTextureSimdLevel());
+
+    // Multiplies the color channels of RGBA pixels by their alpha, rounded like x * a / 255
+    void PremultiplyAlpha(unsigned char* pixels, size_t pixelCount, TextureSimdLevel level = GetTextureSimdLevel());
+}
+
+#endif /* TextureProcessing_hpp */
@@ -0,0 +1,181 @@
+#include "TextureRegistry.hpp"
+#include "GLState.hpp"
+
+#include <iostream>
+
+namespace gps {
+
+    TextureRegistry::TextureRegistry()
+        : pathHits(0), contentHits(0), misses(0), residentBytes(0), savedBytes(0) {}
+
+    TextureRegistry& TextureRegistry::Get() {
+
+        // never destroyed, the global models release their textures during static destruction
+        static TextureRegistry* registry = new TextureRegistry();
+        return *registry;
+    }
+
+    std::string TextureRegistry::CanonicalPath(const std::string& path) {
+
+        std::string normalized(path);
+        for (size_t i = 0; i < normalized.size(); i++) {
+            if (normalized[i] == '\\') {
+                normalized[i] = '/';
+            }
+        }
+
+        bool absolute = !normalized.empty() && normalized[0] == '/';
+        std::vector<std::string> components;
+
+        size_t start = 0;
+        while (start <= normalized.size()) {
+
+            size_t end = normalized.find('/', start);
+            if (end == std::string::npos) {
+                end = normalized.size();
+            }
+
+            std::string component = normalized.substr(start, end - start);
+            if (component == "..") {
+                // only a real directory can be stepped out of, leading ".." stay
+                if (!components.empty() && components.back() != "..") {
+                    components.pop_back();
+                }
+                else if (!absolute) {
+                    components.push_back(component);
+                }
+            }
+            else if (!component.empty() && component != ".") {
+                components.push_back(component);
+            }
+
+            start = end + 1;
+        }
+
+        std::string canonical = absolute ? "/" : "";
+        for (size_t i = 0; i < components.size(); i++) {
+            canonical += (i > 0 ? "/" : "") + components[i];
+        }
+        return canonical;
+    }
+
+    bool TextureRegistry::Contains(const std::string& path) {
+
+        std::lock_guard<std::mutex> lock(mutex);
+        return byPath.find(CanonicalPath(path)) != byPath.end();
+    }
+
+    bool TextureRegistry::ClaimCooking(const std::string& path) {
+
+        std::string canonical = CanonicalPath(path);
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (byPath.find(canonical) != byPath.end()) {
+            return false;
+        }
+        return cooking.insert(canonical).second;
+    }
+
+    void TextureRegistry::EndCooking(const std::string& path) {
+
+        std::string canonical = CanonicalPath(path);
+        std::lock_guard<std::mutex> lock(mutex);
+        cooking.erase(canonical);
+    }
+
+    GLuint TextureRegistry::Acquire(const std::string& path, uint64_t contentHash) {
+
+        std::string canonical = CanonicalPath(path);
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::unordered_map<std::string, GLuint>::iterator found = byPath.find(canonical);
+        if (found != byPath.end()) {
+
+            Entry& entry = textures[found->second];
+            entry.references++;
+            pathHits++;
+            savedBytes += entry.byteSize;
+            return found->second;
+        }
+
+        if (contentHash != 0) {
+
+            std::unordered_map<uint64_t, GLuint>::iterator sameContent = byContent.find(contentHash);
+            if (sameContent != byContent.end()) {
+
+                // remember the new path, later lookups of it hit directly
+                Entry& entry = textures[sameContent->second];
+                entry.references++;
+                entry.paths.push_back(canonical);
+                byPath[canonical] = sameContent->second;
+                contentHits++;
+                savedBytes += entry.byteSize;
+                return sameContent->second;
+            }
+        }
+
+        misses++;
+        return 0;
+    }
+
+    void TextureRegistry::Add(const std::string& path, uint64_t contentHash, GLuint textureId, size_t byteSize) {
+
+        if (textureId == 0) {
+            return;
+        }
+
+        std::string canonical = CanonicalPath(path);
+        std::lock_guard<std::mutex> lock(mutex);
+
+        Entry& entry = textures[textureId];
+        entry.paths.push_back(canonical);
+        entry.contentHash = contentHash;
+        entry.byteSize = byteSize;
+        entry.references = 1;
+
+        byPath[canonical] = textureId;
+        cooking.erase(canonical);
+        // the first texture with this content stays the one shared
+        if (contentHash != 0 && byContent.find(contentHash) == byContent.end()) {
+            byContent[contentHash] = textureId;
+        }
+        residentBytes += byteSize;
+    }
+
+    void TextureRegistry::Release(GLuint textureId) {
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::unordered_map<GLuint, Entry>::iterator found = textures.find(textureId);
+        if (found == textures.end()) {
+            return;
+        }
+
+        Entry& entry = found->second;
+        if (--entry.references > 0) {
+            return;
+        }
+
+        for (size_t i = 0; i < entry.paths.size(); i++) {
+            byPath.erase(entry.paths[i]);
+        }
+        std::unordered_map<uint64_t, GLuint>::iterator sameContent = byContent.find(entry.contentHash);
+        if (sameContent != byContent.end() && sameContent->second == textureId) {
+            byContent.erase(sameContent);
+        }
+        residentBytes -= entry.byteSize;
+
+        glDeleteTextures(1, &textureId);
+        GLState::Get().ForgetTexture(textureId);
+        textures.erase(found);
+    }
+
+    void TextureRegistry::PrintStats() {
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::cout << "Textures : " << textures.size() << " resident (" << residentBytes / (1024.0 * 1024.0) << " MB), "
+            << pathHits << " path hits, " << contentHits << " content hits, " << misses << " misses, "
+            << savedBytes / (1024.0 * 1024.0) << " MB of VRAM saved" << std::endl;
+    }
+}
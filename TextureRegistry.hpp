@@ -0,0 +1,82 @@
+#ifndef TextureRegistry_hpp
+#define TextureRegistry_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace gps {
+
+    // Process-wide set of the textures resident on the GPU, shared by all models.
+    // Textures are found by canonical path, or by the hash of their cooked content
+    // when the same image is stored under another path, and are reference counted:
+    // the GL texture is deleted when the last model using it releases it.
+    // Lookups may come from any thread, creating and deleting textures (Add / Release)
+    // must happen on the thread that owns the OpenGL context.
+    class TextureRegistry {
+
+    public:
+        static TextureRegistry& Get();
+
+        // Path with '\' turned into '/' and the "." / ".." / empty components resolved
+        static std::string CanonicalPath(const std::string& path);
+
+        // True if a texture is resident for the path (no reference is taken)
+        bool Contains(const std::string& path);
+
+        // True if the caller should cook the image: no texture is resident for the path and
+        // no other model is cooking it. The claim ends when the texture is added or with
+        // EndCooking, models sharing the path find it here after their upload.
+        bool ClaimCooking(const std::string& path);
+        void EndCooking(const std::string& path);
+
+        // Returns the texture for the path or, if contentHash is not 0, for the same
+        // content under another path, with one more reference. Returns 0 on a miss.
+        GLuint Acquire(const std::string& path, uint64_t contentHash = 0);
+
+        // Registers a newly created texture with one reference, byteSize is its VRAM footprint
+        void Add(const std::string& path, uint64_t contentHash, GLuint textureId, size_t byteSize);
+
+        // Drops one reference, deletes the texture when it was the last one
+        void Release(GLuint textureId);
+
+        // Hit / miss counts, resident size and the VRAM the hits did not allocate again
+        void PrintStats();
+
+    private:
+        TextureRegistry();
+
+        struct Entry {
+            std::vector<std::string> paths;
+            uint64_t contentHash;
+            size_t byteSize;
+            int references;
+        };
+
+        std::mutex mutex;
+        std::unordered_map<GLuint, Entry> textures;
+        std::unordered_map<std::string, GLuint> byPath;
+        std::unordered_map<uint64_t, GLuint> byContent;
+        // canonical paths claimed by ClaimCooking
+        std::unordered_set<std::string> cooking;
+
+        size_t pathHits;
+        size_t contentHits;
+        size_t misses;
+        size_t residentBytes;
+        size_t savedBytes;
+    };
+}
+
+#endif /* TextureRegistry_hpp */
@@ -0,0 +1,210 @@
+#include "VertexFormat.hpp"
+
+#include "Mesh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace gps {
+
+    namespace {
+
+        const float UNORM16_MAX = 65535.0f;
+        const float SNORM10_MAX = 511.0f;
+        // largest finite half, texture coordinates past it are clamped
+        const uint16_t HALF_MAX = 0x7bff;
+
+        // Round to nearest even, like the GPU conversions
+        uint16_t FloatToHalf(float value) {
+
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+
+            uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+            uint32_t floatExponent = (bits >> 23) & 0xff;
+            uint32_t mantissa = bits & 0x7fffff;
+
+            if (floatExponent == 0xff) {
+                return mantissa != 0 ? (uint16_t)(sign | 0x7e00) : (uint16_t)(sign | HALF_MAX);
+            }
+
+            int exponent = (int)floatExponent - 127 + 15;
+            if (exponent >= 31) {
+                return (uint16_t)(sign | HALF_MAX);
+            }
+
+            uint32_t half;
+            uint32_t shift;
+            if (exponent <= 0) {
+                // subnormal half, the implicit bit becomes part of the mantissa
+                if (exponent < -10) {
+                    return sign;
+                }
+                mantissa |= 0x800000;
+                shift = (uint32_t)(14 - exponent);
+                half = mantissa >> shift;
+            }
+            else {
+                shift = 13;
+                half = ((uint32_t)exponent << 10) | (mantissa >> shift);
+            }
+
+            uint32_t rest = mantissa & ((1u << shift) - 1);
+            uint32_t halfway = 1u << (shift - 1);
+            if (rest > halfway || (rest == halfway && (half & 1))) {
+                // a carry into the exponent is still the right rounding
+                half++;
+            }
+            return (uint16_t)(sign | std::min(half, (uint32_t)HALF_MAX));
+        }
+
+        float HalfToFloat(uint16_t half) {
+
+            uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+            uint32_t exponent = (half >> 10) & 0x1f;
+            uint32_t mantissa = half & 0x3ff;
+
+            if (exponent == 0) {
+                float value = std::ldexp((float)mantissa, -24);
+                return sign != 0 ? -value : value;
+            }
+
+            uint32_t bits = exponent == 31 ? sign | 0x7f800000 | (mantissa << 13)
+                : sign | ((exponent + 112) << 23) | (mantissa << 13);
+            float value;
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        // Signed 10 bit fields x, y, z from the low bits up, w (2 bits) left at 0
+        uint32_t PackNormal(const glm::vec3& normal) {
+
+            float length = glm::length(normal);
+            glm::vec3 direction = length > 0.0f ? normal / length : normal;
+
+            uint32_t packed = 0;
+            for (int i = 0; i < 3; i++) {
+
+                float component = std::max(-1.0f, std::min(1.0f, direction[i]));
+                int32_t value = (int32_t)std::floor(component * SNORM10_MAX + 0.5f);
+                packed |= ((uint32_t)value & 0x3ff) << (10 * i);
+            }
+            return packed;
+        }
+
+        // The GL 4.2 snorm rule, c / 511 clamped to -1 (4.1 maps c to (2c + 1) / 1023, within half a step)
+        glm::vec3 UnpackNormal(uint32_t packed) {
+
+            glm::vec3 normal;
+            for (int i = 0; i < 3; i++) {
+
+                int32_t value = (int32_t)((packed >> (10 * i)) & 0x3ff);
+                if (value >= 512) {
+                    value -= 1024;
+                }
+                normal[i] = std::max((float)value / SNORM10_MAX, -1.0f);
+            }
+            return normal;
+        }
+
+        float AngleDegrees(const glm::vec3& a, const glm::vec3& b) {
+
+            float lengths = glm::length(a) * glm::length(b);
+            if (lengths == 0.0f) {
+                return 0.0f;
+            }
+            float cosine = std::max(-1.0f, std::min(1.0f, glm::dot(a, b) / lengths));
+            return std::acos(cosine) * 180.0f / 3.14159265f;
+        }
+    }
+
+    size_t GetVertexSize(VertexFormat format) {
+
+        return format == VERTEX_FORMAT_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+    }
+
+    VertexQuantization ComputeQuantization(const std::vector<gps::Vertex>& vertices) {
+
+        VertexQuantization quantization;
+        quantization.offset = glm::vec3(0.0f);
+        quantization.scale = glm::vec3(1.0f);
+        if (vertices.empty()) {
+            return quantization;
+        }
+
+        glm::vec3 minimum = vertices[0].Position;
+        glm::vec3 maximum = vertices[0].Position;
+        for (size_t i = 1; i < vertices.size(); i++) {
+            minimum = glm::min(minimum, vertices[i].Position);
+            maximum = glm::max(maximum, vertices[i].Position);
+        }
+
+        quantization.offset = minimum;
+        for (int i = 0; i < 3; i++) {
+            // flat along an axis: every position is the offset there
+            quantization.scale[i] = maximum[i] > minimum[i] ? maximum[i] - minimum[i] : 1.0f;
+        }
+        return quantization;
+    }
+
+    glm::mat4 GetPositionDecode(const VertexQuantization& quantization) {
+
+        glm::mat4 decode(1.0f);
+        decode[0][0] = quantization.scale.x;
+        decode[1][1] = quantization.scale.y;
+        decode[2][2] = quantization.scale.z;
+        decode[3] = glm::vec4(quantization.offset, 1.0f);
+        return decode;
+    }
+
+    void PackVertices(const std::vector<gps::Vertex>& vertices, const VertexQuantization& quantization,
+                      std::vector<PackedVertex>& packed) {
+
+        packed.resize(vertices.size());
+        for (size_t v = 0; v < vertices.size(); v++) {
+
+            const gps::Vertex& vertex = vertices[v];
+            PackedVertex& out = packed[v];
+
+            glm::vec3 position = (vertex.Position - quantization.offset) / quantization.scale;
+            for (int i = 0; i < 3; i++) {
+                float unit = std::max(0.0f, std::min(1.0f, position[i]));
+                out.position[i] = (uint16_t)(unit * UNORM16_MAX + 0.5f);
+            }
+            out.padding = 0;
+            out.normal = PackNormal(vertex.Normal);
+            out.texCoords[0] = FloatToHalf(vertex.TexCoords.x);
+            out.texCoords[1] = FloatToHalf(vertex.TexCoords.y);
+        }
+    }
+
+    gps::Vertex UnpackVertex(const PackedVertex& packed, const VertexQuantization& quantization) {
+
+        gps::Vertex vertex;
+        glm::vec3 unit((float)packed.position[0], (float)packed.position[1], (float)packed.position[2]);
+        vertex.Position = quantization.offset + unit / UNORM16_MAX * quantization.scale;
+        vertex.Normal = UnpackNormal(packed.normal);
+        vertex.TexCoords = glm::vec2(HalfToFloat(packed.texCoords[0]), HalfToFloat(packed.texCoords[1]));
+        return vertex;
+    }
+
+    PackingError MeasurePackingError(const std::vector<gps::Vertex>& vertices, const std::vector<PackedVertex>& packed,
+                                     const VertexQuantization& quantization) {
+
+        PackingError error;
+        error.position = 0.0f;
+        error.normal = 0.0f;
+        error.texCoords = 0.0f;
+
+        for (size_t v = 0; v < vertices.size() && v < packed.size(); v++) {
+
+            gps::Vertex unpacked = UnpackVertex(packed[v], quantization);
+            error.position = std::max(error.position, glm::length(unpacked.Position - vertices[v].Position));
+            error.normal = std::max(error.normal, AngleDegrees(unpacked.Normal, vertices[v].Normal));
+            error.texCoords = std::max(error.texCoords, std::max(std::fabs(unpacked.TexCoords.x - vertices[v].TexCoords.x),
+                                                                 std::fabs(unpacked.TexCoords.y - vertices[v].TexCoords.y)));
+        }
+        return error;
+    }
+}
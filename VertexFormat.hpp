@@ -0,0 +1,64 @@
+#ifndef VertexFormat_hpp
+#define VertexFormat_hpp
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    struct Vertex;
+
+    // How the vertices of a mesh are stored in the GeometryArena
+    enum VertexFormat {
+        // gps::Vertex as it is, 32 bytes
+        VERTEX_FORMAT_FULL = 0,
+        // gps::PackedVertex, 16 bytes
+        VERTEX_FORMAT_PACKED = 1,
+        VERTEX_FORMAT_COUNT = 2
+    };
+
+    // 16 bytes: the position as unorm16 inside the box of its mesh, the normal as snorm
+    // 10:10:10:2, the texture coordinates as half floats. The vertex fetch turns all of them
+    // back into floats, so the programs read both formats the same way; the positions come
+    // out in [0, 1] and the mesh's decode matrix, folded into its model matrix, brings them
+    // back to model space (see RenderQueue::AddTransform).
+    struct PackedVertex {
+        uint16_t position[3];
+        uint16_t padding;
+        uint32_t normal;
+        uint16_t texCoords[2];
+    };
+
+    // Model space box the positions of a mesh are quantized in
+    struct VertexQuantization {
+        glm::vec3 offset;
+        glm::vec3 scale;
+    };
+
+    // Largest differences between vertices and what the vertex fetch reads from their packed copies
+    struct PackingError {
+        // model units
+        float position;
+        // degrees
+        float normal;
+        float texCoords;
+    };
+
+    size_t GetVertexSize(VertexFormat format);
+
+    VertexQuantization ComputeQuantization(const std::vector<gps::Vertex>& vertices);
+    // Maps the [0, 1] positions read from packed vertices to model space
+    glm::mat4 GetPositionDecode(const VertexQuantization& quantization);
+
+    void PackVertices(const std::vector<gps::Vertex>& vertices, const VertexQuantization& quantization,
+                      std::vector<PackedVertex>& packed);
+    // What the vertex fetch and the decode matrix make of a packed vertex
+    gps::Vertex UnpackVertex(const PackedVertex& packed, const VertexQuantization& quantization);
+
+    PackingError MeasurePackingError(const std::vector<gps::Vertex>& vertices, const std::vector<PackedVertex>& packed,
+                                     const VertexQuantization& quantization);
+}
+
+#endif /* VertexFormat_hpp */
@@ -24,7 +24,8 @@ namespace gps {
     class Window {
 
     public:
-        void Create(int width=800, int height=600, const char *title="OpenGL Project");
+        // visible=false gives a hidden window, for a context without anything on screen
+        void Create(int width=800, int height=600, const char *title="OpenGL Project", bool visible=true);
         void Delete();
 
         GLFWwindow* getWindow();
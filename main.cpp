@@ -17,6 +17,15 @@
 #include "Shader.hpp"
 #include "Camera.hpp"
 #include "Model3D.hpp"
+#include "AssetLoader.hpp"
+#include "Benchmark.hpp"
+#include "FrameUniforms.hpp"
+#include "GLState.hpp"
+#include "GpuTimer.hpp"
+#include "OcclusionCuller.hpp"
+#include "ProcessMemory.hpp"
+#include "RenderQueue.hpp"
+#include "SceneBVH.hpp"
 
 #include <iostream>
 
@@ -41,25 +50,27 @@ glm::mat3 normalMatrix;
 glm::vec3 lightDir;
 glm::vec3 lightColor;
 
-// shader uniform locations
-GLint modelLoc;
-GLint viewLoc;
-GLint projectionLoc;
-GLint normalMatrixLoc;
-GLint lightDirLoc;
-GLint lightColorLoc;
+// GPU time of the scene draws, printed every few seconds
+gps::GpuTimer sceneTimer;
+gps::GpuTimer sceneFragments(GL_SAMPLES_PASSED);
 
-GLint skyModelLoc;
+// draws of the frame, sorted to share state; model and normal matrices are set by the queue
+gps::RenderQueue renderQueue;
+const float FAR_PLANE = 500.0f;
 
-// spotlight uniforms 
-GLint spotPosLoc;
-GLint spotDirLoc;
-GLint spotCutOffLoc;
-GLint spotOuterCutOffLoc;
-GLint spotColorLoc;
+// hierarchical Z occlusion culling of the indirect draws, from the occluders visible last frame
+gps::OcclusionCuller occlusionCuller;
+gps::RenderQueue occluderQueue;
+bool occlusionCulling = true;
 
-//pointlight uniforms
-GLint tavPosLoc, tavColorLoc, tavConstLoc, tavLinLoc, tavQuadLoc;
+// levels of detail: error allowed on screen, and in the world for the coarsest level
+const float LOD_PIXEL_ERROR = 1.0f;
+const float LOD_MAX_ERROR = 0.25f;
+bool levelsOfDetail = true;
+
+// per-frame camera, light and fog state, one uniform buffer shared by both shaders
+gps::FrameUniforms frameUniforms;
+gps::FrameData frameData;
 
 // camera
 gps::Camera myCamera(
@@ -95,6 +106,8 @@ GLfloat angle;
 
 // shaders
 gps::Shader myBasicShader;
+// same lighting, transforms read from the render queue's per-draw data
+gps::Shader myBasicIndirectShader;
 gps::Shader skyShader;
 
 //tree animation
@@ -102,6 +115,37 @@ float treeRotationAngle = 0.0f;
 double lastTimeStamp = glfwGetTime();
 float rotationSpeed = 30.0f;
 
+// placement
+float groundLevelY = -3.0f;
+float statuetScale = 0.4f;
+float churchCastleScale = 0.6f;
+float villageScale = 1.5f;
+float treeScale = 2.0f;
+glm::vec3 treePosition = glm::vec3(50.0f, groundLevelY, -10.0f);
+glm::vec3 tavernPos = glm::vec3(80.0f, groundLevelY, -5.0f);
+
+// A model placed in the scene, the BVH objects are the indices into sceneObjects
+struct SceneObject {
+    const char* name;
+    gps::Model3D* model;
+    glm::mat4 transform;
+    // large and solid, drawn into the occlusion culling depth
+    bool occluder;
+    // levels of detail drawn last frame
+    gps::LodState lod;
+};
+std::vector<SceneObject> sceneObjects;
+gps::SceneBVH sceneBVH;
+std::vector<uint32_t> visibleObjects;
+size_t sceneMeshCount = 0;
+size_t treeObject = 0;
+std::vector<uint32_t> occluderObjects;
+
+// triangles drawn during the cinematic tour, at the chosen levels of detail and at full detail
+size_t tourFrames = 0;
+double tourTriangles = 0.0;
+double tourFullDetailTriangles = 0.0;
+
 //animation
 bool cinematic = true;
 double cinematicStartTime = 0.0;
@@ -135,6 +179,39 @@ GLenum glCheckError_(const char *file, int line)
 }
 #define glCheckError() glCheckError_(__FILE__, __LINE__)
 
+glm::mat4 treeTransform() {
+    glm::mat4 transform = glm::mat4(1.0f);
+    transform = glm::translate(transform, treePosition);
+    transform = glm::rotate(transform, glm::radians(treeRotationAngle),
+        glm::vec3(0.0f, 1.0f, 0.0f));
+    return glm::scale(transform, glm::vec3(treeScale));
+}
+
+void addSceneObject(const char* name, gps::Model3D& model, const glm::mat4& transform, bool occluder = false) {
+    SceneObject object = { name, &model, transform, occluder, gps::LodState() };
+    sceneObjects.push_back(object);
+}
+
+gps::BoundingBox sceneObjectBox(const SceneObject& object) {
+    return gps::TransformBounds(object.model->GetBounds(), object.transform).box;
+}
+
+// Prints the object whose box the view ray through the screen center hits first
+void pickObject() {
+    glm::mat4 cameraTransform = glm::inverse(view);
+    glm::vec3 origin = glm::vec3(cameraTransform[3]);
+    glm::vec3 direction = -glm::normalize(glm::vec3(cameraTransform[2]));
+
+    uint32_t object;
+    float distance;
+    if (sceneBVH.Raycast(origin, direction, FAR_PLANE, object, distance)) {
+        std::cout << "Picked : " << sceneObjects[object].name << " at " << distance << std::endl;
+    }
+    else {
+        std::cout << "Picked : nothing" << std::endl;
+    }
+}
+
 void windowResizeCallback(GLFWwindow* window, int width, int height) {
 	fprintf(stdout, "Window resized! New width: %d , and height: %d\n", width, height);
 	//TODO
@@ -166,6 +243,26 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
         if (key == GLFW_KEY_3) {
             currentMode = POINTS;
         }
+        if (key == GLFW_KEY_4) {
+            bool indirect = renderQueue.GetSubmitMode() == gps::SUBMIT_INDIRECT;
+            renderQueue.SetSubmitMode(indirect ? gps::SUBMIT_DIRECT : gps::SUBMIT_INDIRECT);
+            std::cout << "Submit mode : " << (indirect ? "direct" : "indirect") << std::endl;
+        }
+        if (key == GLFW_KEY_5) {
+            occlusionCulling = !occlusionCulling;
+            std::cout << "Occlusion culling : " << (occlusionCulling ? "on" : "off");
+            if (occlusionCulling && !gps::RenderQueue::IsMultiDrawIndirectSupported()) {
+                std::cout << " (needs multi-draw indirect, not available)";
+            }
+            std::cout << std::endl;
+        }
+        if (key == GLFW_KEY_6) {
+            levelsOfDetail = !levelsOfDetail;
+            std::cout << "Levels of detail : " << (levelsOfDetail ? "on" : "off") << std::endl;
+        }
+        if (key == GLFW_KEY_P) {
+            pickObject();
+        }
     }
 }
 
@@ -204,8 +301,6 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
     myCamera.setCameraFront(glm::normalize(direction));
 
     view = myCamera.getViewMatrix();
-    myBasicShader.useShaderProgram();
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
 }
 
 void startCinematicTour() {
@@ -283,13 +378,6 @@ void processMovement() {
 
     if (moved) {
         view = myCamera.getViewMatrix();
-
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-
-        skyShader.useShaderProgram();
-        GLint skyViewLoc = glGetUniformLocation(skyShader.shaderProgram, "view");
-        glUniformMatrix4fv(skyViewLoc, 1, GL_FALSE, glm::value_ptr(view));
     }
 }
 
@@ -309,172 +397,284 @@ void initOpenGLState() {
 	glClearColor(0.7f, 0.7f, 0.7f, 1.0f);
 	glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
     glEnable(GL_FRAMEBUFFER_SRGB);
-	glEnable(GL_DEPTH_TEST); // enable depth-testing
+	gps::GLState::Get().SetEnabled(GL_DEPTH_TEST, true); // enable depth-testing
 	glDepthFunc(GL_LESS); // depth-testing interprets a smaller value as "closer"
-	glEnable(GL_CULL_FACE); // cull face
+	gps::GLState::Get().SetEnabled(GL_CULL_FACE, true); // cull face
 	glCullFace(GL_BACK); // cull back face
 	glFrontFace(GL_CCW); // GL_CCW for counter clock-wise
 }
 
-void initModels() {
-    towerModel.LoadModel("objects/pisaTower.obj", "textures/tower/");
-    churchModel.LoadModel("objects/church.obj", "textures/church/");
-    castleModel.LoadModel("objects/castle.obj", "textures/castle/");
-    statuetModel.LoadModel("objects/Grillparzer_C.obj", "textures/statuet/");
-    groundModel.LoadModel("objects/ground.obj", "textures/ground/");
-    skyModel.LoadModel("objects/skydome.obj", "textures/sky/");
-    treeModel.LoadModel("objects/tree.obj", "textures/tree/");
-    buildingModel.LoadModel("objects/3DModel.obj", "textures/building/");
-    house1Model.LoadModel("objects/house1.obj", "textures/house1/");
-    house2Model.LoadModel("objects/tavern2.obj", "textures/house2/");
-    house3Model.LoadModel("objects/medievalHouse3.obj", "textures/house3/");
-    tavernModel.LoadModel("objects/Tavern.obj", "textures/tavern/");
+bool initModels() {
+    gps::AssetLoader loader;
+
+    // the coarsest levels of detail stay within LOD_MAX_ERROR of the real surface, at the scale each model is placed
+    castleModel.SetLodMaxError(LOD_MAX_ERROR, churchCastleScale * 1.5f);
+    churchModel.SetLodMaxError(LOD_MAX_ERROR, churchCastleScale);
+    towerModel.SetLodMaxError(LOD_MAX_ERROR);
+    statuetModel.SetLodMaxError(LOD_MAX_ERROR, statuetScale);
+    groundModel.SetLodMaxError(LOD_MAX_ERROR, 10.0f);
+    treeModel.SetLodMaxError(LOD_MAX_ERROR, treeScale);
+    buildingModel.SetLodMaxError(LOD_MAX_ERROR, 0.7f);
+    house1Model.SetLodMaxError(LOD_MAX_ERROR, villageScale);
+    house2Model.SetLodMaxError(LOD_MAX_ERROR, villageScale);
+    house3Model.SetLodMaxError(LOD_MAX_ERROR, villageScale);
+    tavernModel.SetLodMaxError(LOD_MAX_ERROR, villageScale);
+    // always around the camera
+    skyModel.SetLodMaxError(0.0f);
+
+    // the big buildings hold most of the vertices; the sky program does not take a model matrix
+    // to decode packed positions, and the tiled ground UVs need more than half floats
+    castleModel.SetVertexFormat(gps::VERTEX_FORMAT_PACKED);
+    churchModel.SetVertexFormat(gps::VERTEX_FORMAT_PACKED);
+    towerModel.SetVertexFormat(gps::VERTEX_FORMAT_PACKED);
+    buildingModel.SetVertexFormat(gps::VERTEX_FORMAT_PACKED);
+    house1Model.SetVertexFormat(gps::VERTEX_FORMAT_PACKED);
+    house2Model.SetVertexFormat(gps::VERTEX_FORMAT_PACKED);
+    house3Model.SetVertexFormat(gps::VERTEX_FORMAT_PACKED);
+    tavernModel.SetVertexFormat(gps::VERTEX_FORMAT_PACKED);
+
+    // every mesh of the scene on 16 bit indices
+    gps::Model3D* models[] = { &castleModel, &churchModel, &towerModel, &statuetModel, &groundModel, &skyModel,
+        &treeModel, &buildingModel, &house1Model, &house2Model, &house3Model, &tavernModel };
+    for (size_t i = 0; i < sizeof(models) / sizeof(models[0]); i++) {
+        models[i]->SetSplitMeshes(true);
+        // picking only needs the boxes of the scene BVH, no triangles stay on the CPU
+        models[i]->SetRetainCpuData(false);
+    }
+
+    // largest first, so the castle starts parsing while the small models stream in
+    loader.Add(castleModel, "objects/castle.obj", "textures/castle/");
+    loader.Add(churchModel, "objects/church.obj", "textures/church/");
+    loader.Add(towerModel, "objects/pisaTower.obj", "textures/tower/");
+    loader.Add(statuetModel, "objects/Grillparzer_C.obj", "textures/statuet/");
+    loader.Add(groundModel, "objects/ground.obj", "textures/ground/");
+    loader.Add(skyModel, "objects/skydome.obj", "textures/sky/");
+    loader.Add(treeModel, "objects/tree.obj", "textures/tree/");
+    loader.Add(buildingModel, "objects/3DModel.obj", "textures/building/");
+    loader.Add(house1Model, "objects/house1.obj", "textures/house1/");
+    loader.Add(house2Model, "objects/tavern2.obj", "textures/house2/");
+    loader.Add(house3Model, "objects/medievalHouse3.obj", "textures/house3/");
+    loader.Add(tavernModel, "objects/Tavern.obj", "textures/tavern/");
+
+    return loader.LoadAll();
+}
+
+// Placement of the opaque models, indexed by sceneBVH
+void initScene() {
+    sceneObjects.clear();
+
+    // GROUND
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(0.0f, groundLevelY, 0.0f));
+    model = glm::scale(model, glm::vec3(10.0f));
+    addSceneObject("ground", groundModel, model);
+
+    // BUILDINGS
+    // CASTLE
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(40.0f, groundLevelY, -100.0f));
+    model = glm::scale(model, glm::vec3(churchCastleScale * 1.5f));
+    addSceneObject("castle", castleModel, model, true);
+
+    // TOWER
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(10.0f, groundLevelY, -40.0f));
+    addSceneObject("tower", towerModel, model, true);
+
+    // CHURCH
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(80.0f, groundLevelY, -40.0f));
+    model = glm::scale(model, glm::vec3(churchCastleScale));
+    addSceneObject("church", churchModel, model, true);
+
+    // STATUET
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(106.0f, groundLevelY, -45.0f));
+    model = glm::scale(model, glm::vec3(statuetScale));
+    addSceneObject("statuet", statuetModel, model);
+
+    // TREE
+    treeObject = sceneObjects.size();
+    addSceneObject("tree", treeModel, treeTransform());
+
+    // BUILDING
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(-20.0f, groundLevelY, -40.0f));
+    model = glm::scale(model, glm::vec3(0.7f));
+    addSceneObject("building", buildingModel, model, true);
+
+    // HOUSE 1
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(0.0f, groundLevelY, 5.0f));
+    model = glm::scale(model, glm::vec3(villageScale));
+    model = glm::rotate(model, glm::radians(10.0f),
+        glm::vec3(0.0f, 1.0f, 0.0f));
+    addSceneObject("house 1", house1Model, model, true);
+
+    // HOUSE 2
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(100.0f, groundLevelY, 5.0f));
+    model = glm::scale(model, glm::vec3(villageScale));
+    model = glm::rotate(model, glm::radians(-10.0f),
+        glm::vec3(0.0f, 1.0f, 0.0f));
+    addSceneObject("house 2", house2Model, model, true);
+
+    // HOUSE 3
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(20.0f, -4.0f, -5.0f));
+    model = glm::scale(model, glm::vec3(villageScale));
+    model = glm::rotate(model, glm::radians(3.0f),
+        glm::vec3(0.0f, 1.0f, 0.0f));
+    addSceneObject("house 3", house3Model, model, true);
+
+    // TAVERN
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, tavernPos);
+    model = glm::scale(model, glm::vec3(villageScale));
+    model = glm::rotate(model, glm::radians(-30.0f),
+        glm::vec3(0.0f, 1.0f, 0.0f));
+    addSceneObject("tavern", tavernModel, model, true);
+
+    std::vector<gps::BoundingBox> boxes;
+    sceneMeshCount = 0;
+    for (size_t i = 0; i < sceneObjects.size(); i++) {
+        boxes.push_back(sceneObjectBox(sceneObjects[i]));
+        sceneMeshCount += sceneObjects[i].model->GetMeshCount();
+    }
+    sceneBVH.Build(boxes);
 }
 
 void initShaders() {
 	myBasicShader.loadShader(
         "shaders/basic.vert",
         "shaders/basic.frag");
+    myBasicIndirectShader.loadShader(
+        "shaders/basic_indirect.vert",
+        "shaders/basic.frag");
     skyShader.loadShader("shaders/sky.vert", "shaders/sky.frag");
+
+    frameUniforms.Create();
+    frameUniforms.Attach(myBasicShader);
+    frameUniforms.Attach(myBasicIndirectShader);
+    frameUniforms.Attach(skyShader);
+
+    occlusionCuller.Create(frameUniforms);
 }
 
 void initUniforms() {
-	myBasicShader.useShaderProgram();
 
     // create model matrix for teapot
     model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-	modelLoc = glGetUniformLocation(myBasicShader.shaderProgram, "model");
 
 	// get view matrix for current camera
 	view = myCamera.getViewMatrix();
-	viewLoc = glGetUniformLocation(myBasicShader.shaderProgram, "view");
-	// send view matrix to shader
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
 
     // compute normal matrix for teapot
     normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
-	normalMatrixLoc = glGetUniformLocation(myBasicShader.shaderProgram, "normalMatrix");
 
 	// create projection matrix
 	projection = glm::perspective(glm::radians(45.0f),
                                (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
-                               0.1f, 500.0f);
-	projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-	// send projection matrix to shader
-	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));	
+                               0.1f, FAR_PLANE);
 
 	//set the light direction (direction towards the light)
 	lightDir = glm::vec3(0.0f, 1.0f, 1.0f);
-	lightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDir");
-	// send light dir to shader
-	glUniform3fv(lightDirLoc, 1, glm::value_ptr(lightDir));
 
 	//set light color
 	lightColor = glm::vec3(1.0f, 1.0f, 1.0f); //white light
-	lightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightColor");
-	// send light color to shader
-	glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
 
+    // frame data that does not change, the rest is filled in by renderScene
+    frameData.lightDir = lightDir;
+    frameData.lightColor = lightColor;
+    frameData.fogDensity = 0.011f;
+    frameData.fogColor = glm::vec4(0.7f, 0.7f, 0.7f, 1.0f);
 
-    skyShader.useShaderProgram();
+    frameData.spotLight.cutOff = glm::cos(glm::radians(12.5f));
+    frameData.spotLight.outerCutOff = glm::cos(glm::radians(17.5f));
+    frameData.spotLight.color = glm::vec3(1.0f, 1.0f, 0.8f);
 
-    skyModelLoc = glGetUniformLocation(skyShader.shaderProgram, "model");
-    GLint skyViewLoc = glGetUniformLocation(skyShader.shaderProgram, "view");
-    GLint skyProjLoc = glGetUniformLocation(skyShader.shaderProgram, "projection");
-
-    glUniformMatrix4fv(skyViewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(skyProjLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    spotPosLoc = glGetUniformLocation(myBasicShader.shaderProgram, "bradSpotLight.position");
-    spotDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "bradSpotLight.direction");
-    spotCutOffLoc = glGetUniformLocation(myBasicShader.shaderProgram, "bradSpotLight.cutOff");
-    spotOuterCutOffLoc = glGetUniformLocation(myBasicShader.shaderProgram, "bradSpotLight.outerCutOff");
-    spotColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "bradSpotLight.color");
-
-    tavPosLoc = glGetUniformLocation(myBasicShader.shaderProgram, "tavernLight.position");
-    tavColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "tavernLight.color");
-    tavConstLoc = glGetUniformLocation(myBasicShader.shaderProgram, "tavernLight.constant");
-    tavLinLoc = glGetUniformLocation(myBasicShader.shaderProgram, "tavernLight.linear");
-    tavQuadLoc = glGetUniformLocation(myBasicShader.shaderProgram, "tavernLight.quadratic");
+    frameData.pointLight.color = glm::vec3(3.0f, 2.5f, 2.0f);
+    frameData.pointLight.constant = 1.0f;
+    frameData.pointLight.linear = 0.09f;
+    frameData.pointLight.quadratic = 0.032f;
 }
 
-GLuint ReadTextureFromFile(const char* file_name) {
-    int x, y, n;
-    int force_channels = 4;
-    unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
+void updateTreeRotation() {
+    double currentTimeStamp = glfwGetTime();
+    double elapsedSeconds = currentTimeStamp - lastTimeStamp;
+    lastTimeStamp = currentTimeStamp;
 
-    if (!image_data) {
-        fprintf(stderr, "ERROR: could not load %s\n", file_name);
-        return 0;
-    }
+    treeRotationAngle += rotationSpeed * (float)elapsedSeconds;
 
-    // NPOT check
-    if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
-        fprintf(
-            stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name
-        );
+    if (treeRotationAngle > 360.0f) {
+        treeRotationAngle -= 360.0f;
     }
 
-    int width_in_bytes = x * 4;
-    unsigned char* top = NULL;
-    unsigned char* bottom = NULL;
-    unsigned char temp = 0;
-    int half_height = y / 2;
+    // the tree keeps its BVH leaf, the boxes above it are refitted
+    sceneObjects[treeObject].transform = treeTransform();
+    sceneBVH.Update((uint32_t)treeObject, sceneObjectBox(sceneObjects[treeObject]));
+}
 
-    for (int row = 0; row < half_height; row++) {
+void renderScene() {
 
-        top = image_data + row * width_in_bytes;
-        bottom = image_data + (y - row - 1) * width_in_bytes;
+    // TREE SPOTLIGHT
+    glm::vec3 spotLightPosWorld = treePosition + glm::vec3(0.0f, 5.0f, 0.0f);
+    frameData.spotLight.position = glm::vec3(view * glm::vec4(spotLightPosWorld, 1.0f));
+    frameData.spotLight.direction = glm::mat3(view) * glm::vec3(0.0f, -1.0f, 0.0f);
 
-        for (int col = 0; col < width_in_bytes; col++) {
+    // TAVERN POINTLIGHT
+    glm::vec3 tavernLightPosWorld = tavernPos + glm::vec3(-9.5f, 6.3f, 0.2f);
+    frameData.pointLight.position = glm::vec3(view * glm::vec4(tavernLightPosWorld, 1.0f));
 
-            temp = *top;
-            *top = *bottom;
-            *bottom = temp;
-            top++;
-            bottom++;
-        }
-    }
+    // camera and lights for every shader, in one upload
+    frameData.view = view;
+    frameData.projection = projection;
+    frameUniforms.Update(frameData);
 
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        GL_SRGB, //GL_SRGB,//GL_RGBA,
-        x,
-        y,
-        0,
-        GL_RGBA,
-        GL_UNSIGNED_BYTE,
-        image_data
-    );
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    return textureID;
+    renderQueue.SetLodThreshold(levelsOfDetail ? LOD_PIXEL_ERROR : 0.0f, myWindow.getWindowDimensions().height);
+    renderQueue.Begin(view, projection, FAR_PLANE);
+    const gps::Shader& opaqueShader = renderQueue.GetSubmitMode() == gps::SUBMIT_INDIRECT ? myBasicIndirectShader : myBasicShader;
 
-}
+    // SKYDOME
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, myCamera.getPosition());
+    model = glm::scale(model, glm::vec3(300.0f));
 
-void updateTreeRotation() {
-    double currentTimeStamp = glfwGetTime();
-    double elapsedSeconds = currentTimeStamp - lastTimeStamp;
-    lastTimeStamp = currentTimeStamp;
+    skyModel.Submit(renderQueue, gps::RENDER_LAYER_BACKGROUND, skyShader, model);
 
-    treeRotationAngle += rotationSpeed * (float)elapsedSeconds;
+    // GROUND, BUILDINGS, TREE: only the objects the BVH finds in the frustum are submitted
+    visibleObjects.clear();
+    sceneBVH.Cull(renderQueue.GetFrustum(), visibleObjects);
 
-    if (treeRotationAngle > 360.0f) {
-        treeRotationAngle -= 360.0f;
+    size_t submittedMeshes = 0;
+    for (size_t i = 0; i < visibleObjects.size(); i++) {
+        SceneObject& object = sceneObjects[visibleObjects[i]];
+        object.model->Submit(renderQueue, gps::RENDER_LAYER_OPAQUE, opaqueShader, object.transform, &object.lod);
+        submittedMeshes += object.model->GetMeshCount();
     }
-}
+    renderQueue.RecordCulling(0, sceneMeshCount - submittedMeshes);
+
+    // OCCLUSION: the occluders visible last frame, depth only, make the Hi-Z pyramid the
+    // opaque draws are tested against (GPU side, between the upload and the multi-draws)
+    bool occlusion = occlusionCulling && renderQueue.GetSubmitMode() == gps::SUBMIT_INDIRECT
+        && gps::RenderQueue::IsMultiDrawIndirectSupported();
+    if (occlusion) {
+        // no LOD threshold on this queue: a coarser level may cover pixels the real surface does not
+        occluderQueue.Begin(view, projection, FAR_PLANE);
+        for (size_t i = 0; i < occluderObjects.size(); i++) {
+            const SceneObject& object = sceneObjects[occluderObjects[i]];
+            object.model->Submit(occluderQueue, gps::RENDER_LAYER_OPAQUE, occlusionCuller.GetDepthShader(), object.transform);
+        }
+        occlusionCuller.BuildHiZ(occluderQueue, projection * view);
+    }
+    renderQueue.SetOcclusionCuller(occlusion ? &occlusionCuller : NULL);
 
-void renderScene() {
+    occluderObjects.clear();
+    for (size_t i = 0; i < visibleObjects.size(); i++) {
+        if (sceneObjects[visibleObjects[i]].occluder) {
+            occluderObjects.push_back(visibleObjects[i]);
+        }
+    }
 
     // RENDER MODE
     switch (currentMode) {
@@ -495,146 +695,25 @@ void renderScene() {
     glClearColor(0.8f, 0.8f, 0.8f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    float groundLevelY = -3.0f;
-    float statuetScale = 0.4f;
-    float churchCastleScale = 0.6f;
-
-    // SKYDOME
-    skyShader.useShaderProgram();
-
-    glDisable(GL_DEPTH_TEST);
-    glCullFace(GL_FRONT);
-    glDisable(GL_CULL_FACE);
 
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, myCamera.getPosition());
-    model = glm::scale(model, glm::vec3(300.0f));
-
-    glUniformMatrix4fv(skyModelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    skyModel.Draw(skyShader);
+    // sorted by state, each program / texture / VAO change is made once
+    sceneTimer.Begin();
+    sceneFragments.Begin();
+    renderQueue.Execute();
+    sceneFragments.End();
+    sceneTimer.End();
 
-    glCullFace(GL_BACK);
-    glEnable(GL_DEPTH_TEST);
-
-    myBasicShader.useShaderProgram();
-
-    // TREE SPOTLIGHT
-    glm::vec3 treePosition = glm::vec3(50.0f, groundLevelY, -10.0f);
-
-    glm::vec3 spotLightPosWorld = treePosition + glm::vec3(0.0f, 5.0f, 0.0f);
-    glm::vec3 spotLightPosEye =
-        glm::vec3(view * glm::vec4(spotLightPosWorld, 1.0f));
-
-    glm::vec3 spotLightDirEye =
-        glm::mat3(view) * glm::vec3(0.0f, -1.0f, 0.0f);
-
-    glUniform3fv(spotPosLoc, 1, glm::value_ptr(spotLightPosEye));
-    glUniform3fv(spotDirLoc, 1, glm::value_ptr(spotLightDirEye));
-    glUniform1f(spotCutOffLoc, glm::cos(glm::radians(12.5f)));
-    glUniform1f(spotOuterCutOffLoc, glm::cos(glm::radians(17.5f)));
-    glUniform3fv(spotColorLoc, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.8f)));
-
-    // TAVERN POINTLIGHT
-    glm::vec3 tavernPos = glm::vec3(80.0f, groundLevelY, -5.0f);
-    glm::vec3 tavernLightPosWorld = tavernPos + glm::vec3(-9.5f, 6.3f, 0.2f);
-    glm::vec3 tavernLightPosEye = glm::vec3(view * glm::vec4(tavernLightPosWorld, 1.0f));
-
-
-    glUniform3fv(tavPosLoc, 1, glm::value_ptr(tavernLightPosEye));
-    glUniform3fv(tavColorLoc, 1, glm::value_ptr(glm::vec3(3.0f, 2.5f, 2.0f)));
-    glUniform1f(tavConstLoc, 1.0f);
-    glUniform1f(tavLinLoc, 0.09f);
-    glUniform1f(tavQuadLoc, 0.032f);
-
-    // GROUND
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(0.0f, groundLevelY, 0.0f));
-    model = glm::scale(model, glm::vec3(10.0f));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    groundModel.Draw(myBasicShader);
-
-    // BUILDINGS
-    // CASTLE
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(40.0f, groundLevelY, -100.0f));
-    model = glm::scale(model, glm::vec3(churchCastleScale * 1.5f));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    castleModel.Draw(myBasicShader);
-
-    // TOWER
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(10.0f, groundLevelY, -40.0f));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    towerModel.Draw(myBasicShader);
-
-    // CHURCH
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(80.0f, groundLevelY, -40.0f));
-    model = glm::scale(model, glm::vec3(churchCastleScale));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    churchModel.Draw(myBasicShader);
-
-    // STATUET
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(106.0f, groundLevelY, -45.0f));
-    model = glm::scale(model, glm::vec3(statuetScale));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    statuetModel.Draw(myBasicShader);
-
-    // TREE
-    float treeScale = 2.0f;
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, treePosition);
-    model = glm::rotate(model, glm::radians(treeRotationAngle),
-        glm::vec3(0.0f, 1.0f, 0.0f));
-    model = glm::scale(model, glm::vec3(treeScale));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    treeModel.Draw(myBasicShader);
-
-    // BUILDING
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(-20.0f, groundLevelY, -40.0f));
-    model = glm::scale(model, glm::vec3(0.7f));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    buildingModel.Draw(myBasicShader);
-
-    float villageScale = 1.5f;
-
-    // HOUSE 1
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(0.0f, groundLevelY, 5.0f));
-    model = glm::scale(model, glm::vec3(villageScale));
-    model = glm::rotate(model, glm::radians(10.0f),
-        glm::vec3(0.0f, 1.0f, 0.0f));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    house1Model.Draw(myBasicShader);
-
-    // HOUSE 2
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(100.0f, groundLevelY, 5.0f));
-    model = glm::scale(model, glm::vec3(villageScale));
-    model = glm::rotate(model, glm::radians(-10.0f),
-        glm::vec3(0.0f, 1.0f, 0.0f));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    house2Model.Draw(myBasicShader);
-
-    // HOUSE 3
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(20.0f, -4.0f, -5.0f));
-    model = glm::scale(model, glm::vec3(villageScale));
-    model = glm::rotate(model, glm::radians(3.0f),
-        glm::vec3(0.0f, 1.0f, 0.0f));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    house3Model.Draw(myBasicShader);
-
-    // TAVERN
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(80.0f, groundLevelY, -5.0f));
-    model = glm::scale(model, glm::vec3(villageScale));
-    model = glm::rotate(model, glm::radians(-30.0f),
-        glm::vec3(0.0f, 1.0f, 0.0f));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    tavernModel.Draw(myBasicShader);
+    double sceneMilliseconds;
+    double fragments;
+    if (sceneTimer.ReadAverage(300, sceneMilliseconds)) {
+        std::cout << "Scene GPU time : " << sceneMilliseconds << " ms" << std::endl;
+        if (sceneFragments.ReadAverage(1, fragments)) {
+            std::cout << "Scene fragments : " << (size_t)fragments << " (occlusion culling " << (occlusion ? "on" : "off") << ")" << std::endl;
+        }
+        renderQueue.PrintStats();
+        gps::GLState::Get().PrintFrameStats();
+        gps::PrintProcessMemory("Memory");
+    }
 }
 
 //for initial animation
@@ -701,23 +780,42 @@ void updateCinematicCamera() {
     }
 
     view = glm::lookAt(camPos, lookAt, glm::vec3(0.0f, 1.0f, 0.0f));
+}
 
-    myBasicShader.useShaderProgram();
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
 
-    skyShader.useShaderProgram();
-    GLint skyViewLoc = glGetUniformLocation(skyShader.shaderProgram, "view");
-    glUniformMatrix4fv(skyViewLoc, 1, GL_FALSE, glm::value_ptr(view));
+// Sums the triangles of every tour frame, prints the averages when the tour is over
+void recordTourTriangles() {
+    if (cinematic) {
+        const gps::RenderQueueStats& stats = renderQueue.GetStats();
+        tourFrames++;
+        tourTriangles += (double)stats.trianglesSubmitted;
+        tourFullDetailTriangles += (double)stats.trianglesFullDetail;
+    }
+    else if (tourFrames > 0) {
+        std::cout << "Cinematic tour : " << tourFrames << " frames, " << (size_t)(tourTriangles / tourFrames)
+            << " triangles per frame with levels of detail " << (levelsOfDetail ? "on" : "off") << ", "
+            << (size_t)(tourFullDetailTriangles / tourFrames) << " at full detail" << std::endl;
+        tourFrames = 0;
+        tourTriangles = 0.0;
+        tourFullDetailTriangles = 0.0;
+    }
 }
 
-
 void cleanup() {
+    renderQueue.Delete();
+    occluderQueue.Delete();
+    occlusionCuller.Delete();
+    frameUniforms.Delete();
     myWindow.Delete();
     //cleanup code for your own data
 }
 
 int main(int argc, const char * argv[]) {
 
+    if (argc > 2 && std::string(argv[1]) == "--benchmark") {
+        return gps::RunBenchmark(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+    }
+
     try {
         initOpenGLWindow();
     } catch (const std::exception& e) {
@@ -726,7 +824,15 @@ int main(int argc, const char * argv[]) {
     }
 
     initOpenGLState();
-	initModels();
+    // the whole opaque scene in one multi-draw per texture set, or a draw loop on GL 4.1
+    renderQueue.SetSubmitMode(gps::SUBMIT_INDIRECT);
+    std::cout << "Multi-draw indirect : " << (gps::RenderQueue::IsMultiDrawIndirectSupported() ? "yes" : "no, draw loop fallback") << std::endl;
+    if (!initModels()) {
+        cleanup();
+        return EXIT_FAILURE;
+    }
+    gps::PrintProcessMemory("Memory after loading");
+	initScene();
 	initShaders();
 	initUniforms();
     setWindowCallbacks();
@@ -749,6 +855,8 @@ int main(int argc, const char * argv[]) {
         lastTime = currentTime;
 
 	    renderScene();
+        recordTourTriangles();
+        gps::GLState::Get().EndFrame();
 
 		glfwPollEvents();
 		glfwSwapBuffers(myWindow.getWindow());
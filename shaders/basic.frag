@@ -6,25 +6,40 @@ in vec2 fragTexCoords;
 
 out vec4 fColor;
 
-// dirlight
-uniform vec3 lightDir;
-uniform vec3 lightColor;
-
-// texturi
-uniform sampler2D diffuseTexture;
-uniform sampler2D specularTexture;
-
-// spotlight
+// per-frame state, shared by all programs (FrameUniforms.hpp), eye space lights
 struct SpotLight
 {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
     vec3 color;
 };
 
-uniform SpotLight bradSpotLight;
+struct PointLight
+{
+    vec3 position;
+    float constant;
+    vec3 color;
+    float linear;
+    float quadratic;
+};
+
+layout(std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 lightDir;
+    float fogDensity;
+    vec3 lightColor;
+    SpotLight bradSpotLight;
+    PointLight tavernLight;
+    vec4 fogColor;
+};
+
+// texturi
+uniform sampler2D diffuseTexture;
+uniform sampler2D specularTexture;
 
 const float ambientStrength  = 0.15;
 const float specularStrength = 0.6;
@@ -33,7 +48,6 @@ const float shininess        = 64.0;
 // fog
 float computeFog()
 {
-    float fogDensity = 0.011;             
     float distance = length(fragPosEye);  
     float fogFactor = exp(-pow(distance * fogDensity, 2.0));
     return clamp(fogFactor, 0.0, 1.0);
@@ -73,15 +87,6 @@ vec3 computeSpotLight()
 }
 
 //pointlight for tavern
-struct PointLight {
-    vec3 position;
-    vec3 color;
-    float constant;
-    float linear;
-    float quadratic;
-};
-uniform PointLight tavernLight;
-
 vec3 computePointLight(PointLight light)
 {
     vec3 N = normalize(normalEye);
@@ -114,7 +119,5 @@ void main()
 
     // fog
     float fogFactor = computeFog();
-    vec4 fogColor = vec4(0.7, 0.7, 0.7, 1.0);
-
     fColor = mix(fogColor, baseColor, fogFactor);
 }
@@ -1,5 +1,7 @@
 #version 410 core
 
+// float or packed (GeometryArena): packed positions are unorm16 in [0, 1] and the model
+// matrix holds their mesh's decode, packed normals are snorm 10:10:10:2, packed UVs half floats
 layout(location = 0) in vec3 vPosition;
 layout(location = 1) in vec3 vNormal;
 layout(location = 2) in vec2 vTexCoords;
@@ -9,15 +11,46 @@ out vec3 normalEye;
 out vec2 fragTexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// per-frame state, shared by all programs (FrameUniforms.hpp), eye space lights
+struct SpotLight
+{
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 color;
+};
+
+struct PointLight
+{
+    vec3 position;
+    float constant;
+    vec3 color;
+    float linear;
+    float quadratic;
+};
+
+layout(std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 lightDir;
+    float fogDensity;
+    vec3 lightColor;
+    SpotLight bradSpotLight;
+    PointLight tavernLight;
+    vec4 fogColor;
+};
+
+// inverse transpose of view * model, computed once per draw on the CPU
+uniform mat3 normalMatrix;
 
 void main()
 {
     vec4 posEye = view * model * vec4(vPosition, 1.0);
     fragPosEye = posEye.xyz;
 
-    mat3 normalMatrix = mat3(transpose(inverse(view * model)));
     normalEye = normalize(normalMatrix * vNormal);
 
     fragTexCoords = vTexCoords;
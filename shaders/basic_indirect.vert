@@ -0,0 +1,68 @@
+#version 410 core
+
+// the vertex inputs of basic.vert, float or packed alike
+layout(location = 0) in vec3 vPosition;
+layout(location = 1) in vec3 vNormal;
+layout(location = 2) in vec2 vTexCoords;
+// index of the draw in drawData, equal to the command's base instance (RenderQueue.hpp)
+layout(location = 3) in uint vDrawIndex;
+
+out vec3 fragPosEye;
+out vec3 normalEye;
+out vec2 fragTexCoords;
+
+// per-draw transforms written by the render queue, 7 texels per draw:
+// the model matrix columns, then the normal matrix columns
+uniform samplerBuffer drawData;
+// added to vDrawIndex, set by the GL 4.1 fallback that draws without base instances
+uniform int drawIndexOffset;
+
+// per-frame state, shared by all programs (FrameUniforms.hpp), eye space lights
+struct SpotLight
+{
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 color;
+};
+
+struct PointLight
+{
+    vec3 position;
+    float constant;
+    vec3 color;
+    float linear;
+    float quadratic;
+};
+
+layout(std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 lightDir;
+    float fogDensity;
+    vec3 lightColor;
+    SpotLight bradSpotLight;
+    PointLight tavernLight;
+    vec4 fogColor;
+};
+
+void main()
+{
+    int first = (int(vDrawIndex) + drawIndexOffset) * 7;
+    mat4 model = mat4(texelFetch(drawData, first), texelFetch(drawData, first + 1),
+                      texelFetch(drawData, first + 2), texelFetch(drawData, first + 3));
+    // inverse transpose of view * model, computed on the CPU
+    mat3 normalMatrix = mat3(texelFetch(drawData, first + 4).xyz, texelFetch(drawData, first + 5).xyz,
+                             texelFetch(drawData, first + 6).xyz);
+
+    vec4 posEye = view * model * vec4(vPosition, 1.0);
+    fragPosEye = posEye.xyz;
+
+    normalEye = normalize(normalMatrix * vNormal);
+
+    fragTexCoords = vTexCoords;
+
+    gl_Position = projection * posEye;
+}
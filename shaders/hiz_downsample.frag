@@ -0,0 +1,20 @@
+#version 410 core
+
+// each texel of a Hi-Z level is the farthest of the 2x2 texels below it
+// (the level below is the texture's base and only level while this runs, so it is lod 0)
+uniform sampler2D hiZ;
+
+out float depth;
+
+void main()
+{
+    ivec2 last = textureSize(hiZ, 0) - 1;
+    ivec2 texel = ivec2(gl_FragCoord.xy) * 2;
+
+    // min() folds the missing row / column of levels that are 1 texel thick
+    float d0 = texelFetch(hiZ, min(texel, last), 0).r;
+    float d1 = texelFetch(hiZ, min(texel + ivec2(1, 0), last), 0).r;
+    float d2 = texelFetch(hiZ, min(texel + ivec2(0, 1), last), 0).r;
+    float d3 = texelFetch(hiZ, min(texel + ivec2(1, 1), last), 0).r;
+    depth = max(max(d0, d1), max(d2, d3));
+}
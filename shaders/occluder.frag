@@ -0,0 +1,9 @@
+#version 410 core
+
+// level 0 of the Hi-Z pyramid is the window space depth
+out float depth;
+
+void main()
+{
+    depth = gl_FragCoord.z;
+}
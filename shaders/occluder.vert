@@ -0,0 +1,42 @@
+#version 410 core
+
+// depth of the occluders, for the Hi-Z pyramid (OcclusionCuller.hpp)
+layout(location = 0) in vec3 vPosition;
+
+uniform mat4 model;
+
+// per-frame state, shared by all programs (FrameUniforms.hpp), eye space lights
+struct SpotLight
+{
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 color;
+};
+
+struct PointLight
+{
+    vec3 position;
+    float constant;
+    vec3 color;
+    float linear;
+    float quadratic;
+};
+
+layout(std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 lightDir;
+    float fogDensity;
+    vec3 lightColor;
+    SpotLight bradSpotLight;
+    PointLight tavernLight;
+    vec4 fogColor;
+};
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(vPosition, 1.0);
+}
@@ -0,0 +1,67 @@
+#version 410 core
+
+// One DrawElementsIndirectCommand and the world space box of its draw per vertex.
+// The command is written back by transform feedback, with no instances if the box is
+// behind the Hi-Z pyramid (OcclusionCuller.hpp).
+layout(location = 0) in uvec4 vCommand;
+layout(location = 1) in uint vBaseInstance;
+// w is 0 for draws that are never culled
+layout(location = 2) in vec4 vBoxCenter;
+layout(location = 3) in vec3 vBoxExtent;
+
+flat out uvec4 command;
+flat out uint baseInstance;
+
+uniform mat4 viewProjection;
+uniform sampler2D hiZ;
+uniform int hiZLevels;
+
+bool isVisible()
+{
+    if (vBoxCenter.w == 0.0) {
+        return true;
+    }
+
+    // screen rectangle and nearest depth of the box corners
+    vec3 minimum = vec3(1.0);
+    vec3 maximum = vec3(-1.0);
+    for (int i = 0; i < 8; i++) {
+
+        vec3 corner = vBoxCenter.xyz + vBoxExtent * vec3((i & 1) != 0 ? 1.0 : -1.0,
+                                                         (i & 2) != 0 ? 1.0 : -1.0,
+                                                         (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = viewProjection * vec4(corner, 1.0);
+        // the box reaches behind the camera
+        if (clip.w <= 0.0) {
+            return true;
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        minimum = min(minimum, ndc);
+        maximum = max(maximum, ndc);
+    }
+
+    vec2 uvMinimum = clamp(minimum.xy * 0.5 + 0.5, 0.0, 1.0);
+    vec2 uvMaximum = clamp(maximum.xy * 0.5 + 0.5, 0.0, 1.0);
+    float nearestDepth = minimum.z * 0.5 + 0.5;
+
+    // the level where the rectangle is at most one texel wide, so 2x2 texels cover it
+    vec2 size = (uvMaximum - uvMinimum) * vec2(textureSize(hiZ, 0));
+    int level = min(int(ceil(log2(max(max(size.x, size.y), 1.0)))), hiZLevels - 1);
+
+    ivec2 levelSize = textureSize(hiZ, level);
+    ivec2 first = clamp(ivec2(uvMinimum * vec2(levelSize)), ivec2(0), levelSize - 1);
+    ivec2 last = clamp(ivec2(uvMaximum * vec2(levelSize)), ivec2(0), levelSize - 1);
+
+    float farthest = max(max(texelFetch(hiZ, first, level).r, texelFetch(hiZ, ivec2(last.x, first.y), level).r),
+                         max(texelFetch(hiZ, ivec2(first.x, last.y), level).r, texelFetch(hiZ, last, level).r));
+    return nearestDepth <= farthest;
+}
+
+void main()
+{
+    command = vCommand;
+    if (!isVisible()) {
+        command.y = 0u;
+    }
+    baseInstance = vBaseInstance;
+}
@@ -3,8 +3,36 @@
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec2 aTex;
 
-uniform mat4 view;
-uniform mat4 projection;
+// per-frame state, shared by all programs (FrameUniforms.hpp), eye space lights
+struct SpotLight
+{
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 color;
+};
+
+struct PointLight
+{
+    vec3 position;
+    float constant;
+    vec3 color;
+    float linear;
+    float quadratic;
+};
+
+layout(std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 lightDir;
+    float fogDensity;
+    vec3 lightColor;
+    SpotLight bradSpotLight;
+    PointLight tavernLight;
+    vec4 fogColor;
+};
 
 out vec2 TexCoord;
 